@@ -2,8 +2,13 @@
 
 #include <array>
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
 #include <limits>
+#include <cstring>
 #include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 
 // zedwood
@@ -18,10 +23,23 @@
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 
+#ifdef SHA256_AFALG
+// Linux kernel crypto API
+#include <fcntl.h>
+#include <linux/if_alg.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifdef USE_NSS
 // NSS
 #include <hasht.h>
+// The header has no C++ guards of its own
+extern "C"
+{
 #include <nsslowhash.h>
+}
 #endif
 
 // Bcrypt
@@ -34,10 +52,21 @@
 #pragma comment(lib, "bcrypt.lib")
 #endif
 
+// Intermediate state of a message, the same for every implementation: the
+// chaining value after the whole blocks hashed so far, the bytes % 64 bytes
+// of the incomplete block and the message length so far
+struct sha256_state
+{
+  std::array<std::uint32_t, 8> h;
+  std::array<unsigned char, 64> block;
+  std::uint64_t bytes;
+};
+
 struct sha256_dummy
 {
   void add_bytes(const unsigned char *, std::size_t) {}
   std::array<unsigned char, 32> digest() { return {}; }
+  void reset() {}
 };
 
 struct sha256_zedwood
@@ -61,6 +90,22 @@ struct sha256_zedwood
     ctx.final(tmp.data());
     return tmp;
   }
+  void reset() { ctx.init(); }
+  // Only for messages below 2^29 bytes: zedwood keeps the length in 32 bits
+  // and its bit count overflows beyond that. The zedwood backend therefore
+  // lacks sha256_midstate, so hash_resumable does not use it.
+  sha256_state save_state() const
+  {
+    sha256_state state = {};
+    unsigned long long bytes;
+    ctx.get_state(state.h.data(), state.block.data(), bytes);
+    state.bytes = bytes;
+    return state;
+  }
+  void load_state(const sha256_state &state)
+  {
+    ctx.set_state(state.h.data(), state.block.data(), state.bytes);
+  }
 };
 
 struct sha256_openssl_deprecated
@@ -80,6 +125,7 @@ struct sha256_openssl_deprecated
     SHA256_Final(tmp.data(), &ctx);
     return tmp;
   }
+  void reset() { SHA256_Init(&ctx); }
 };
 
 struct openssl_evp_destroyer
@@ -95,7 +141,7 @@ struct openssl_md_destroyer
 struct sha256_openssl
 {
   std::unique_ptr<EVP_MD_CTX, openssl_evp_destroyer> ctx;
-  const std::unique_ptr<EVP_MD, openssl_md_destroyer> md;
+  std::unique_ptr<EVP_MD, openssl_md_destroyer> md;
 
   sha256_openssl() : ctx(EVP_MD_CTX_create()), md(EVP_MD_fetch(NULL, "SHA256", NULL))
   {
@@ -116,9 +162,10 @@ struct sha256_openssl
     EVP_DigestFinal_ex(ctx.get(), tmp.data(), nullptr);
     return tmp;
   }
+  void reset() { EVP_DigestInit_ex(ctx.get(), md.get(), NULL); }
 };
 
-static std::unique_ptr<EVP_MD, openssl_md_destroyer> global_md;
+inline std::unique_ptr<EVP_MD, openssl_md_destroyer> global_md;
 
 struct sha256_openssl_global
 {
@@ -143,6 +190,83 @@ struct sha256_openssl_global
     EVP_DigestFinal_ex(ctx.get(), tmp.data(), nullptr);
     return tmp;
   }
+  void reset() { EVP_DigestInit_ex(ctx.get(), global_md.get(), NULL); }
+};
+
+// Per-thread cache of initialized EVP_MD_CTX objects sharing one fetched
+// EVP_MD. Contexts are only touched by their own thread, so no locking is
+// needed.
+class openssl_context_pool
+{
+public:
+  static constexpr std::size_t max_cached = 16;
+
+  static openssl_context_pool &local()
+  {
+    thread_local openssl_context_pool pool;
+    return pool;
+  }
+
+  EVP_MD_CTX *acquire()
+  {
+    if (!cached.empty())
+    {
+      EVP_MD_CTX *ctx = cached.back().release();
+      cached.pop_back();
+      return ctx;
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+    assert(ctx);
+    EVP_DigestInit_ex(ctx, md.get(), NULL);
+    return ctx;
+  }
+
+  void release(EVP_MD_CTX *ctx)
+  {
+    if (cached.size() >= max_cached)
+    {
+      EVP_MD_CTX_destroy(ctx);
+      return;
+    }
+    EVP_DigestInit_ex(ctx, md.get(), NULL);
+    cached.emplace_back(ctx);
+  }
+
+private:
+  openssl_context_pool() : md(EVP_MD_fetch(NULL, "SHA256", NULL))
+  {
+    cached.reserve(max_cached);
+  }
+
+  std::unique_ptr<EVP_MD, openssl_md_destroyer> md;
+  std::vector<std::unique_ptr<EVP_MD_CTX, openssl_evp_destroyer>> cached;
+};
+
+struct openssl_pool_releaser
+{
+  void operator()(EVP_MD_CTX *ctx) const
+  {
+    openssl_context_pool::local().release(ctx);
+  }
+};
+
+struct sha256_openssl_pooled
+{
+  std::unique_ptr<EVP_MD_CTX, openssl_pool_releaser> ctx;
+
+  sha256_openssl_pooled() : ctx(openssl_context_pool::local().acquire()) {}
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    EVP_DigestUpdate(ctx.get(), bytes, num);
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp;
+    EVP_DigestFinal_ex(ctx.get(), tmp.data(), nullptr);
+    return tmp;
+  }
+  void reset() { EVP_DigestInit_ex2(ctx.get(), NULL, NULL); }
 };
 
 struct sha256_openssl_oneshot
@@ -156,7 +280,53 @@ struct sha256_openssl_oneshot
   {
     return digest_data;
   }
+  void reset() {}
+};
+
+#ifdef USE_NSS
+// Lives until the process exits, NSSLOW_Shutdown is never needed
+inline NSSLOWInitContext *nss_init_context()
+{
+  static NSSLOWInitContext *const ctx = NSSLOW_Init();
+  return ctx;
+}
+
+struct nss_hash_destroyer
+{
+  void operator()(NSSLOWHASHContext *ctx) const { NSSLOWHASH_Destroy(ctx); }
+};
+
+struct sha256_libnss
+{
+  std::unique_ptr<NSSLOWHASHContext, nss_hash_destroyer> ctx;
+
+  sha256_libnss() : ctx(NSSLOWHASH_NewContext(nss_init_context(), HASH_AlgSHA256))
+  {
+    assert(static_cast<bool>(ctx));
+    NSSLOWHASH_Begin(ctx.get());
+  }
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    constexpr std::size_t max_bytes = (std::numeric_limits<unsigned int>::max)() / 2;
+    unsigned int size = 0;
+    for (std::size_t i = 0; i < num; i += size, bytes += size)
+    {
+      size = static_cast<unsigned int>((std::min)(max_bytes, num - i));
+      NSSLOWHASH_Update(ctx.get(), bytes, size);
+    }
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp;
+    unsigned int length = 0;
+    NSSLOWHASH_End(ctx.get(), tmp.data(), &length, static_cast<unsigned int>(tmp.size()));
+    assert(length == tmp.size());
+    return tmp;
+  }
+  void reset() { NSSLOWHASH_Begin(ctx.get()); }
 };
+#endif
 
 #ifdef _WIN32
 struct bcrypt_alg_destroyer
@@ -216,6 +386,14 @@ struct sha256_bcrypt
     assert(ret == STATUS_SUCCESS);
     return tmp;
   }
+  void reset()
+  {
+    BCRYPT_HASH_HANDLE handle;
+    auto ret = BCryptCreateHash(alg.get(), &handle, NULL, 0, NULL, 0, 0);
+    (void)ret;
+    assert(ret == STATUS_SUCCESS);
+    ctx.reset(handle);
+  }
 };
 #endif
 
@@ -228,11 +406,250 @@ struct sha256_bitcoin
   {
     ctx.Write(bytes, num);
   }
+  void add_iovec(const struct iovec *iov, std::size_t iovcnt)
+  {
+    ctx.Write(iov, iovcnt);
+  }
   std::array<unsigned char, 32> digest()
   {
     std::array<unsigned char, 32> tmp;
     ctx.Finalize(tmp.data());
     return tmp;
   }
+  void reset() { ctx.Reset(); }
+  sha256_state save_state() const
+  {
+    sha256_state state = {};
+    ctx.GetState(state.h.data(), state.block.data(), state.bytes);
+    return state;
+  }
+  void load_state(const sha256_state &state)
+  {
+    ctx.SetState(state.h.data(), state.block.data(), state.bytes);
+  }
+
+  // Runs of 64-byte messages go to the multi-way SHA256D64 kernels
+  void double_hash_many(std::span<const std::span<const unsigned char>> inputs,
+                        std::span<std::array<unsigned char, 32>> out)
+  {
+    constexpr std::size_t chunk = 32;
+    unsigned char blocks[64 * chunk];
+    unsigned char digests[32 * chunk];
+    std::size_t i = 0;
+    while (i < inputs.size())
+    {
+      std::size_t n = 0;
+      while (n < chunk && i + n < inputs.size() && inputs[i + n].size() == 64)
+      {
+        std::memcpy(blocks + 64 * n, inputs[i + n].data(), 64);
+        ++n;
+      }
+      if (n > 0)
+      {
+        SHA256D64(digests, blocks, n);
+        for (std::size_t j = 0; j < n; ++j)
+        {
+          std::memcpy(out[i + j].data(), digests + 32 * j, 32);
+        }
+        i += n;
+        continue;
+      }
+      ctx.Reset();
+      ctx.Write(inputs[i].data(), inputs[i].size());
+      std::array<unsigned char, 32> first;
+      ctx.Finalize(first.data());
+      ctx.Reset();
+      ctx.Write(first.data(), first.size());
+      ctx.Finalize(out[i].data());
+      ++i;
+    }
+    ctx.Reset();
+  }
 };
 #endif
+
+#ifdef SHA256_AFALG
+// Bound once per process; -1 if the kernel was built without
+// CONFIG_CRYPTO_USER_API_HASH or has no sha256 transform
+inline int afalg_sha256_socket()
+{
+  static const int fd = []
+  {
+    int tfm = ::socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (tfm < 0)
+    {
+      return -1;
+    }
+    sockaddr_alg addr = {};
+    addr.salg_family = AF_ALG;
+    std::memcpy(addr.salg_type, "hash", sizeof("hash"));
+    std::memcpy(addr.salg_name, "sha256", sizeof("sha256"));
+    if (::bind(tfm, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+      ::close(tfm);
+      return -1;
+    }
+    return tfm;
+  }();
+  return fd;
+}
+
+// Hashes in the kernel, with whatever SHA-NI or AVX2 glue it selected. Every
+// hasher accepts its own operation socket; all but the last part of a message
+// are sent with MSG_MORE. Check available() first, the wrapper does nothing
+// useful otherwise.
+struct sha256_afalg
+{
+  int op = -1;
+  // For add_fd, created on first use
+  int pipe_fds[2] = {-1, -1};
+  std::size_t pipe_size = 0;
+  // Bytes were sent since the last digest()
+  bool pending = false;
+
+  static bool available() { return afalg_sha256_socket() >= 0; }
+
+  sha256_afalg()
+  {
+    if (available())
+    {
+      op = ::accept4(afalg_sha256_socket(), nullptr, nullptr, SOCK_CLOEXEC);
+    }
+    assert(op >= 0 || !available());
+  }
+  sha256_afalg(sha256_afalg &&other) noexcept
+      : op(std::exchange(other.op, -1)),
+        pipe_fds{std::exchange(other.pipe_fds[0], -1), std::exchange(other.pipe_fds[1], -1)},
+        pipe_size(other.pipe_size), pending(other.pending)
+  {
+  }
+  sha256_afalg &operator=(sha256_afalg &&) = delete;
+  ~sha256_afalg()
+  {
+    for (int fd : {op, pipe_fds[0], pipe_fds[1]})
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+    }
+  }
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    while (num > 0)
+    {
+      ssize_t sent = ::send(op, bytes, num, MSG_MORE);
+      if (sent < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      assert(sent > 0);
+      if (sent <= 0)
+      {
+        return;
+      }
+      pending = true;
+      bytes += sent;
+      num -= static_cast<std::size_t>(sent);
+    }
+  }
+
+  // Hashes fd from its current position to the end without copying the data
+  // to user space: a pipe is spliced into the socket directly, anything else
+  // through a pipe of this hasher. The bytes hashed, -1 with errno set on
+  // failure. sendfile() is not used since it may clear MSG_MORE on the last
+  // page, which would end the message.
+  long long add_fd(int fd)
+  {
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      return -1;
+    }
+    if (S_ISFIFO(st.st_mode))
+    {
+      return splice_all(fd, std::size_t(1) << 20, true);
+    }
+    if (pipe_fds[0] < 0)
+    {
+      if (::pipe2(pipe_fds, O_CLOEXEC) != 0)
+      {
+        return -1;
+      }
+      // Limited by /proc/sys/fs/pipe-max-size
+      ::fcntl(pipe_fds[1], F_SETPIPE_SZ, 1 << 20);
+      int size = ::fcntl(pipe_fds[1], F_GETPIPE_SZ);
+      pipe_size = size > 0 ? static_cast<std::size_t>(size) : std::size_t(65536);
+    }
+    long long total = 0;
+    for (;;)
+    {
+      ssize_t spliced =
+          ::splice(fd, nullptr, pipe_fds[1], nullptr, pipe_size, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (spliced < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (spliced <= 0)
+      {
+        return spliced == 0 ? total : -1;
+      }
+      if (splice_all(pipe_fds[0], static_cast<std::size_t>(spliced), false) != spliced)
+      {
+        return -1;
+      }
+      total += spliced;
+    }
+  }
+
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp = {};
+    // Without MSG_MORE pending, the kernel returns the digest of the empty
+    // message
+    ssize_t num = ::read(op, tmp.data(), tmp.size());
+    (void)num;
+    assert(num == static_cast<ssize_t>(tmp.size()) || !available());
+    pending = false;
+    return tmp;
+  }
+  // The next send starts a new message once the pending one is finalized
+  void reset()
+  {
+    if (pending)
+    {
+      digest();
+    }
+  }
+
+private:
+  // Moves num bytes from a pipe into the socket, or everything up to the end
+  // of the pipe's input with until_eof
+  long long splice_all(int from, std::size_t num, bool until_eof)
+  {
+    long long total = 0;
+    while (until_eof || static_cast<std::size_t>(total) < num)
+    {
+      std::size_t chunk = until_eof ? num : num - static_cast<std::size_t>(total);
+      ssize_t moved =
+          ::splice(from, nullptr, op, nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (moved < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (moved < 0 || (moved == 0 && !until_eof))
+      {
+        return -1;
+      }
+      if (moved == 0)
+      {
+        break;
+      }
+      pending = true;
+      total += moved;
+    }
+    return total;
+  }
+};
+#endif // SHA256_AFALG
@@ -0,0 +1,118 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#include <openssl/crypto.h>
+
+namespace
+{
+thread_local std::uint64_t num_allocations = 0;
+thread_local std::uint64_t num_bytes = 0;
+
+inline void count(std::size_t size)
+{
+  ++num_allocations;
+  num_bytes += size;
+}
+
+void *allocate(std::size_t size)
+{
+  count(size);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *allocate_aligned(std::size_t size, std::align_val_t alignment)
+{
+  count(size);
+  auto align = static_cast<std::size_t>(alignment);
+  size = (size + align - 1) / align * align;
+#ifdef _WIN32
+  return _aligned_malloc(size == 0 ? align : size, align);
+#else
+  return std::aligned_alloc(align, size == 0 ? align : size);
+#endif
+}
+
+void deallocate_aligned(void *ptr)
+{
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+void *openssl_malloc(std::size_t size, const char *, int)
+{
+  count(size);
+  return std::malloc(size);
+}
+
+void *openssl_realloc(void *ptr, std::size_t size, const char *, int)
+{
+  count(size);
+  return std::realloc(ptr, size);
+}
+
+void openssl_free(void *ptr, const char *, int) { std::free(ptr); }
+
+// Has to run before OpenSSL allocates anything
+const bool openssl_hooked =
+    CRYPTO_set_mem_functions(openssl_malloc, openssl_realloc, openssl_free) == 1;
+} // namespace
+
+allocation_counts thread_allocation_counts()
+{
+  return {num_allocations, num_bytes};
+}
+
+bool openssl_allocations_counted() { return openssl_hooked; }
+
+void *operator new(std::size_t size)
+{
+  void *ptr = allocate(size);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+  void *ptr = allocate_aligned(size, alignment);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { deallocate_aligned(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { deallocate_aligned(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { deallocate_aligned(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { deallocate_aligned(ptr); }
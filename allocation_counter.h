@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+struct allocation_counts
+{
+  std::uint64_t allocations = 0;
+  std::uint64_t bytes = 0;
+};
+
+// Heap allocations made by the calling thread so far, through the global
+// operator new and through OpenSSL's CRYPTO_malloc/CRYPTO_realloc.
+allocation_counts thread_allocation_counts();
+
+// False if the OpenSSL memory functions could not be replaced, in which case
+// allocations inside OpenSSL are not part of the counts.
+bool openssl_allocations_counted();
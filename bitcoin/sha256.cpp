@@ -5,6 +5,7 @@
 #include "sha256.h"
 #include "common.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <string.h>
 #include <iostream>
@@ -712,6 +713,49 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
     return *this;
 }
 
+CSHA256& CSHA256::Write(const struct iovec* iov, size_t iovcnt)
+{
+    // Assembled blocks are flushed in groups to amortize the Transform setup.
+    unsigned char blocks[64 * 16];
+    size_t fill = bytes % 64;
+    memcpy(blocks, buf, fill);
+    for (size_t i = 0; i < iovcnt; ++i) {
+        const unsigned char* data = static_cast<const unsigned char*>(iov[i].iov_base);
+        size_t len = iov[i].iov_len;
+        while (len > 0) {
+            size_t partial = fill % 64;
+            if (partial == 0 && len >= 64) {
+                if (fill) {
+                    Transform(s, blocks, fill / 64);
+                    fill = 0;
+                }
+                size_t run = len / 64;
+                Transform(s, data, run);
+                data += 64 * run;
+                len -= 64 * run;
+                bytes += 64 * run;
+                continue;
+            }
+            // Complete the current block, or start one with a short fragment
+            size_t take = partial ? std::min(len, 64 - partial) : len;
+            memcpy(blocks + fill, data, take);
+            fill += take;
+            data += take;
+            len -= take;
+            bytes += take;
+            if (fill == sizeof(blocks)) {
+                Transform(s, blocks, sizeof(blocks) / 64);
+                fill = 0;
+            }
+        }
+    }
+    if (fill >= 64) {
+        Transform(s, blocks, fill / 64);
+    }
+    memcpy(buf, blocks + fill / 64 * 64, fill % 64);
+    return *this;
+}
+
 void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
 {
     static const unsigned char pad[64] = {0x80};
@@ -736,6 +780,21 @@ CSHA256& CSHA256::Reset()
     return *this;
 }
 
+void CSHA256::GetState(uint32_t state[8], unsigned char partial[64], uint64_t& written) const
+{
+    std::copy(s, s + 8, state);
+    std::copy(buf, buf + bytes % 64, partial);
+    written = bytes;
+}
+
+CSHA256& CSHA256::SetState(const uint32_t state[8], const unsigned char partial[64], uint64_t written)
+{
+    std::copy(state, state + 8, s);
+    std::copy(partial, partial + written % 64, buf);
+    bytes = written;
+    return *this;
+}
+
 void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
 {
     if (TransformD64_8way) {
@@ -9,6 +9,19 @@
 #include <stdint.h>
 #include <string>
 
+#ifdef _WIN32
+#ifndef SHA256_IOVEC_DEFINED
+#define SHA256_IOVEC_DEFINED
+/** Scatter/gather buffer as declared in POSIX <sys/uio.h>. */
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+#endif
+#else
+#include <sys/uio.h>
+#endif
+
 /** A hasher class for SHA-256. */
 class CSHA256
 {
@@ -22,8 +35,16 @@ public:
 
     CSHA256();
     CSHA256& Write(const unsigned char* data, size_t len);
+    /** Hash the concatenation of iovcnt fragments. Blocks spanning fragment
+     *  boundaries are assembled on the stack and compressed together, runs of
+     *  whole blocks are compressed in place. */
+    CSHA256& Write(const struct iovec* iov, size_t iovcnt);
     void Finalize(unsigned char hash[OUTPUT_SIZE]);
     CSHA256& Reset();
+    /** Export or restore the intermediate state: the chaining value, the
+     *  buffered bytes of the incomplete block and the number of bytes written. */
+    void GetState(uint32_t state[8], unsigned char partial[64], uint64_t& written) const;
+    CSHA256& SetState(const uint32_t state[8], const unsigned char partial[64], uint64_t written);
 };
 
 namespace sha256_implementation {
@@ -0,0 +1,452 @@
+#include "blob_store.h"
+
+#include "file_hash.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <set>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+// Blobs are hashed in batches of up to this many blobs or about this many
+// bytes before their writes are queued
+constexpr std::size_t put_batch = 64;
+constexpr std::size_t put_batch_bytes = std::size_t(1) << 20;
+
+[[noreturn]] void throw_errno(const char *what, int error = errno)
+{
+  throw std::system_error(error, std::generic_category(), what);
+}
+
+// "ab/cdef..." relative to the root
+std::string relative_name(const sha256_digest &digest)
+{
+  std::string hex = to_hex(digest);
+  return hex.substr(0, 2) + "/" + hex.substr(2);
+}
+} // namespace
+
+blob_writer::blob_writer(blob_store &store, sha256_engine engine)
+    : store(&store), engine(std::move(engine))
+{
+  this->engine.reset();
+  fd = store.open_temp(temp_name);
+}
+
+blob_writer::blob_writer(blob_writer &&other) noexcept
+    : store(other.store), engine(std::move(other.engine)), fd(other.fd),
+      temp_name(std::move(other.temp_name)), size(other.size)
+{
+  other.fd = -1;
+}
+
+blob_writer::~blob_writer()
+{
+  if (fd >= 0)
+  {
+    store->discard_temp(fd, temp_name);
+  }
+}
+
+void blob_writer::write(std::span<const unsigned char> data)
+{
+  store->write_all(fd, data, size);
+  engine.add_bytes(data.data(), data.size());
+  size += data.size();
+}
+
+blob_put_result blob_writer::commit()
+{
+  blob_put_result result = {engine.digest(), false};
+  int temp_fd = fd;
+  fd = -1;
+  if (store->has(result.digest))
+  {
+    store->discard_temp(temp_fd, temp_name);
+  }
+  else
+  {
+    result.stored = store->link_temp(temp_fd, temp_name, result.digest);
+  }
+  store->count(result.stored, size);
+  return result;
+}
+
+blob_store::blob_store(const std::string &root, const sha256_backend &backend,
+                       const blob_store_options &options)
+    : root(root), backend(backend), opts(options), engine(backend.create())
+{
+  std::filesystem::create_directories(root);
+  root_fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd < 0)
+  {
+    throw_errno("open");
+  }
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 0; i < 257; ++i)
+  {
+    char name[3] = {digits[i / 16 % 16], digits[i % 16], '\0'};
+    // Named temporary files go to tmp, on the same file system
+    const char *dir = i < 256 ? name : "tmp";
+    if (::mkdirat(root_fd, dir, 0755) != 0 && errno != EEXIST)
+    {
+      int error = errno;
+      ::close(root_fd);
+      throw_errno("mkdir", error);
+    }
+  }
+#ifdef O_TMPFILE
+  int fd = ::openat(root_fd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0444);
+  if (fd >= 0)
+  {
+    unnamed_temp = ::access("/proc/self/fd", X_OK) == 0;
+    ::close(fd);
+  }
+#endif
+  if (opts.overlap)
+  {
+    writer_thread = std::thread([this] { job_loop(); });
+  }
+}
+
+blob_store::~blob_store()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (writer_thread.joinable())
+  {
+    writer_thread.join();
+  }
+  ::close(root_fd);
+}
+
+bool blob_store::has(const sha256_digest &digest) const
+{
+  struct stat st;
+  return ::fstatat(root_fd, relative_name(digest).c_str(), &st, 0) == 0;
+}
+
+std::vector<bool> blob_store::has_many(std::span<const sha256_digest> digests) const
+{
+  std::vector<bool> found(digests.size());
+  for (std::size_t i = 0; i < digests.size(); ++i)
+  {
+    found[i] = has(digests[i]);
+  }
+  return found;
+}
+
+blob_put_result blob_store::put(std::span<const unsigned char> data)
+{
+  sha256_input blob = data;
+  return put_many(std::span<const sha256_input>(&blob, 1))[0];
+}
+
+std::vector<blob_put_result> blob_store::put_many(std::span<const sha256_input> blobs)
+{
+  std::vector<blob_put_result> results(blobs.size());
+  // Written by the jobs, so not a vector<bool>
+  std::vector<char> stored(blobs.size(), 0);
+  // New blobs of this call whose writes are queued
+  std::set<sha256_digest> queued;
+  std::vector<sha256_digest> digests(put_batch);
+
+  // Queued jobs refer to the locals above
+  try
+  {
+    // Every blob is hashed before it is written, so duplicates are never
+    // written, and the writes of one batch overlap with hashing the next
+    for (std::size_t first = 0; first < blobs.size();)
+    {
+      std::size_t count = 0;
+      std::size_t bytes = 0;
+      while (first + count < blobs.size() && count < put_batch && bytes < put_batch_bytes)
+      {
+        bytes += blobs[first + count++].size();
+      }
+      engine.hash_many(blobs.subspan(first, count),
+                       std::span<sha256_digest>(digests).first(count));
+      for (std::size_t i = first; i < first + count; ++i)
+      {
+        const auto &digest = results[i].digest = digests[i - first];
+        if (!queued.count(digest) && !has(digest))
+        {
+          queued.insert(digest);
+          submit([this, &stored, &blobs, &results, i]
+                 { stored[i] = store_blob(blobs[i], results[i].digest); });
+        }
+      }
+      first += count;
+    }
+  }
+  catch (...)
+  {
+    try
+    {
+      wait_jobs();
+    }
+    catch (...)
+    {
+    }
+    throw;
+  }
+  wait_jobs();
+
+  for (std::size_t i = 0; i < blobs.size(); ++i)
+  {
+    results[i].stored = stored[i] != 0;
+    count(results[i].stored, blobs[i].size());
+  }
+  return results;
+}
+
+blob_writer blob_store::writer()
+{
+  return blob_writer(*this, backend.create());
+}
+
+std::optional<std::vector<unsigned char>> blob_store::get(const sha256_digest &digest) const
+{
+  int fd = ::openat(root_fd, relative_name(digest).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    if (errno == ENOENT)
+    {
+      return std::nullopt;
+    }
+    throw_errno("open");
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+  {
+    int error = errno;
+    ::close(fd);
+    throw_errno("fstat", error);
+  }
+  std::vector<unsigned char> data(static_cast<std::size_t>(st.st_size));
+  std::size_t done = 0;
+  while (done < data.size())
+  {
+    ssize_t num = ::read(fd, data.data() + done, data.size() - done);
+    if (num < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (num <= 0)
+    {
+      int error = num < 0 ? errno : EIO;
+      ::close(fd);
+      throw_errno("read", error);
+    }
+    done += static_cast<std::size_t>(num);
+  }
+  ::close(fd);
+  return data;
+}
+
+std::string blob_store::path(const sha256_digest &digest) const
+{
+  return root + "/" + relative_name(digest);
+}
+
+blob_store_stats blob_store::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return counters;
+}
+
+int blob_store::open_temp(std::string &temp_name)
+{
+  temp_name.clear();
+#ifdef O_TMPFILE
+  if (unnamed_temp)
+  {
+    int fd = ::openat(root_fd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0444);
+    if (fd < 0)
+    {
+      throw_errno("open");
+    }
+    return fd;
+  }
+#endif
+  std::string templ = root + "/tmp/blob.XXXXXX";
+  std::vector<char> buffer(templ.begin(), templ.end());
+  buffer.push_back('\0');
+  int fd = ::mkostemp(buffer.data(), O_CLOEXEC);
+  if (fd < 0)
+  {
+    throw_errno("mkostemp");
+  }
+  ::fchmod(fd, 0444);
+  temp_name = buffer.data();
+  return fd;
+}
+
+void blob_store::write_all(int fd, std::span<const unsigned char> data, std::uint64_t offset)
+{
+  while (!data.empty())
+  {
+    ssize_t num = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset));
+    if (num < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      throw_errno("write");
+    }
+    data = data.subspan(static_cast<std::size_t>(num));
+    offset += static_cast<std::uint64_t>(num);
+  }
+}
+
+bool blob_store::link_temp(int fd, const std::string &temp_name, const sha256_digest &digest)
+{
+  if (opts.sync && ::fsync(fd) != 0)
+  {
+    int error = errno;
+    discard_temp(fd, temp_name);
+    throw_errno("fsync", error);
+  }
+  std::string name = relative_name(digest);
+  int result = temp_name.empty()
+                   ? ::linkat(AT_FDCWD, ("/proc/self/fd/" + std::to_string(fd)).c_str(),
+                              root_fd, name.c_str(), AT_SYMLINK_FOLLOW)
+                   : ::linkat(AT_FDCWD, temp_name.c_str(), root_fd, name.c_str(), 0);
+  int error = result == 0 ? 0 : errno;
+  discard_temp(fd, temp_name);
+  // EEXIST: another writer stored the same blob first
+  if (error != 0 && error != EEXIST)
+  {
+    throw_errno("link", error);
+  }
+  if (error == 0 && opts.sync)
+  {
+    int dir = ::openat(root_fd, name.substr(0, 2).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0)
+    {
+      ::fsync(dir);
+      ::close(dir);
+    }
+  }
+  return error == 0;
+}
+
+void blob_store::discard_temp(int fd, const std::string &temp_name)
+{
+  ::close(fd);
+  if (!temp_name.empty())
+  {
+    ::unlink(temp_name.c_str());
+  }
+}
+
+bool blob_store::store_blob(std::span<const unsigned char> data, const sha256_digest &digest)
+{
+  std::string temp_name;
+  int fd = open_temp(temp_name);
+  try
+  {
+    write_all(fd, data, 0);
+  }
+  catch (...)
+  {
+    discard_temp(fd, temp_name);
+    throw;
+  }
+  return link_temp(fd, temp_name, digest);
+}
+
+void blob_store::count(bool stored, std::uint64_t bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stored)
+  {
+    ++counters.blobs_stored;
+    counters.bytes_stored += bytes;
+  }
+  else
+  {
+    ++counters.blobs_deduplicated;
+  }
+}
+
+void blob_store::submit(std::function<void()> job)
+{
+  if (!opts.overlap)
+  {
+    try
+    {
+      job();
+    }
+    catch (...)
+    {
+      if (!job_error)
+      {
+        job_error = std::current_exception();
+      }
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  changed.notify_all();
+}
+
+void blob_store::wait_jobs()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [this] { return jobs.empty() && !running; });
+  if (job_error)
+  {
+    std::exception_ptr error;
+    std::swap(error, job_error);
+    std::rethrow_exception(error);
+  }
+}
+
+void blob_store::job_loop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    changed.wait(lock, [this] { return stopping || !jobs.empty(); });
+    if (jobs.empty())
+    {
+      return;
+    }
+    auto job = std::move(jobs.front());
+    jobs.pop_front();
+    running = true;
+    lock.unlock();
+    // Jobs clean up after themselves, so the ones after a failure still run
+    std::exception_ptr error;
+    try
+    {
+      job();
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !job_error)
+    {
+      job_error = error;
+    }
+    running = false;
+    changed.notify_all();
+  }
+}
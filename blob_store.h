@@ -0,0 +1,135 @@
+#pragma once
+
+// Content-addressable storage on the local file system. Every blob is stored
+// once, under the hex SHA-256 of its contents, in 256 fan-out directories:
+// root/ab/cdef... for a digest starting with 0xab.
+
+#include "sha256_engine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct blob_store_options
+{
+  // fsync blobs and their directory before a put returns
+  bool sync = false;
+  // Write blobs on a second thread while the next ones are hashed
+  bool overlap = true;
+};
+
+struct blob_put_result
+{
+  sha256_digest digest;
+  // false if the blob was already in the store
+  bool stored;
+};
+
+struct blob_store_stats
+{
+  std::uint64_t blobs_stored = 0;
+  std::uint64_t blobs_deduplicated = 0;
+  std::uint64_t bytes_stored = 0;
+};
+
+class blob_store;
+
+// Streams one blob into the store: data is hashed as it is appended to an
+// unnamed temporary file, which commit() links under its digest or discards
+// if the store already has it. Destroying an uncommitted writer discards it.
+class blob_writer
+{
+public:
+  blob_writer(blob_writer &&other) noexcept;
+  blob_writer &operator=(blob_writer &&) = delete;
+  ~blob_writer();
+
+  void write(std::span<const unsigned char> data);
+  blob_put_result commit();
+
+private:
+  friend class blob_store;
+  blob_writer(blob_store &store, sha256_engine engine);
+
+  blob_store *store;
+  sha256_engine engine;
+  int fd = -1;
+  std::string temp_name;
+  std::uint64_t size = 0;
+};
+
+// Errors are reported as std::system_error. A blob becomes visible atomically
+// when it is complete, so concurrent readers and writers, also in other
+// processes, never see partial blobs. has and get may be called from any
+// thread; puts and writers from one thread at a time.
+class blob_store
+{
+public:
+  // Creates root and the fan-out directories if needed
+  blob_store(const std::string &root, const sha256_backend &backend,
+             const blob_store_options &options = {});
+  ~blob_store();
+
+  blob_store(const blob_store &) = delete;
+  blob_store &operator=(const blob_store &) = delete;
+
+  bool has(const sha256_digest &digest) const;
+  std::vector<bool> has_many(std::span<const sha256_digest> digests) const;
+
+  blob_put_result put(std::span<const unsigned char> data);
+  // Blobs are hashed in batches and only new ones are written. Results are
+  // in input order.
+  std::vector<blob_put_result> put_many(std::span<const sha256_input> blobs);
+  blob_writer writer();
+
+  std::optional<std::vector<unsigned char>> get(const sha256_digest &digest) const;
+  std::string path(const sha256_digest &digest) const;
+
+  blob_store_stats stats() const;
+
+private:
+  friend class blob_writer;
+
+  // Temporary file in the store, with an empty temp_name if it is unnamed
+  int open_temp(std::string &temp_name);
+  void write_all(int fd, std::span<const unsigned char> data, std::uint64_t offset);
+  // Links the temporary file under digest and closes it. false if the blob
+  // was already there.
+  bool link_temp(int fd, const std::string &temp_name, const sha256_digest &digest);
+  void discard_temp(int fd, const std::string &temp_name);
+  // Writes and links a blob that is not in the store yet
+  bool store_blob(std::span<const unsigned char> data, const sha256_digest &digest);
+  void count(bool stored, std::uint64_t bytes);
+
+  // Runs jobs in order on the writer thread, or right away without overlap
+  void submit(std::function<void()> job);
+  // Waits for all jobs and rethrows the first error among them
+  void wait_jobs();
+  void job_loop();
+
+  std::string root;
+  const sha256_backend &backend;
+  blob_store_options opts;
+  int root_fd = -1;
+  // O_TMPFILE and linkat through /proc/self/fd are available
+  bool unnamed_temp = false;
+  sha256_engine engine;
+
+  mutable std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::function<void()>> jobs;
+  bool running = false;
+  bool stopping = false;
+  std::exception_ptr job_error;
+  blob_store_stats counters;
+  std::thread writer_thread;
+};
@@ -0,0 +1,243 @@
+#include "cdc.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+// Random values from splitmix64, fixed so that boundaries are reproducible
+constexpr std::array<std::uint64_t, 256> make_gear_table()
+{
+  std::array<std::uint64_t, 256> table{};
+  std::uint64_t state = 0;
+  for (auto &entry : table)
+  {
+    state += 0x9e3779b97f4a7c15;
+    std::uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    entry = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr auto gear = make_gear_table();
+
+// Ones in the top bits, which depend on all of the last 64 bytes
+std::uint64_t top_mask(unsigned bits)
+{
+  return bits == 0 ? 0 : ~std::uint64_t(0) << (64 - bits);
+}
+} // namespace
+
+fastcdc::fastcdc(const cdc_options &options)
+{
+  avg = std::clamp(options.avg_size, std::size_t(256), std::size_t(1) << 28);
+  min = std::min(options.min_size ? options.min_size : avg / 4, avg);
+  max = std::max(options.max_size ? options.max_size : avg * 8, avg);
+  // Two more mask bits before avg_size and two fewer after it
+  auto bits = static_cast<unsigned>(std::bit_width(avg) - 1);
+  mask_before_avg = top_mask(bits + 2);
+  mask_after_avg = top_mask(bits - 2);
+}
+
+std::size_t fastcdc::cut(std::span<const unsigned char> data, bool last) const
+{
+  std::size_t size = data.size();
+  if (size <= min)
+  {
+    return last ? size : 0;
+  }
+  std::size_t end = std::min(size, max);
+  std::size_t normal = std::min(avg, end);
+  std::uint64_t fingerprint = 0;
+  std::size_t i = min;
+  for (; i < normal; ++i)
+  {
+    fingerprint = (fingerprint << 1) + gear[data[i]];
+    if (!(fingerprint & mask_before_avg))
+    {
+      return i + 1;
+    }
+  }
+  for (; i < end; ++i)
+  {
+    fingerprint = (fingerprint << 1) + gear[data[i]];
+    if (!(fingerprint & mask_after_avg))
+    {
+      return i + 1;
+    }
+  }
+  return end == max || last ? end : 0;
+}
+
+cdc_stream::cdc_stream(const sha256_backend &backend, const cdc_options &chunking,
+                       const cdc_stream_options &options)
+    : cdc(chunking), opts(options), engine(backend.create())
+{
+  opts.region_size = std::max(opts.region_size, 2 * cdc.max_size());
+  opts.batch_chunks = std::max(opts.batch_chunks, std::size_t(1));
+  for (auto &r : regions)
+  {
+    r.data.resize(opts.region_size);
+  }
+  if (opts.pipelined)
+  {
+    hasher = std::thread([this] { hash_loop(); });
+  }
+}
+
+cdc_stream::~cdc_stream()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  if (hasher.joinable())
+  {
+    hasher.join();
+  }
+}
+
+std::span<unsigned char> cdc_stream::prepare()
+{
+  if (current->filled == current->data.size())
+  {
+    seal(false);
+  }
+  return std::span<unsigned char>(current->data).subspan(current->filled);
+}
+
+void cdc_stream::commit(std::size_t bytes)
+{
+  current->filled += bytes;
+}
+
+void cdc_stream::write(std::span<const unsigned char> data)
+{
+  while (!data.empty())
+  {
+    auto space = prepare();
+    std::size_t num = std::min(space.size(), data.size());
+    std::memcpy(space.data(), data.data(), num);
+    commit(num);
+    data = data.subspan(num);
+  }
+}
+
+void cdc_stream::drain(std::vector<cdc_chunk> &out)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  out.insert(out.end(), completed.begin(), completed.end());
+  completed.clear();
+}
+
+std::vector<cdc_chunk> cdc_stream::finish()
+{
+  if (current->filled > 0)
+  {
+    seal(true);
+  }
+  std::vector<cdc_chunk> out;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !regions[0].busy && !regions[1].busy; });
+    out.swap(completed);
+  }
+  current->offset = 0;
+  return out;
+}
+
+void cdc_stream::seal(bool last)
+{
+  region &r = *current;
+  region &next = current == &regions[0] ? regions[1] : regions[0];
+  std::span<const unsigned char> bytes(r.data.data(), r.filled);
+  r.chunks.clear();
+  std::size_t pos = 0;
+  while (pos < bytes.size())
+  {
+    std::size_t length = cdc.cut(bytes.subspan(pos), last);
+    if (length == 0)
+    {
+      break;
+    }
+    r.chunks.push_back({r.offset + pos, static_cast<std::uint32_t>(length), {}});
+    pos += length;
+  }
+
+  // The unfinished chunk moves to the front of the other region
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&next] { return !next.busy; });
+  }
+  std::memcpy(next.data.data(), r.data.data() + pos, r.filled - pos);
+  next.filled = r.filled - pos;
+  next.offset = r.offset + pos;
+  current = &next;
+  if (r.chunks.empty())
+  {
+    return;
+  }
+
+  if (opts.pipelined)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      r.busy = true;
+      sealed.push_back(&r);
+    }
+    changed.notify_all();
+  }
+  else
+  {
+    hash_region(r);
+    std::lock_guard<std::mutex> lock(mutex);
+    completed.insert(completed.end(), r.chunks.begin(), r.chunks.end());
+  }
+}
+
+void cdc_stream::hash_region(region &r)
+{
+  std::vector<sha256_input> inputs;
+  std::vector<sha256_digest> digests(opts.batch_chunks);
+  for (std::size_t first = 0; first < r.chunks.size(); first += opts.batch_chunks)
+  {
+    std::size_t count = std::min(opts.batch_chunks, r.chunks.size() - first);
+    inputs.clear();
+    for (std::size_t i = first; i < first + count; ++i)
+    {
+      const auto &chunk = r.chunks[i];
+      inputs.emplace_back(r.data.data() + (chunk.offset - r.offset), chunk.length);
+    }
+    engine.hash_many(inputs, std::span<sha256_digest>(digests).first(count));
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      r.chunks[first + i].digest = digests[i];
+    }
+  }
+}
+
+void cdc_stream::hash_loop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    changed.wait(lock, [this] { return stopping || !sealed.empty(); });
+    if (sealed.empty())
+    {
+      return;
+    }
+    region &r = *sealed.front();
+    lock.unlock();
+    hash_region(r);
+    lock.lock();
+    sealed.pop_front();
+    completed.insert(completed.end(), r.chunks.begin(), r.chunks.end());
+    r.busy = false;
+    changed.notify_all();
+  }
+}
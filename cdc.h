@@ -0,0 +1,127 @@
+#pragma once
+
+// Content-defined chunking for deduplication. Chunk boundaries depend only on
+// the bytes around them, so an insertion only changes the chunks next to it,
+// and every chunk is identified by its SHA-256.
+
+#include "sha256_engine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+struct cdc_options
+{
+  // Boundaries are placed so that chunks average about this many bytes
+  std::size_t avg_size = std::size_t(16) << 10;
+  // 0 picks avg_size / 4 and avg_size * 8
+  std::size_t min_size = 0;
+  std::size_t max_size = 0;
+};
+
+// FastCDC boundary detection (Xia et al., USENIX ATC 2016): a gear hash over
+// the last 64 bytes, no cut points below min_size, and normalized chunking,
+// i.e. a stricter mask before avg_size and a looser one after it, which
+// narrows the chunk size distribution.
+class fastcdc
+{
+public:
+  explicit fastcdc(const cdc_options &options = {});
+
+  // Length of the chunk starting at data[0]. Returns 0 if more data is needed
+  // to decide, which never happens for last or once data holds max_size bytes.
+  std::size_t cut(std::span<const unsigned char> data, bool last) const;
+
+  std::size_t min_size() const { return min; }
+  std::size_t avg_size() const { return avg; }
+  std::size_t max_size() const { return max; }
+
+private:
+  std::size_t min;
+  std::size_t avg;
+  std::size_t max;
+  std::uint64_t mask_before_avg;
+  std::uint64_t mask_after_avg;
+};
+
+struct cdc_chunk
+{
+  // Position in the stream
+  std::uint64_t offset;
+  std::uint32_t length;
+  sha256_digest digest;
+};
+
+struct cdc_stream_options
+{
+  // Bytes collected before their boundaries are searched, at least
+  // 2 * max_size
+  std::size_t region_size = std::size_t(4) << 20;
+  // Chunks per hash_many call
+  std::size_t batch_chunks = 64;
+  // Hash completed chunks on a second thread while the next region is filled
+  // and chunked
+  bool pipelined = true;
+};
+
+// Splits a byte stream into chunks and hashes them. Data is collected in two
+// regions: while one is being filled and chunked, the chunks of the other are
+// hashed in batches. Only the unfinished chunk at the end of a region is
+// copied into the next one.
+class cdc_stream
+{
+public:
+  cdc_stream(const sha256_backend &backend, const cdc_options &chunking = {},
+             const cdc_stream_options &options = {});
+  ~cdc_stream();
+
+  cdc_stream(const cdc_stream &) = delete;
+  cdc_stream &operator=(const cdc_stream &) = delete;
+
+  // Free space to read new data into, followed by commit()
+  std::span<unsigned char> prepare();
+  void commit(std::size_t bytes);
+  // Copies data through prepare() and commit()
+  void write(std::span<const unsigned char> data);
+
+  // Appends the chunks hashed so far to out, in stream order
+  void drain(std::vector<cdc_chunk> &out);
+  // Ends the stream and returns all chunks not drained yet. The next write
+  // starts a new stream at offset 0.
+  std::vector<cdc_chunk> finish();
+
+  const fastcdc &chunker() const { return cdc; }
+
+private:
+  struct region
+  {
+    std::vector<unsigned char> data;
+    std::size_t filled = 0;
+    // Stream offset of data[0], which always starts a chunk
+    std::uint64_t offset = 0;
+    std::vector<cdc_chunk> chunks;
+    bool busy = false;
+  };
+
+  void seal(bool last);
+  void hash_region(region &r);
+  void hash_loop();
+
+  fastcdc cdc;
+  cdc_stream_options opts;
+  sha256_engine engine;
+  region regions[2];
+  region *current = &regions[0];
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<region *> sealed;
+  std::vector<cdc_chunk> completed;
+  bool stopping = false;
+  std::thread hasher;
+};
@@ -0,0 +1,108 @@
+// Content-defined chunking benchmarks, registered next to the in-memory ones
+// in main.cpp.
+
+#include "cdc.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+const std::vector<unsigned char> &stream_data()
+{
+  static const std::vector<unsigned char> data = []
+  {
+    std::vector<unsigned char> bytes(std::size_t(64) << 20);
+    std::mt19937_64 gen(42);
+    for (auto &byte : bytes)
+    {
+      byte = static_cast<unsigned char>(gen());
+    }
+    return bytes;
+  }();
+  return data;
+}
+
+void setChunkCounters(benchmark::State &state, std::size_t chunks)
+{
+  const auto &data = stream_data();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+  state.counters["avg_chunk"] =
+      static_cast<double>(data.size()) / static_cast<double>(std::max(chunks, std::size_t(1)));
+}
+
+// Boundary detection alone
+void cdc_boundaries(benchmark::State &state)
+{
+  const auto &data = stream_data();
+  fastcdc cdc({static_cast<std::size_t>(state.range(0))});
+  std::size_t chunks = 0;
+  for (auto _ : state)
+  {
+    chunks = 0;
+    std::span<const unsigned char> rest(data);
+    while (!rest.empty())
+    {
+      rest = rest.subspan(cdc.cut(rest, true));
+      ++chunks;
+    }
+    benchmark::DoNotOptimize(chunks);
+  }
+  setChunkCounters(state, chunks);
+}
+
+// Chunking and hashing, with the hashing on a second thread or inline
+void cdc_stream_hash(benchmark::State &state, const char *backend_name)
+{
+  const sha256_backend *backend = find_sha256_backend(backend_name);
+  if (!backend)
+  {
+    state.SkipWithError("backend not available");
+    return;
+  }
+  const auto &data = stream_data();
+  cdc_stream_options options;
+  options.pipelined = state.range(1) != 0;
+  cdc_stream stream(*backend, {static_cast<std::size_t>(state.range(0))}, options);
+  std::size_t chunks = 0;
+  for (auto _ : state)
+  {
+    stream.write(data);
+    auto result = stream.finish();
+    chunks = result.size();
+    benchmark::DoNotOptimize(result.data());
+  }
+  setChunkCounters(state, chunks);
+}
+
+void cdcArguments(benchmark::internal::Benchmark *b)
+{
+  b->ArgNames({"avg", "pipelined"});
+  for (int64_t avg : {4 << 10, 16 << 10, 64 << 10})
+  {
+    b->Args({avg, 0});
+    b->Args({avg, 1});
+  }
+}
+
+} // namespace
+
+BENCHMARK(cdc_boundaries)
+    ->ArgName("avg")
+    ->Arg(4 << 10)
+    ->Arg(16 << 10)
+    ->Arg(64 << 10)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(cdc_stream_hash, bitcoin, "bitcoin")
+    ->Apply(cdcArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(cdc_stream_hash, openssl, "openssl")
+    ->Apply(cdcArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,232 @@
+// Cycle-accurate timing of single hashes on small messages.
+//
+// Google benchmark's loop overhead and the ClobberMemory in BENCHMARK_SHA256
+// are significant compared to a 32-256 byte hash. This harness times small
+// batches of hashes with serialized rdtsc/rdtscp, subtracts the calibrated
+// cost of an empty batch and rejects outliers before reporting cycles per hash
+// and cycles per byte.
+//
+// Usage: cycles [--samples N] [size ...]
+//
+// Cycles are TSC ticks. Pin the process to one core (e.g. with taskset) and
+// disable frequency boost for them to match core clock cycles.
+
+#include "algorithm_wrappers.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <x86intrin.h>
+
+namespace
+{
+
+// Number of hashes timed by one sample
+constexpr int batch_size = 8;
+constexpr int warmup_samples = 1000;
+
+inline std::uint64_t tsc_begin()
+{
+  _mm_lfence();
+  std::uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+}
+
+inline std::uint64_t tsc_end()
+{
+  unsigned int aux;
+  std::uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+}
+
+template <typename T>
+inline void escape(T &&value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct sample_stats
+{
+  double median = 0.0;
+  double mean = 0.0;
+  double min = 0.0;
+  std::size_t kept = 0;
+  std::size_t total = 0;
+};
+
+// Tukey's fences: drop samples above Q3 + 1.5 * IQR, e.g. those hit by an
+// interrupt or a context switch.
+sample_stats summarize(std::vector<double> samples)
+{
+  sample_stats stats;
+  stats.total = samples.size();
+  if (samples.empty())
+  {
+    return stats;
+  }
+  std::sort(samples.begin(), samples.end());
+  double q1 = samples[samples.size() / 4];
+  double q3 = samples[(samples.size() * 3) / 4];
+  double upper = q3 + 1.5 * (q3 - q1);
+  samples.erase(std::upper_bound(samples.begin(), samples.end(), upper),
+                samples.end());
+
+  stats.kept = samples.size();
+  stats.min = samples.front();
+  stats.median = samples[samples.size() / 2];
+  double sum = 0.0;
+  for (double sample : samples)
+  {
+    sum += sample;
+  }
+  stats.mean = sum / static_cast<double>(samples.size());
+  return stats;
+}
+
+template <typename sha256_wrapper>
+inline void hash_once(const unsigned char *data, std::size_t size)
+{
+  sha256_wrapper sha256_obj;
+  sha256_obj.add_bytes(data, size);
+  auto result = sha256_obj.digest();
+  escape(result);
+}
+
+// Cycles for one batch of hashes, or for an empty batch if sha256_wrapper is
+// void.
+template <typename sha256_wrapper>
+std::vector<double> collect(const unsigned char *data, std::size_t size,
+                            int num_samples)
+{
+  std::vector<double> samples;
+  samples.reserve(static_cast<std::size_t>(num_samples));
+  for (int i = -warmup_samples; i < num_samples; ++i)
+  {
+    std::uint64_t begin = tsc_begin();
+    for (int j = 0; j < batch_size; ++j)
+    {
+      if constexpr (!std::is_void_v<sha256_wrapper>)
+      {
+        hash_once<sha256_wrapper>(data, size);
+      }
+      else
+      {
+        escape(data);
+      }
+    }
+    std::uint64_t end = tsc_end();
+    if (i >= 0)
+    {
+      samples.push_back(static_cast<double>(end - begin));
+    }
+  }
+  return samples;
+}
+
+double tsc_ticks_per_ns()
+{
+  auto begin_time = std::chrono::steady_clock::now();
+  std::uint64_t begin = tsc_begin();
+  while (std::chrono::steady_clock::now() - begin_time <
+         std::chrono::milliseconds(100))
+  {
+  }
+  std::uint64_t end = tsc_end();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin_time;
+  return static_cast<double>(end - begin) / elapsed.count();
+}
+
+template <typename sha256_wrapper>
+void report(const char *name, const std::vector<unsigned char> &data,
+            int num_samples, double overhead, double ticks_per_ns)
+{
+  auto stats = summarize(collect<sha256_wrapper>(data.data(), data.size(),
+                                                 num_samples));
+  double per_hash = (std::max)(0.0, stats.median - overhead) / batch_size;
+  double min_per_hash = (std::max)(0.0, stats.min - overhead) / batch_size;
+  std::printf("%-28s %8zu %12.1f %12.1f %10.2f %10.1f %8zu/%zu\n", name,
+              data.size(), per_hash, min_per_hash,
+              per_hash / static_cast<double>(data.size()),
+              per_hash / ticks_per_ns, stats.kept, stats.total);
+}
+
+} // namespace
+
+#define REPORT_SHA256(SHA256_TYPE) \
+  report<SHA256_TYPE>(#SHA256_TYPE, data, num_samples, overhead, ticks_per_ns)
+
+int main(int argc, char **argv)
+{
+  int num_samples = 20000;
+  std::vector<std::size_t> sizes;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+    {
+      num_samples = std::atoi(argv[++i]);
+    }
+    else
+    {
+      sizes.push_back(static_cast<std::size_t>(std::strtoull(argv[i], nullptr, 10)));
+    }
+  }
+  if (sizes.empty())
+  {
+    sizes = {32, 64, 128, 256};
+  }
+  if (num_samples < 4)
+  {
+    std::fprintf(stderr, "At least 4 samples are required\n");
+    return EXIT_FAILURE;
+  }
+
+  global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
+#ifdef BITCOIN_IMPL
+  SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif // BITCOIN_IMPL
+
+  double ticks_per_ns = tsc_ticks_per_ns();
+  auto empty = summarize(collect<void>(nullptr, 0, num_samples));
+  double overhead = empty.median;
+  std::printf("TSC: %.3f GHz, timing overhead: %.1f cycles per batch of %d\n\n",
+              ticks_per_ns, overhead, batch_size);
+  std::printf("%-28s %8s %12s %12s %10s %10s %12s\n", "implementation", "bytes",
+              "cycles/hash", "min", "cycles/B", "ns/hash", "kept");
+
+  for (std::size_t size : sizes)
+  {
+    // Reproducibly random bytes, as in the benchmark fixture
+    std::mt19937_64 gen;
+    std::vector<unsigned char> data(size);
+    for (auto &byte : data)
+    {
+      byte = static_cast<unsigned char>(gen());
+    }
+
+    REPORT_SHA256(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+    REPORT_SHA256(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+    REPORT_SHA256(sha256_openssl_deprecated);
+    REPORT_SHA256(sha256_openssl_oneshot);
+    REPORT_SHA256(sha256_openssl_global);
+    REPORT_SHA256(sha256_openssl);
+#ifdef _WIN32
+    REPORT_SHA256(sha256_bcrypt);
+#endif
+    std::printf("\n");
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,439 @@
+#include "digest_cache.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct digest_cache::record
+{
+  std::uint64_t dev;
+  std::uint64_t ino;
+  std::uint64_t size;
+  std::int64_t mtime_ns;
+  std::int64_t ctime_ns;
+  sha256_digest digest;
+  // FNV-1a of the bytes above
+  std::uint64_t check;
+};
+
+namespace
+{
+constexpr char magic[8] = {'S', 'H', 'A', '2', '5', '6', 'D', 'C'};
+constexpr std::uint32_t format_version = 1;
+constexpr std::size_t record_size = 80;
+
+// Same size as a record, so records start at multiples of record_size
+struct header
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t record_size;
+  unsigned char reserved[64];
+};
+static_assert(sizeof(header) == record_size);
+
+[[noreturn]] void throw_errno(const std::string &what, int error = errno)
+{
+  throw std::system_error(error, std::generic_category(), what);
+}
+
+std::uint64_t fnv1a(const unsigned char *bytes, std::size_t num)
+{
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < num; ++i)
+  {
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+bool write_all(int fd, const unsigned char *bytes, std::size_t num)
+{
+  while (num > 0)
+  {
+    ssize_t written = ::write(fd, bytes, num);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    num -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+// Holds an flock() until destroyed
+class file_lock
+{
+public:
+  explicit file_lock(int fd) : fd(fd)
+  {
+    while (::flock(fd, LOCK_EX) != 0 && errno == EINTR)
+    {
+    }
+  }
+  ~file_lock() { ::flock(fd, LOCK_UN); }
+
+private:
+  int fd;
+};
+
+// Opens the cache at path, writing the header if the file is new
+int open_cache_file(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    throw_errno(path);
+  }
+  try
+  {
+    {
+      file_lock lock(fd);
+      struct stat st;
+      if (::fstat(fd, &st) != 0)
+      {
+        throw_errno(path);
+      }
+      if (st.st_size == 0)
+      {
+        header h = {};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = format_version;
+        h.record_size = record_size;
+        if (!write_all(fd, reinterpret_cast<const unsigned char *>(&h), sizeof(h)))
+        {
+          throw_errno(path);
+        }
+      }
+    }
+    header h = {};
+    if (::pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) ||
+        std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version ||
+        h.record_size != record_size)
+    {
+      throw std::system_error(EINVAL, std::generic_category(), path + ": not a digest cache");
+    }
+  }
+  catch (...)
+  {
+    ::close(fd);
+    throw;
+  }
+  return fd;
+}
+} // namespace
+
+file_key make_file_key(const struct stat &st)
+{
+  file_key key;
+  key.dev = static_cast<std::uint64_t>(st.st_dev);
+  key.ino = static_cast<std::uint64_t>(st.st_ino);
+  key.size = static_cast<std::uint64_t>(st.st_size);
+#ifdef __APPLE__
+  key.mtime_ns = st.st_mtimespec.tv_sec * std::int64_t(1000000000) + st.st_mtimespec.tv_nsec;
+  key.ctime_ns = st.st_ctimespec.tv_sec * std::int64_t(1000000000) + st.st_ctimespec.tv_nsec;
+#else
+  key.mtime_ns = st.st_mtim.tv_sec * std::int64_t(1000000000) + st.st_mtim.tv_nsec;
+  key.ctime_ns = st.st_ctim.tv_sec * std::int64_t(1000000000) + st.st_ctim.tv_nsec;
+#endif
+  return key;
+}
+
+std::size_t digest_cache::key_hash::operator()(const file_key &key) const
+{
+  std::uint64_t hash = key.ino * 0x9e3779b97f4a7c15;
+  for (std::uint64_t value : {key.dev, key.size, static_cast<std::uint64_t>(key.mtime_ns),
+                              static_cast<std::uint64_t>(key.ctime_ns)})
+  {
+    hash = (hash ^ value) * 0x100000001b3;
+  }
+  return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+digest_cache::digest_cache(const std::string &path, const digest_cache_options &options)
+    : path(path), opts(options)
+{
+  static_assert(sizeof(record) == record_size);
+  fd = open_cache_file(path);
+  loaded = sizeof(header);
+  try
+  {
+    load();
+  }
+  catch (...)
+  {
+    ::close(fd);
+    throw;
+  }
+}
+
+digest_cache::~digest_cache()
+{
+  try
+  {
+    flush();
+  }
+  catch (...)
+  {
+  }
+  ::close(fd);
+}
+
+std::optional<sha256_digest> digest_cache::find(const file_key &key) const
+{
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end())
+  {
+    return std::nullopt;
+  }
+  return it->second.digest;
+}
+
+bool digest_cache::insert(const file_key &key, const sha256_digest &digest,
+                          std::int64_t hashed_at_ns)
+{
+  std::int64_t settled = hashed_at_ns - opts.racy_window_ns;
+  if (key.mtime_ns >= settled || key.ctime_ns >= settled)
+  {
+    return false;
+  }
+  record r = {key.dev, key.ino, key.size, key.mtime_ns, key.ctime_ns, digest, 0};
+  r.check = fnv1a(reinterpret_cast<const unsigned char *>(&r), offsetof(record, check));
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  index[key] = {digest, sequence++};
+  auto bytes = reinterpret_cast<const unsigned char *>(&r);
+  pending.insert(pending.end(), bytes, bytes + sizeof(r));
+  if (pending.size() >= opts.flush_records * sizeof(record))
+  {
+    flush_locked();
+  }
+  return true;
+}
+
+void digest_cache::flush()
+{
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  flush_locked();
+}
+
+void digest_cache::flush_locked()
+{
+  if (pending.empty())
+  {
+    return;
+  }
+  for (;;)
+  {
+    {
+      file_lock lock(fd);
+      if (!replaced())
+      {
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+          throw_errno(path);
+        }
+        // A torn append leaves a partial record; the zeros that complete it
+        // fail the checksum
+        std::size_t partial = static_cast<std::size_t>(st.st_size) % record_size;
+        if (partial != 0)
+        {
+          std::vector<unsigned char> zeros(record_size - partial, 0);
+          if (!write_all(fd, zeros.data(), zeros.size()))
+          {
+            throw_errno(path);
+          }
+        }
+        if (!write_all(fd, pending.data(), pending.size()))
+        {
+          throw_errno(path);
+        }
+        pending.clear();
+        return;
+      }
+    }
+    reopen();
+  }
+}
+
+std::size_t digest_cache::refresh()
+{
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  std::size_t count = 0;
+  for (;;)
+  {
+    {
+      file_lock lock(fd);
+      if (!replaced())
+      {
+        return count + load();
+      }
+    }
+    count += reopen();
+  }
+}
+
+bool digest_cache::replaced() const
+{
+  struct stat opened;
+  struct stat named;
+  if (::fstat(fd, &opened) != 0)
+  {
+    throw_errno(path);
+  }
+  if (::stat(path.c_str(), &named) != 0)
+  {
+    if (errno == ENOENT)
+    {
+      return true;
+    }
+    throw_errno(path);
+  }
+  return opened.st_dev != named.st_dev || opened.st_ino != named.st_ino;
+}
+
+std::size_t digest_cache::reopen()
+{
+  int reopened = open_cache_file(path);
+  ::close(fd);
+  fd = reopened;
+  loaded = sizeof(header);
+  return load();
+}
+
+std::size_t digest_cache::load()
+{
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+  {
+    throw_errno(path);
+  }
+  auto end = static_cast<std::uint64_t>(st.st_size) / record_size * record_size;
+  if (end <= loaded)
+  {
+    return 0;
+  }
+  // Mappings start at a page boundary
+  auto page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+  std::uint64_t map_offset = loaded / page * page;
+  auto map_size = static_cast<std::size_t>(end - map_offset);
+  void *map =
+      ::mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(map_offset));
+  if (map == MAP_FAILED)
+  {
+    throw_errno(path);
+  }
+  std::size_t count = 0;
+  const auto *bytes = static_cast<const unsigned char *>(map) + (loaded - map_offset);
+  for (; loaded < end; loaded += record_size, bytes += record_size)
+  {
+    record r;
+    std::memcpy(&r, bytes, sizeof(r));
+    if (r.check != fnv1a(bytes, offsetof(record, check)))
+    {
+      continue;
+    }
+    index[{r.dev, r.ino, r.size, r.mtime_ns, r.ctime_ns}] = {r.digest, sequence++};
+    ++count;
+  }
+  ::munmap(map, map_size);
+  return count;
+}
+
+void digest_cache::compact()
+{
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  flush_locked();
+  // Held until the old file is closed
+  for (;;)
+  {
+    while (::flock(fd, LOCK_EX) != 0 && errno == EINTR)
+    {
+    }
+    if (!replaced())
+    {
+      break;
+    }
+    ::flock(fd, LOCK_UN);
+    reopen();
+  }
+  load();
+
+  // Newest key per file
+  std::unordered_map<file_key, const std::pair<const file_key, entry> *, key_hash> newest;
+  for (const auto &item : index)
+  {
+    file_key file = {item.first.dev, item.first.ino};
+    auto &slot = newest[file];
+    if (!slot || slot->second.sequence < item.second.sequence)
+    {
+      slot = &item;
+    }
+  }
+
+  std::string temp_path = path + ".tmp" + std::to_string(::getpid());
+  int temp_fd =
+      ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (temp_fd < 0)
+  {
+    throw_errno(temp_path);
+  }
+  std::vector<unsigned char> bytes(sizeof(header) + newest.size() * record_size);
+  header h = {};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = format_version;
+  h.record_size = record_size;
+  std::memcpy(bytes.data(), &h, sizeof(h));
+  std::unordered_map<file_key, entry, key_hash> kept;
+  std::size_t offset = sizeof(header);
+  for (const auto &[file, item] : newest)
+  {
+    const file_key &key = item->first;
+    record r = {key.dev, key.ino, key.size, key.mtime_ns, key.ctime_ns, item->second.digest, 0};
+    r.check = fnv1a(reinterpret_cast<const unsigned char *>(&r), offsetof(record, check));
+    std::memcpy(bytes.data() + offset, &r, sizeof(r));
+    offset += record_size;
+    kept[key] = item->second;
+  }
+  if (!write_all(temp_fd, bytes.data(), bytes.size()) || ::fsync(temp_fd) != 0 ||
+      ::rename(temp_path.c_str(), path.c_str()) != 0)
+  {
+    int error = errno;
+    ::close(temp_fd);
+    ::unlink(temp_path.c_str());
+    ::flock(fd, LOCK_UN);
+    throw_errno(temp_path, error);
+  }
+  ::close(fd);
+  fd = temp_fd;
+  loaded = bytes.size();
+  index.swap(kept);
+}
+
+std::size_t digest_cache::size() const
+{
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return index.size();
+}
+
+std::int64_t digest_cache::now_ns()
+{
+  timespec ts;
+  ::clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * std::int64_t(1000000000) + ts.tv_nsec;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// Persistent cache of file digests, so that re-scanning a tree only hashes
+// the files that changed. Entries are keyed by what stat() reports: a write
+// changes the modification time, a replaced file has a new inode, and
+// setting the modification time back changes the status change time, which
+// cannot be set from user space.
+
+#include "sha256_batch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct stat;
+
+struct file_key
+{
+  std::uint64_t dev = 0;
+  std::uint64_t ino = 0;
+  std::uint64_t size = 0;
+  std::int64_t mtime_ns = 0;
+  std::int64_t ctime_ns = 0;
+
+  bool operator==(const file_key &) const = default;
+};
+
+file_key make_file_key(const struct stat &st);
+
+struct digest_cache_options
+{
+  // Files modified or changed less than this long before they were hashed
+  // are not cached, since another write within the same timestamp tick would
+  // leave their key unchanged
+  std::int64_t racy_window_ns = 1000000000;
+  // Records kept in memory before they are appended to the file
+  std::size_t flush_records = 1024;
+};
+
+// The file starts with an 80-byte header followed by 80-byte records, in
+// native byte order, so it can be mapped and scanned without parsing. It is
+// only ever appended to; the last record for a key wins and records with a
+// bad checksum, e.g. from a crash during an append, are skipped.
+//
+// Any number of processes may read and append at the same time: appends take
+// an exclusive flock() and each write() holds whole records. Lookups and
+// inserts are thread-safe. Errors opening the file are reported as
+// std::system_error.
+class digest_cache
+{
+public:
+  explicit digest_cache(const std::string &path, const digest_cache_options &options = {});
+  // Flushes, ignoring errors
+  ~digest_cache();
+
+  digest_cache(const digest_cache &) = delete;
+  digest_cache &operator=(const digest_cache &) = delete;
+
+  std::optional<sha256_digest> find(const file_key &key) const;
+  // Records the digest of a file whose key was the same before and after
+  // hashing it, which started at hashed_at_ns (CLOCK_REALTIME). false if it
+  // was changed too recently to be cached.
+  bool insert(const file_key &key, const sha256_digest &digest, std::int64_t hashed_at_ns);
+
+  // Appends the records inserted since the last flush
+  void flush();
+  // Reads records appended by other processes; returns how many. After the
+  // file was replaced, all records of the new file are counted.
+  std::size_t refresh();
+  // Rewrites the file with the newest record per file (device and inode) and
+  // renames it over the old one, holding the lock until then. Other instances
+  // notice the new file on their next flush() or refresh().
+  void compact();
+
+  std::size_t size() const;
+  const digest_cache_options &options() const { return opts; }
+
+  static std::int64_t now_ns();
+
+private:
+  struct record;
+  struct key_hash
+  {
+    std::size_t operator()(const file_key &key) const;
+  };
+  struct entry
+  {
+    sha256_digest digest;
+    // Order of the record, the newest wins when compacting
+    std::uint64_t sequence;
+  };
+
+  // With the mutex held exclusively
+  std::size_t load();
+  void flush_locked();
+  // Whether path no longer names the open file, e.g. after another process
+  // compacted it
+  bool replaced() const;
+  // Opens the file at path and loads it from the start
+  std::size_t reopen();
+
+  std::string path;
+  digest_cache_options opts;
+  int fd = -1;
+  // Bytes of the file read so far, always at a record boundary
+  std::uint64_t loaded = 0;
+  std::uint64_t sequence = 0;
+  mutable std::shared_mutex mutex;
+  std::unordered_map<file_key, entry, key_hash> index;
+  std::vector<unsigned char> pending;
+};
@@ -0,0 +1,204 @@
+#include "digest_memo.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+std::uint64_t load64(const unsigned char *bytes)
+{
+  std::uint64_t word;
+  std::memcpy(&word, bytes, sizeof(word));
+  return word;
+}
+
+// Finalizer of splitmix64
+std::uint64_t mix(std::uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+} // namespace
+
+struct digest_memo::shard
+{
+  struct entry
+  {
+    std::uint64_t fingerprint;
+    sha256_digest digest;
+    std::vector<unsigned char> bytes;
+  };
+
+  // Evicts from the back, keeping the front entry, until size more bytes fit
+  void make_room(std::size_t size)
+  {
+    while (lru.size() > 1 && used + size > capacity)
+    {
+      used -= lru.back().bytes.size() + entry_overhead;
+      index.erase(lru.back().fingerprint);
+      lru.pop_back();
+    }
+  }
+
+  // Each shard on its own cache lines, lookups of different shards do not
+  // contend
+  alignas(64) std::mutex mutex;
+  // Most recently used first
+  std::list<entry> lru;
+  std::unordered_map<std::uint64_t, std::list<entry>::iterator> index;
+  std::size_t capacity = 0;
+  std::size_t used = 0;
+  std::uint64_t lookups = 0;
+  std::uint64_t hits = 0;
+  std::uint64_t bytes_saved = 0;
+};
+
+digest_memo::digest_memo(const digest_memo_options &options)
+    : opts(options), shard_mask(std::bit_ceil((std::max)(options.shards, std::size_t(1))) - 1),
+      shards(new shard[shard_mask + 1])
+{
+  for (std::size_t i = 0; i <= shard_mask; ++i)
+  {
+    shards[i].capacity = options.capacity / (shard_mask + 1);
+  }
+}
+
+digest_memo::~digest_memo() = default;
+
+std::uint64_t digest_memo::fingerprint(const unsigned char *bytes, std::size_t num)
+{
+  // Four independent lanes, so the multiplications overlap
+  std::uint64_t lanes[4] = {0x243f6a8885a308d3 ^ num, 0x13198a2e03707344, 0xa4093822299f31d0,
+                            0x082efa98ec4e6c89};
+  std::size_t i = 0;
+  for (; i + 32 <= num; i += 32)
+  {
+    for (unsigned lane = 0; lane < 4; ++lane)
+    {
+      std::uint64_t word = load64(bytes + i + 8 * lane) ^ lanes[lane];
+      lanes[lane] = (word ^ (word >> 29)) * 0x9e3779b97f4a7c15;
+    }
+  }
+  unsigned lane = 0;
+  for (; i + 8 <= num; i += 8, ++lane)
+  {
+    std::uint64_t word = load64(bytes + i) ^ lanes[lane];
+    lanes[lane] = (word ^ (word >> 29)) * 0x9e3779b97f4a7c15;
+  }
+  if (i < num)
+  {
+    std::uint64_t word = 0;
+    std::memcpy(&word, bytes + i, num - i);
+    lanes[lane] = mix(lanes[lane] ^ word);
+  }
+  return mix(lanes[0] ^ std::rotl(lanes[1], 16) ^ std::rotl(lanes[2], 32) ^
+             std::rotl(lanes[3], 48));
+}
+
+digest_memo::shard &digest_memo::shard_for(std::uint64_t fingerprint) const
+{
+  // The map inside the shard hashes the low bits
+  return shards[static_cast<std::size_t>(fingerprint >> 48) & shard_mask];
+}
+
+std::optional<sha256_digest> digest_memo::find(const unsigned char *bytes, std::size_t num,
+                                               std::uint64_t fingerprint)
+{
+  shard &s = shard_for(fingerprint);
+  std::lock_guard<std::mutex> lock(s.mutex);
+  ++s.lookups;
+  auto it = s.index.find(fingerprint);
+  if (it == s.index.end())
+  {
+    return std::nullopt;
+  }
+  const auto &stored = it->second->bytes;
+  if (stored.size() != num || (num != 0 && std::memcmp(stored.data(), bytes, num) != 0))
+  {
+    return std::nullopt;
+  }
+  s.lru.splice(s.lru.begin(), s.lru, it->second);
+  ++s.hits;
+  s.bytes_saved += num;
+  return it->second->digest;
+}
+
+void digest_memo::insert(const unsigned char *bytes, std::size_t num, std::uint64_t fingerprint,
+                         const sha256_digest &digest)
+{
+  std::size_t size = num + entry_overhead;
+  shard &s = shard_for(fingerprint);
+  if (size > s.capacity)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(s.mutex);
+  auto it = s.index.find(fingerprint);
+  if (it != s.index.end())
+  {
+    // Another thread inserted it meanwhile, or a different message with the
+    // same fingerprint, which is replaced
+    s.used -= it->second->bytes.size() + entry_overhead;
+    s.lru.erase(it->second);
+    s.index.erase(it);
+  }
+  if (!s.lru.empty() && s.used + size > s.capacity)
+  {
+    // Once the shard is full, the least recently used entry and its index
+    // node are reused for the new one, so that a miss does not allocate
+    auto oldest = std::prev(s.lru.end());
+    s.used -= oldest->bytes.size() + entry_overhead;
+    auto node = s.index.extract(oldest->fingerprint);
+    s.lru.splice(s.lru.begin(), s.lru, oldest);
+    s.make_room(size);
+    oldest->fingerprint = fingerprint;
+    oldest->digest = digest;
+    oldest->bytes.assign(bytes, bytes + num);
+    node.key() = fingerprint;
+    s.index.insert(std::move(node));
+  }
+  else
+  {
+    s.lru.push_front({fingerprint, digest, std::vector<unsigned char>(bytes, bytes + num)});
+    s.index.emplace(fingerprint, s.lru.begin());
+  }
+  s.used += size;
+}
+
+void digest_memo::clear()
+{
+  for (std::size_t i = 0; i <= shard_mask; ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    shards[i].index.clear();
+    shards[i].lru.clear();
+    shards[i].used = 0;
+  }
+}
+
+digest_memo_stats digest_memo::stats() const
+{
+  digest_memo_stats stats;
+  for (std::size_t i = 0; i <= shard_mask; ++i)
+  {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    stats.lookups += shards[i].lookups;
+    stats.hits += shards[i].hits;
+    stats.bytes_saved += shards[i].bytes_saved;
+    stats.entries += shards[i].index.size();
+    stats.bytes += shards[i].used;
+  }
+  return stats;
+}
+
+digest_memo &digest_memo::shared()
+{
+  static digest_memo memo;
+  return memo;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+// Memoized digests of small messages, for workloads that hash the same bytes
+// over and over, e.g. configuration blobs or hot keys. A lookup costs a 64-bit
+// fingerprint and a comparison of the full message, so it only pays off where
+// that is cheaper than hashing, see the memo benchmarks.
+
+#include "sha256_batch.h"
+#include "sha256_hasher.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+struct digest_memo_options
+{
+  // Longer messages are hashed without looking them up
+  std::size_t max_input = 1024;
+  // Bytes of messages kept, including entry_overhead per entry
+  std::size_t capacity = std::size_t(8) << 20;
+  // Rounded up to a power of two
+  std::size_t shards = 16;
+};
+
+struct digest_memo_stats
+{
+  std::uint64_t lookups = 0;
+  std::uint64_t hits = 0;
+  // Bytes of the messages found, which did not have to be hashed
+  std::uint64_t bytes_saved = 0;
+  std::size_t entries = 0;
+  std::size_t bytes = 0;
+
+  double hit_rate() const { return lookups ? double(hits) / double(lookups) : 0.0; }
+};
+
+// Messages are spread over shards by their fingerprint, and each shard is an
+// LRU list behind its own mutex that evicts once it holds more than its share
+// of the capacity. A fingerprint maps to one entry per shard, so of two
+// messages with the same fingerprint only the last one inserted is kept.
+class digest_memo
+{
+public:
+  // Charged for each entry on top of the message
+  static constexpr std::size_t entry_overhead = 128;
+
+  explicit digest_memo(const digest_memo_options &options = {});
+  ~digest_memo();
+
+  digest_memo(const digest_memo &) = delete;
+  digest_memo &operator=(const digest_memo &) = delete;
+
+  // Not cryptographic; distinct messages with the same fingerprint only cost
+  // a miss
+  static std::uint64_t fingerprint(const unsigned char *bytes, std::size_t num);
+
+  std::optional<sha256_digest> find(const unsigned char *bytes, std::size_t num,
+                                    std::uint64_t fingerprint);
+  void insert(const unsigned char *bytes, std::size_t num, std::uint64_t fingerprint,
+              const sha256_digest &digest);
+
+  // Drops all entries, the counters are kept
+  void clear();
+  digest_memo_stats stats() const;
+  const digest_memo_options &options() const { return opts; }
+
+  // Process-wide instance with the default options
+  static digest_memo &shared();
+
+private:
+  struct shard;
+
+  shard &shard_for(std::uint64_t fingerprint) const;
+
+  digest_memo_options opts;
+  std::size_t shard_mask;
+  std::unique_ptr<shard[]> shards;
+};
+
+// Front-end for any wrapper: messages of up to max_input bytes are buffered
+// and looked up in a digest_memo when the digest is requested, longer ones are
+// streamed to the wrapped hasher as soon as they outgrow the buffer.
+template <Sha256Hasher T>
+class sha256_memoized
+{
+public:
+  sha256_memoized() : sha256_memoized(digest_memo::shared()) {}
+  explicit sha256_memoized(digest_memo &memo) : memo(&memo), buffer(memo.options().max_input) {}
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    if (!streaming)
+    {
+      if (num <= buffer.size() - pending)
+      {
+        if (num != 0)
+        {
+          std::memcpy(buffer.data() + pending, bytes, num);
+          pending += num;
+        }
+        return;
+      }
+      hasher.add_bytes(buffer.data(), pending);
+      pending = 0;
+      streaming = true;
+      used = true;
+    }
+    hasher.add_bytes(bytes, num);
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    if (streaming)
+    {
+      return hasher.digest();
+    }
+    std::uint64_t fingerprint = digest_memo::fingerprint(buffer.data(), pending);
+    if (auto found = memo->find(buffer.data(), pending, fingerprint))
+    {
+      return *found;
+    }
+    hasher.add_bytes(buffer.data(), pending);
+    used = true;
+    auto digest = hasher.digest();
+    memo->insert(buffer.data(), pending, fingerprint, digest);
+    return digest;
+  }
+  void reset()
+  {
+    // After a hit the wrapped hasher is still fresh
+    if (used)
+    {
+      hasher.reset();
+    }
+    pending = 0;
+    streaming = false;
+    used = false;
+  }
+
+private:
+  digest_memo *memo;
+  T hasher;
+  // max_input bytes, of which the first pending are buffered
+  std::vector<unsigned char> buffer;
+  std::size_t pending = 0;
+  bool streaming = false;
+  bool used = false;
+};
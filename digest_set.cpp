@@ -0,0 +1,380 @@
+#include "digest_set.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+constexpr unsigned bucket_slots = 8;
+// Buckets moved by each insert while a table is resized
+constexpr std::size_t resize_step = 16;
+
+// Slot layout: id (1-based, 0 for an empty slot) in bits 0-46, the frozen
+// flag in bit 47 and the tag in bits 48-63, i.e. the top 16-bit lane
+constexpr std::uint64_t id_mask = (std::uint64_t(1) << 47) - 1;
+constexpr std::uint64_t frozen = std::uint64_t(1) << 47;
+constexpr unsigned tag_shift = 48;
+
+struct alignas(64) bucket
+{
+  std::atomic<std::uint64_t> slots[bucket_slots];
+};
+
+std::uint64_t bucket_bits(const sha256_digest &digest)
+{
+  std::uint64_t bits;
+  std::memcpy(&bits, digest.data(), sizeof(bits));
+  return bits;
+}
+
+std::uint16_t tag_of(const sha256_digest &digest)
+{
+  std::uint16_t tag;
+  std::memcpy(&tag, digest.data() + sizeof(std::uint64_t), sizeof(tag));
+  return tag;
+}
+
+void snapshot(const bucket &b, std::uint64_t (&slots)[bucket_slots])
+{
+  for (unsigned i = 0; i < bucket_slots; ++i)
+  {
+    slots[i] = b.slots[i].load(std::memory_order_acquire);
+  }
+}
+
+// One bit per slot whose tag equals tag
+unsigned match_tags(const std::uint64_t (&slots)[bucket_slots], std::uint16_t tag)
+{
+  unsigned matches = 0;
+#if defined(__SSE2__)
+  const __m128i tags = _mm_set1_epi16(static_cast<short>(tag));
+  for (unsigned i = 0; i < bucket_slots; i += 2)
+  {
+    __m128i pair = _mm_loadu_si128(reinterpret_cast<const __m128i *>(slots + i));
+    auto equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(pair, tags)));
+    // The high bytes of the top lanes of both slots
+    matches |= ((equal >> 7) & 1) << i;
+    matches |= ((equal >> 15) & 1) << (i + 1);
+  }
+#else
+  for (unsigned i = 0; i < bucket_slots; ++i)
+  {
+    matches |= unsigned(slots[i] >> tag_shift == tag) << i;
+  }
+#endif
+  return matches;
+}
+
+// One bit per slot without an entry, frozen or not
+unsigned empty_slots(const std::uint64_t (&slots)[bucket_slots])
+{
+  unsigned empty = 0;
+  for (unsigned i = 0; i < bucket_slots; ++i)
+  {
+    empty |= unsigned((slots[i] & id_mask) == 0) << i;
+  }
+  return empty;
+}
+} // namespace
+
+struct digest_set::table
+{
+  explicit table(std::size_t num_buckets)
+      : mask(num_buckets - 1), buckets(new bucket[num_buckets]())
+  {
+  }
+  ~table() { delete[] buckets; }
+
+  std::size_t slots() const { return (mask + 1) * bucket_slots; }
+
+  const std::size_t mask;
+  bucket *const buckets;
+  // Slots with an entry, apart from the members every lookup reads
+  alignas(64) std::atomic<std::size_t> used{0};
+  std::atomic<table *> next{nullptr};
+  // Buckets claimed and finished by help_resize
+  std::atomic<std::size_t> resize_cursor{0};
+  std::atomic<std::size_t> resize_done{0};
+};
+
+digest_set::digest_set(std::size_t capacity)
+{
+  std::size_t buckets = std::bit_ceil((std::max)(capacity * 4 / 3 / bucket_slots, std::size_t(16)));
+  first = new table(buckets);
+  head.store(first);
+}
+
+digest_set::~digest_set()
+{
+  for (table *t = first; t;)
+  {
+    table *next = t->next.load();
+    delete t;
+    t = next;
+  }
+  for (auto &segment : segments)
+  {
+    delete[] segment.load();
+  }
+}
+
+std::pair<std::uint64_t, bool> digest_set::insert(const sha256_digest &digest)
+{
+  table *t = head.load(std::memory_order_acquire);
+  if (t->next.load(std::memory_order_acquire))
+  {
+    help_resize(*t);
+  }
+  return insert_into(*t, digest, 0, false);
+}
+
+std::optional<std::uint64_t> digest_set::find(const sha256_digest &digest) const
+{
+  for (const table *t = head.load(std::memory_order_acquire); t;
+       t = t->next.load(std::memory_order_acquire))
+  {
+    if (std::uint64_t id = find_in(*t, digest))
+    {
+      return id;
+    }
+  }
+  return std::nullopt;
+}
+
+const sha256_digest &digest_set::at(std::uint64_t id) const
+{
+  auto [k, offset] = arena_position(id);
+  return segments[k].load(std::memory_order_acquire)[offset];
+}
+
+std::size_t digest_set::capacity() const
+{
+  const table *t = head.load(std::memory_order_acquire);
+  while (const table *next = t->next.load(std::memory_order_acquire))
+  {
+    t = next;
+  }
+  return t->slots();
+}
+
+std::uint64_t digest_set::find_in(const table &t, const sha256_digest &digest) const
+{
+  std::uint16_t tag = tag_of(digest);
+  std::size_t home = bucket_bits(digest) & t.mask;
+  for (std::size_t i = 0; i <= t.mask; ++i)
+  {
+    std::uint64_t slots[bucket_slots];
+    snapshot(t.buckets[(home + i) & t.mask], slots);
+    for (unsigned matches = match_tags(slots, tag); matches; matches &= matches - 1)
+    {
+      std::uint64_t id = slots[std::countr_zero(matches)] & id_mask;
+      if (id && at(id) == digest)
+      {
+        return id;
+      }
+    }
+    // Digests are never placed after a bucket with room
+    if (empty_slots(slots))
+    {
+      break;
+    }
+  }
+  return 0;
+}
+
+std::pair<std::uint64_t, bool> digest_set::insert_into(table &t, const sha256_digest &digest,
+                                                       std::uint64_t id, bool moving)
+{
+  std::uint16_t tag = tag_of(digest);
+  std::size_t home = bucket_bits(digest) & t.mask;
+  for (;;)
+  {
+    if (t.next.load(std::memory_order_acquire))
+    {
+      return insert_resizing(t, digest, id, moving);
+    }
+    for (std::size_t i = 0; i <= t.mask; ++i)
+    {
+      bucket &b = t.buckets[(home + i) & t.mask];
+      std::uint64_t slots[bucket_slots];
+      snapshot(b, slots);
+      unsigned empty;
+      for (;;)
+      {
+        for (unsigned matches = match_tags(slots, tag); matches; matches &= matches - 1)
+        {
+          std::uint64_t found = slots[std::countr_zero(matches)] & id_mask;
+          if (found && at(found) == digest)
+          {
+            return {found, false};
+          }
+        }
+        empty = empty_slots(slots);
+        unsigned slot = static_cast<unsigned>(std::countr_zero(empty));
+        if (!empty || slots[slot] != 0)
+        {
+          break;
+        }
+        if (!id)
+        {
+          id = allocate(digest);
+        }
+        // A failed exchange leaves the current contents in slots[slot]
+        if (b.slots[slot].compare_exchange_strong(slots[slot],
+                                                  id | std::uint64_t(tag) << tag_shift,
+                                                  std::memory_order_acq_rel))
+        {
+          if (!moving)
+          {
+            count.fetch_add(1, std::memory_order_relaxed);
+          }
+          if (t.used.fetch_add(1, std::memory_order_relaxed) + 1 > t.slots() / 4 * 3)
+          {
+            start_resize(t);
+          }
+          return {id, true};
+        }
+      }
+      if (empty)
+      {
+        // A frozen empty slot, the table is being resized
+        break;
+      }
+    }
+    // Full or frozen, either way the entry goes to the next table
+    start_resize(t);
+  }
+}
+
+std::pair<std::uint64_t, bool> digest_set::insert_resizing(table &t, const sha256_digest &digest,
+                                                           std::uint64_t id, bool moving)
+{
+  // Frozen buckets no longer change, so the end of the probe sequence found
+  // in them is final
+  std::uint16_t tag = tag_of(digest);
+  std::size_t home = bucket_bits(digest) & t.mask;
+  std::size_t length = 0;
+  while (length <= t.mask)
+  {
+    std::size_t index = (home + length++) & t.mask;
+    freeze_bucket(t, index);
+    std::uint64_t slots[bucket_slots];
+    snapshot(t.buckets[index], slots);
+    for (unsigned matches = match_tags(slots, tag); matches; matches &= matches - 1)
+    {
+      std::uint64_t found = slots[std::countr_zero(matches)] & id_mask;
+      if (found && at(found) == digest)
+      {
+        return {found, false};
+      }
+    }
+    if (empty_slots(slots))
+    {
+      break;
+    }
+  }
+  for (std::size_t i = 0; i < length; ++i)
+  {
+    move_bucket(t, (home + i) & t.mask);
+  }
+  return insert_into(*t.next.load(std::memory_order_acquire), digest, id, moving);
+}
+
+void digest_set::freeze_bucket(table &t, std::size_t index)
+{
+  for (auto &slot : t.buckets[index].slots)
+  {
+    std::uint64_t value = slot.load(std::memory_order_acquire);
+    while (!(value & frozen) &&
+           !slot.compare_exchange_weak(value, value | frozen, std::memory_order_acq_rel))
+    {
+    }
+  }
+}
+
+void digest_set::move_bucket(table &t, std::size_t index)
+{
+  // Entries already in the next table are found there, so any number of
+  // threads may move the same bucket
+  table &next = *t.next.load(std::memory_order_acquire);
+  std::uint64_t slots[bucket_slots];
+  snapshot(t.buckets[index], slots);
+  for (std::uint64_t slot : slots)
+  {
+    if (std::uint64_t id = slot & id_mask)
+    {
+      insert_into(next, at(id), id, true);
+    }
+  }
+}
+
+void digest_set::help_resize(table &t)
+{
+  std::size_t buckets = t.mask + 1;
+  std::size_t begin = t.resize_cursor.fetch_add(resize_step, std::memory_order_relaxed);
+  if (begin >= buckets)
+  {
+    return;
+  }
+  std::size_t end = (std::min)(begin + resize_step, buckets);
+  for (std::size_t index = begin; index < end; ++index)
+  {
+    freeze_bucket(t, index);
+    move_bucket(t, index);
+  }
+  if (t.resize_done.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == buckets)
+  {
+    // Everything is in the next table now, lookups can start there
+    table *expected = &t;
+    head.compare_exchange_strong(expected, t.next.load(std::memory_order_acquire),
+                                 std::memory_order_acq_rel);
+  }
+}
+
+void digest_set::start_resize(table &t)
+{
+  if (t.next.load(std::memory_order_acquire))
+  {
+    return;
+  }
+  auto *bigger = new table(2 * (t.mask + 1));
+  table *expected = nullptr;
+  if (!t.next.compare_exchange_strong(expected, bigger, std::memory_order_acq_rel))
+  {
+    delete bigger;
+  }
+}
+
+std::uint64_t digest_set::allocate(const sha256_digest &digest)
+{
+  std::uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+  auto [k, offset] = arena_position(id);
+  sha256_digest *segment = segments[k].load(std::memory_order_acquire);
+  if (!segment)
+  {
+    auto *fresh = new sha256_digest[std::size_t(1) << (first_segment_bits + k)];
+    if (segments[k].compare_exchange_strong(segment, fresh, std::memory_order_acq_rel))
+    {
+      segment = fresh;
+    }
+    else
+    {
+      delete[] fresh;
+    }
+  }
+  segment[offset] = digest;
+  return id;
+}
+
+std::pair<unsigned, std::size_t> digest_set::arena_position(std::uint64_t id)
+{
+  // Segment k starts at id 2^first_segment_bits * (2^k - 1) + 1
+  std::uint64_t n = id - 1 + (std::uint64_t(1) << first_segment_bits);
+  auto k = static_cast<unsigned>(std::bit_width(n >> first_segment_bits) - 1);
+  return {k, static_cast<std::size_t>(n - (std::uint64_t(1) << (first_segment_bits + k)))};
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// Concurrent set of SHA-256 digests for deduplication. Digests are uniformly
+// distributed, so the bucket index and a 16-bit tag are taken straight from
+// their bits instead of hashing them again. Note that digests chosen to
+// collide in those bits, which is cheap for an attacker, degrade lookups to
+// linear probing.
+
+#include "sha256_batch.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// Open addressing with 64-byte buckets of eight slots, probed linearly.
+// A slot holds the tag and the id of a digest stored in a separate arena, so
+// one SIMD comparison of the tags finds the candidates in a bucket. Inserts
+// and lookups are lock-free. Digests cannot be removed.
+//
+// Above 3/4 load a table twice the size is added, and the buckets of the old
+// one are moved over incrementally by the inserts that follow, a few at a
+// time. Old tables are kept until the set is destroyed, since lookups may
+// still be reading them; together they are smaller than the newest table.
+class digest_set
+{
+public:
+  // Digests the set holds before its first resize
+  explicit digest_set(std::size_t capacity = 0);
+  ~digest_set();
+
+  digest_set(const digest_set &) = delete;
+  digest_set &operator=(const digest_set &) = delete;
+
+  // The id of digest and whether this call inserted it. Ids are unique and
+  // never change, but have gaps where concurrent inserts of the same digest
+  // raced.
+  std::pair<std::uint64_t, bool> insert(const sha256_digest &digest);
+  std::optional<std::uint64_t> find(const sha256_digest &digest) const;
+  bool contains(const sha256_digest &digest) const { return find(digest).has_value(); }
+  // The digest with this id
+  const sha256_digest &at(std::uint64_t id) const;
+
+  std::size_t size() const { return count.load(std::memory_order_relaxed); }
+  // Slots of the newest table
+  std::size_t capacity() const;
+
+private:
+  struct table;
+
+  // The id of digest in t, 0 if it is not there
+  std::uint64_t find_in(const table &t, const sha256_digest &digest) const;
+  // Inserts digest into t or one of its successors. id is 0 until one is
+  // allocated; moving is set for entries moved from an older table.
+  std::pair<std::uint64_t, bool> insert_into(table &t, const sha256_digest &digest,
+                                             std::uint64_t id, bool moving);
+  // For a table being resized: freezes the probe sequence of digest and
+  // moves it to the next table, where digest is then inserted
+  std::pair<std::uint64_t, bool> insert_resizing(table &t, const sha256_digest &digest,
+                                                 std::uint64_t id, bool moving);
+  void freeze_bucket(table &t, std::size_t bucket);
+  void move_bucket(table &t, std::size_t bucket);
+  void help_resize(table &t);
+  void start_resize(table &t);
+  std::uint64_t allocate(const sha256_digest &digest);
+  // Segment and offset of an id in the arena
+  static std::pair<unsigned, std::size_t> arena_position(std::uint64_t id);
+
+  // Oldest table that still has entries not moved to its successor
+  std::atomic<table *> head;
+  // Oldest table, which owns the others through their next pointers
+  table *first;
+  // Written by every insert, so kept off the cache line of the pointers
+  alignas(64) std::atomic<std::uint64_t> next_id{1};
+  alignas(64) std::atomic<std::size_t> count{0};
+
+  // Arena segment k holds 2^(k + first_segment_bits) digests, so ids never
+  // move while the arena grows
+  static constexpr unsigned first_segment_bits = 12;
+  static constexpr unsigned num_segments = 40;
+  std::atomic<sha256_digest *> segments[num_segments] = {};
+};
@@ -0,0 +1,150 @@
+// Concurrent digest set benchmarks, registered next to the in-memory ones in
+// main.cpp.
+
+#include "digest_set.h"
+#include "sha256_engine.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t pool_size = std::size_t(1) << 20;
+
+// Double SHA-256 of 64-byte messages, which the bitcoin backend computes with
+// its multi-lane SHA256D64 kernels
+const std::vector<sha256_digest> &digest_pool()
+{
+  static const std::vector<sha256_digest> pool = []
+  {
+    const sha256_backend *backend = find_sha256_backend("bitcoin");
+    auto engine = (backend ? *backend : sha256_backends().front()).create();
+    std::vector<unsigned char> messages(64 * pool_size);
+    for (std::size_t i = 0; i < pool_size; ++i)
+    {
+      for (std::size_t byte = 0; byte < 8; ++byte)
+      {
+        messages[64 * i + byte] = static_cast<unsigned char>(i >> (8 * byte));
+      }
+    }
+    std::vector<sha256_input> inputs;
+    for (std::size_t i = 0; i < pool_size; ++i)
+    {
+      inputs.emplace_back(messages.data() + 64 * i, 64);
+    }
+    std::vector<sha256_digest> digests(pool_size);
+    engine.double_hash_many(inputs, digests);
+    return digests;
+  }();
+  return pool;
+}
+
+// What the digest set replaces: a generic hash set behind a mutex, which
+// hashes the digest bytes again and allocates a node per entry
+class locked_unordered_set
+{
+public:
+  bool insert(const sha256_digest &digest)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set.emplace(reinterpret_cast<const char *>(digest.data()), digest.size()).second;
+  }
+  bool contains(const sha256_digest &digest) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set.count(std::string(reinterpret_cast<const char *>(digest.data()), digest.size()));
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::unordered_set<std::string> set;
+};
+
+bool insert_digest(digest_set &set, const sha256_digest &digest)
+{
+  return set.insert(digest).second;
+}
+
+bool insert_digest(locked_unordered_set &set, const sha256_digest &digest)
+{
+  return set.insert(digest);
+}
+
+// All threads insert their share of the pool into an initially small set, so
+// the set resizes while it is being filled
+template <typename Set>
+void digest_set_insert(benchmark::State &state)
+{
+  static std::unique_ptr<Set> set;
+  const auto &pool = digest_pool();
+  if (state.thread_index() == 0)
+  {
+    // The other threads do not touch the set before the timed loop starts
+    set = std::make_unique<Set>();
+  }
+  std::size_t share = pool.size() / static_cast<std::size_t>(state.threads());
+  std::size_t begin = share * static_cast<std::size_t>(state.thread_index());
+  for (auto _ : state)
+  {
+    std::size_t inserted = 0;
+    for (std::size_t i = begin; i < begin + share; ++i)
+    {
+      inserted += insert_digest(*set, pool[i]);
+    }
+    benchmark::DoNotOptimize(inserted);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * share));
+}
+
+// Lookups in a set holding half of the pool, alternating between hits and
+// misses
+template <typename Set>
+void digest_set_lookup(benchmark::State &state)
+{
+  static const std::unique_ptr<Set> set = []
+  {
+    auto filled = std::make_unique<Set>();
+    const auto &pool = digest_pool();
+    for (std::size_t i = 0; i < pool.size(); i += 2)
+    {
+      insert_digest(*filled, pool[i]);
+    }
+    return filled;
+  }();
+  const auto &pool = digest_pool();
+  std::size_t i = pool.size() / static_cast<std::size_t>(state.threads()) *
+                  static_cast<std::size_t>(state.thread_index());
+  std::size_t hits = 0;
+  for (auto _ : state)
+  {
+    hits += set->contains(pool[i++ & (pool.size() - 1)]);
+  }
+  benchmark::DoNotOptimize(hits);
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(digest_set_insert, digest_set)
+    ->ThreadRange(1, 64)
+    ->Iterations(1)
+    ->Repetitions(5)
+    ->ReportAggregatesOnly()
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(digest_set_insert, locked_unordered_set)
+    ->ThreadRange(1, 64)
+    ->Iterations(1)
+    ->Repetitions(5)
+    ->ReportAggregatesOnly()
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(digest_set_lookup, digest_set)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(digest_set_lookup, locked_unordered_set)->ThreadRange(1, 64)->UseRealTime();
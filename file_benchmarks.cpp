@@ -0,0 +1,831 @@
+// Benchmarks hashing whole files, registered next to the in-memory ones in
+// main.cpp. Not available on Windows.
+
+#include "algorithm_wrappers.h"
+#include "blob_store.h"
+#include "digest_cache.h"
+#include "parallel_hash.h"
+#include "skip_unavailable.h"
+#include "topology.h"
+#ifdef SHA256_IO_URING
+#include "uring_hash.h"
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Files with random contents, created in a new directory below base and
+// removed at exit
+class file_set
+{
+public:
+  explicit file_set(const std::string &base) : pool(std::size_t(16) << 20)
+  {
+    for (auto &byte : pool)
+    {
+      byte = static_cast<unsigned char>(gen());
+    }
+    std::string templ = base + "/sha256_files_XXXXXX";
+    std::vector<char> buffer(templ.begin(), templ.end());
+    buffer.push_back('\0');
+    if (::mkdtemp(buffer.data()))
+    {
+      root = buffer.data();
+    }
+  }
+
+  ~file_set()
+  {
+    if (!root.empty())
+    {
+      std::error_code ec;
+      std::filesystem::remove_all(root, ec);
+    }
+  }
+
+  file_set(const file_set &) = delete;
+  file_set &operator=(const file_set &) = delete;
+
+  // name is relative to the root and may contain directories. Files larger
+  // than the 16 MiB pool of random bytes repeat it.
+  bool add(const std::string &name, std::uint64_t size)
+  {
+    if (root.empty())
+    {
+      return false;
+    }
+    auto path = std::filesystem::path(root) / name;
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+      return false;
+    }
+    bool ok = true;
+    for (std::uint64_t written = 0; ok && written < size;)
+    {
+      std::size_t chunk = static_cast<std::size_t>(
+          (std::min)(size - written, static_cast<std::uint64_t>(pool.size())));
+      ok = std::fwrite(pool.data() + gen() % (pool.size() - chunk + 1), 1, chunk, file) == chunk;
+      written += chunk;
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (ok)
+    {
+      paths.push_back(path.string());
+      total_bytes += size;
+    }
+    return ok;
+  }
+
+  const std::vector<std::string> &files() const { return paths; }
+  std::uint64_t bytes() const { return total_bytes; }
+
+protected:
+  std::mt19937_64 gen;
+
+private:
+  std::vector<unsigned char> pool;
+  std::string root;
+  std::vector<std::string> paths;
+  std::uint64_t total_bytes = 0;
+};
+
+std::string local_directory()
+{
+  const char *tmpdir = std::getenv("TMPDIR");
+  return tmpdir ? tmpdir : "/tmp";
+}
+
+// Synthetic directory tree: many small files with log-uniform sizes between
+// 512 bytes and 64 KiB spread over nested directories, plus a few large files
+class synthetic_tree : public file_set
+{
+public:
+  static const synthetic_tree &get()
+  {
+    static synthetic_tree tree;
+    return tree;
+  }
+
+private:
+  synthetic_tree() : file_set(local_directory())
+  {
+    constexpr int num_small = 2000;
+    constexpr int num_large = 8;
+    constexpr int num_files = num_small + num_large;
+    std::uniform_real_distribution<double> log_size(9.0, 16.0);
+    for (int i = 0; i < num_files; ++i)
+    {
+      bool large = i % (num_files / num_large) == 0;
+      std::size_t size = large ? (std::size_t(8) << 20) + gen() % (std::size_t(8) << 20)
+                               : static_cast<std::size_t>(std::exp2(log_size(gen)));
+      add(std::to_string(i % 16) + "/" + std::to_string(i % 7) + "/f" + std::to_string(i),
+          size);
+    }
+  }
+};
+
+// Eight files of 8 MiB each, on the file system of the temporary directory or
+// on tmpfs
+class large_files : public file_set
+{
+public:
+  static const large_files &get(bool tmpfs)
+  {
+    if (tmpfs)
+    {
+      static large_files set("/dev/shm");
+      return set;
+    }
+    static large_files set(local_directory());
+    return set;
+  }
+
+private:
+  explicit large_files(const std::string &base) : file_set(base)
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      std::string name = "f";
+      name += std::to_string(i);
+      add(name, std::size_t(8) << 20);
+    }
+  }
+};
+
+// Read size of the file_read_loop and file_uring benchmarks
+constexpr std::size_t file_buffer_size = std::size_t(128) << 10;
+
+void parallelTreeArguments(benchmark::internal::Benchmark *b)
+{
+  b->ArgName("threads");
+  int cores = getPhysicalCores();
+  for (int threads = 1; threads < cores; threads *= 2)
+  {
+    b->Arg(threads);
+  }
+  b->Arg(cores);
+}
+
+bool prepare(benchmark::State &state, const sha256_backend *backend, const file_set &set)
+{
+  if (!backend)
+  {
+    state.SkipWithError("backend not available");
+    return false;
+  }
+  if (set.files().empty())
+  {
+    state.SkipWithError("could not create the files");
+    return false;
+  }
+  return true;
+}
+
+void setFileCounters(benchmark::State &state, const file_set &set)
+{
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * set.bytes()));
+  state.counters["files_per_second"] = benchmark::Counter(
+      static_cast<double>(set.files().size()), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Hot page cache: the files are read once before timing
+void parallel_tree(benchmark::State &state, const char *backend_name)
+{
+  const sha256_backend *backend = find_sha256_backend(backend_name);
+  const auto &tree = synthetic_tree::get();
+  if (!prepare(state, backend, tree))
+  {
+    return;
+  }
+  parallel_hash_options parallel;
+  parallel.num_threads = static_cast<int>(state.range(0));
+  parallel_file_hasher hasher(*backend, {}, parallel);
+  hasher.hash(tree.files());
+
+  for (auto _ : state)
+  {
+    auto results = hasher.hash(tree.files());
+    benchmark::DoNotOptimize(results.data());
+  }
+  setFileCounters(state, tree);
+}
+
+// Plain read() loop as the reference for the io_uring pipeline, with the same
+// buffer size
+void file_read_loop(benchmark::State &state, bool tmpfs)
+{
+  const sha256_backend *backend = find_sha256_backend("bitcoin");
+  const auto &set = large_files::get(tmpfs);
+  if (!prepare(state, backend, set))
+  {
+    return;
+  }
+  file_hasher hasher(*backend, {io_strategy::read, file_buffer_size, {}});
+  for (const auto &path : set.files())
+  {
+    hasher.hash_path(path.c_str());
+  }
+
+  for (auto _ : state)
+  {
+    for (const auto &path : set.files())
+    {
+      auto result = hasher.hash_path(path.c_str());
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  setFileCounters(state, set);
+}
+
+#ifdef SHA256_IO_URING
+void file_uring(benchmark::State &state, bool tmpfs)
+{
+  const sha256_backend *backend = find_sha256_backend("bitcoin");
+  const auto &set = large_files::get(tmpfs);
+  if (!prepare(state, backend, set))
+  {
+    return;
+  }
+  uring_hash_options options;
+  options.queue_depth = static_cast<unsigned>(state.range(0));
+  options.buffer_size = file_buffer_size;
+  uring_file_hasher hasher(*backend, options);
+  if (!hasher.available())
+  {
+    state.SkipWithError("io_uring not available");
+    return;
+  }
+  hasher.hash(set.files());
+
+  for (auto _ : state)
+  {
+    auto results = hasher.hash(set.files());
+    benchmark::DoNotOptimize(results.data());
+  }
+  setFileCounters(state, set);
+}
+#endif // SHA256_IO_URING
+
+// Read strategies of the _file benchmarks
+enum file_io : int64_t
+{
+  file_io_read = 0,          // read() into a reused buffer
+  file_io_pread = 1,         // pread() after POSIX_FADV_SEQUENTIAL and POSIX_FADV_WILLNEED
+  file_io_mmap = 2,          // mmap() with MADV_SEQUENTIAL
+  file_io_mmap_hugepage = 3, // mmap() with MADV_HUGEPAGE, needs tmpfs or read-only THP for files
+  file_io_mmap_populate = 4, // mmap() with MAP_POPULATE, faults in the whole file up front
+  file_io_direct = 5,        // O_DIRECT into an aligned buffer
+  file_io_splice = 6,        // splice() into a pipe, read() from the pipe
+};
+
+const char *file_io_name(file_io io)
+{
+  switch (io)
+  {
+  case file_io_read:
+    return "read";
+  case file_io_pread:
+    return "pread";
+  case file_io_mmap:
+    return "mmap";
+  case file_io_mmap_hugepage:
+    return "mmap_hugepage";
+  case file_io_mmap_populate:
+    return "mmap_populate";
+  case file_io_direct:
+    return "direct";
+  case file_io_splice:
+    return "splice";
+  }
+  return "";
+}
+
+// One file per benchmarked size in the temporary directory, created on first
+// use. Sizes grow by 16x from 4 KiB up to SHA256_FILE_BENCH_MAX_BYTES (default
+// 256 MiB), e.g. 10737418240 adds 4 GiB and 10 GiB.
+class sized_files : public file_set
+{
+public:
+  static sized_files &get()
+  {
+    static sized_files set;
+    return set;
+  }
+
+  static std::vector<int64_t> sizes()
+  {
+    int64_t max_bytes = int64_t(256) << 20;
+    if (const char *env = std::getenv("SHA256_FILE_BENCH_MAX_BYTES"))
+    {
+      max_bytes = (std::max)(int64_t(std::atoll(env)), int64_t(4096));
+    }
+    std::vector<int64_t> sizes;
+    for (int64_t size = 4096; size < max_bytes; size *= 16)
+    {
+      sizes.push_back(size);
+    }
+    sizes.push_back(max_bytes);
+    return sizes;
+  }
+
+  // Empty if the file could not be written
+  std::string path(std::uint64_t size)
+  {
+    auto it = by_size.find(size);
+    if (it == by_size.end())
+    {
+      if (!add("size_" + std::to_string(size), size))
+      {
+        return {};
+      }
+      it = by_size.emplace(size, files().back()).first;
+    }
+    return it->second;
+  }
+
+private:
+  sized_files() : file_set(local_directory()) {}
+
+  std::map<std::uint64_t, std::string> by_size;
+};
+
+// Writes back and evicts the file from the page cache
+void drop_page_cache(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0)
+  {
+    ::fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+// Cold runs use the largest buffer only, which keeps the family at 90
+// instances with the default file sizes
+void fileIoArguments(benchmark::internal::Benchmark *b)
+{
+  for (int64_t size : sized_files::sizes())
+  {
+    for (int64_t io = file_io_read; io <= file_io_splice; ++io)
+    {
+      bool mapped = io == file_io_mmap || io == file_io_mmap_hugepage ||
+                    io == file_io_mmap_populate;
+      std::vector<int64_t> buffers = mapped ? std::vector<int64_t>{0}
+                                            : std::vector<int64_t>{1LL << 16, 1LL << 20};
+      for (int64_t buffer : buffers)
+      {
+        b->Args({size, io, buffer, 0});
+      }
+      b->Args({size, io, buffers.back(), 1});
+    }
+  }
+}
+
+template <typename sha256_wrapper>
+class file_io_fixture : public benchmark::Fixture
+{
+public:
+  void SetUp(::benchmark::State &state)
+  {
+    if (skipUnavailable<sha256_wrapper>(state))
+    {
+      return;
+    }
+    sha256_backends(); // Fetches global_md and selects the bitcoin kernels
+    path = sized_files::get().path(static_cast<std::uint64_t>(state.range(0)));
+    io = static_cast<file_io>(state.range(1));
+    buffer_size = (std::max)(static_cast<std::size_t>(state.range(2)), std::size_t(4096));
+    cold = state.range(3) != 0;
+    buffer.reset(static_cast<unsigned char *>(std::aligned_alloc(4096, buffer_size)));
+    if (io == file_io_splice && ::pipe2(pipe_fds, O_CLOEXEC) == 0)
+    {
+      // Limited by /proc/sys/fs/pipe-max-size
+      ::fcntl(pipe_fds[1], F_SETPIPE_SZ, static_cast<int>(buffer_size));
+      int pipe_size = ::fcntl(pipe_fds[1], F_GETPIPE_SZ);
+      splice_chunk = pipe_size > 0 ? (std::min)(buffer_size, std::size_t(pipe_size))
+                                   : std::size_t(4096);
+    }
+    if (!cold && !path.empty())
+    {
+      std::array<unsigned char, 32> digest;
+      hash_file(digest);
+    }
+  }
+
+  void TearDown(::benchmark::State &)
+  {
+    for (int &fd : pipe_fds)
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    buffer.reset();
+  }
+
+  // false on I/O errors
+  bool hash_file(std::array<unsigned char, 32> &digest)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | (io == file_io_direct ? O_DIRECT : 0));
+    if (fd < 0)
+    {
+      return false;
+    }
+    sha256_wrapper sha256_obj;
+    bool ok = false;
+    switch (io)
+    {
+    case file_io_read:
+    case file_io_direct:
+      ok = hash_read(fd, sha256_obj);
+      break;
+    case file_io_pread:
+      ok = hash_pread(fd, sha256_obj);
+      break;
+    case file_io_mmap:
+    case file_io_mmap_hugepage:
+    case file_io_mmap_populate:
+      ok = hash_mmap(fd, sha256_obj);
+      break;
+    case file_io_splice:
+      ok = hash_splice(fd, sha256_obj);
+      break;
+    }
+    ::close(fd);
+    digest = sha256_obj.digest();
+    return ok;
+  }
+
+  std::string path;
+  file_io io = file_io_read;
+  bool cold = false;
+
+private:
+  struct aligned_free
+  {
+    void operator()(unsigned char *ptr) const { std::free(ptr); }
+  };
+
+  bool hash_read(int fd, sha256_wrapper &sha256_obj)
+  {
+    for (;;)
+    {
+      ssize_t num = ::read(fd, buffer.get(), buffer_size);
+      if (num <= 0)
+      {
+        return num == 0;
+      }
+      sha256_obj.add_bytes(buffer.get(), static_cast<std::size_t>(num));
+    }
+  }
+
+  bool hash_pread(int fd, sha256_wrapper &sha256_obj)
+  {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    for (off_t offset = 0;;)
+    {
+      ssize_t num = ::pread(fd, buffer.get(), buffer_size, offset);
+      if (num <= 0)
+      {
+        return num == 0;
+      }
+      sha256_obj.add_bytes(buffer.get(), static_cast<std::size_t>(num));
+      offset += num;
+    }
+  }
+
+  bool hash_mmap(int fd, sha256_wrapper &sha256_obj)
+  {
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      return false;
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    if (size == 0)
+    {
+      return true;
+    }
+    int flags = MAP_PRIVATE | (io == file_io_mmap_populate ? MAP_POPULATE : 0);
+    void *map = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      return false;
+    }
+    if (io == file_io_mmap)
+    {
+      ::madvise(map, size, MADV_SEQUENTIAL);
+    }
+    else if (io == file_io_mmap_hugepage)
+    {
+      ::madvise(map, size, MADV_HUGEPAGE);
+    }
+    sha256_obj.add_bytes(static_cast<const unsigned char *>(map), size);
+    ::munmap(map, size);
+    return true;
+  }
+
+  // The data still has to be copied out of the pipe to be hashed in user
+  // space. The afalg backend splices the pages on into its socket instead, so
+  // they are hashed in the kernel without any copy.
+  bool hash_splice(int fd, sha256_wrapper &sha256_obj)
+  {
+    if constexpr (requires { sha256_obj.add_fd(fd); })
+    {
+      return sha256_obj.add_fd(fd) >= 0;
+    }
+    if (pipe_fds[0] < 0)
+    {
+      return false;
+    }
+    for (loff_t offset = 0;;)
+    {
+      ssize_t spliced = ::splice(fd, &offset, pipe_fds[1], nullptr, splice_chunk, SPLICE_F_MOVE);
+      if (spliced <= 0)
+      {
+        return spliced == 0;
+      }
+      while (spliced > 0)
+      {
+        ssize_t num = ::read(pipe_fds[0], buffer.get(), static_cast<std::size_t>(spliced));
+        if (num <= 0)
+        {
+          return false;
+        }
+        sha256_obj.add_bytes(buffer.get(), static_cast<std::size_t>(num));
+        spliced -= num;
+      }
+    }
+  }
+
+  std::unique_ptr<unsigned char, aligned_free> buffer;
+  std::size_t buffer_size = 0;
+  std::size_t splice_chunk = 0;
+  int pipe_fds[2] = {-1, -1};
+};
+
+// In-memory blobs for the blob store benchmarks: 2000 small ones with
+// log-uniform sizes between 512 bytes and 64 KiB, or four of 16 MiB
+const std::vector<std::vector<unsigned char>> &blob_set(bool large)
+{
+  auto make = [](bool large)
+  {
+    std::mt19937_64 gen(large ? 2 : 1);
+    std::uniform_real_distribution<double> log_size(9.0, 16.0);
+    std::vector<std::vector<unsigned char>> blobs(large ? 4 : 2000);
+    for (auto &blob : blobs)
+    {
+      blob.resize(large ? std::size_t(16) << 20
+                        : static_cast<std::size_t>(std::exp2(log_size(gen))));
+      for (auto &byte : blob)
+      {
+        byte = static_cast<unsigned char>(gen());
+      }
+    }
+    return blobs;
+  };
+  static const auto small_blobs = make(false);
+  static const auto large_blobs = make(true);
+  return large ? large_blobs : small_blobs;
+}
+
+// Ingest into a blob store. Without dedup every iteration starts with an
+// empty store, with dedup all blobs are already stored.
+void blob_store_put(benchmark::State &state, const char *backend_name)
+{
+  const sha256_backend *backend = find_sha256_backend(backend_name);
+  if (!backend)
+  {
+    state.SkipWithError("backend not available");
+    return;
+  }
+  const auto &blobs = blob_set(state.range(0) != 0);
+  blob_store_options options;
+  options.overlap = state.range(1) != 0;
+  bool dedup = state.range(2) != 0;
+  std::vector<sha256_input> inputs(blobs.begin(), blobs.end());
+  std::uint64_t bytes = 0;
+  for (const auto &blob : blobs)
+  {
+    bytes += blob.size();
+  }
+
+  std::string root = local_directory() + "/sha256_blobs_" + std::to_string(::getpid());
+  std::error_code ec;
+  std::optional<blob_store> store;
+  std::uint64_t stored = 0;
+  for (auto _ : state)
+  {
+    if (!store || !dedup)
+    {
+      state.PauseTiming();
+      store.reset();
+      std::filesystem::remove_all(root, ec);
+      store.emplace(root, *backend, options);
+      if (dedup)
+      {
+        store->put_many(inputs);
+      }
+      state.ResumeTiming();
+    }
+    auto results = store->put_many(inputs);
+    stored = static_cast<std::uint64_t>(
+        std::count_if(results.begin(), results.end(), [](const auto &r) { return r.stored; }));
+  }
+  store.reset();
+  std::filesystem::remove_all(root, ec);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+  state.counters["stored"] = static_cast<double>(stored);
+}
+
+// Rescan of the synthetic tree, hot in the page cache, where a percentage of
+// the files changed since the last scan. Their modification times are set
+// back by a second before each iteration, so the cache cannot know them.
+void tree_rescan(benchmark::State &state)
+{
+  const sha256_backend *backend = find_sha256_backend("bitcoin");
+  const auto &tree = synthetic_tree::get();
+  if (!prepare(state, backend, tree))
+  {
+    return;
+  }
+  bool cached = state.range(0) != 0;
+  auto changed_percent = static_cast<std::size_t>(state.range(1));
+  std::string cache_path =
+      local_directory() + "/sha256_digest_cache_" + std::to_string(::getpid());
+  file_hash_options options;
+  if (cached)
+  {
+    std::remove(cache_path.c_str());
+    digest_cache_options cache_options;
+    // Files are changed right before they are hashed
+    cache_options.racy_window_ns = 0;
+    options.cache = std::make_shared<digest_cache>(cache_path, cache_options);
+  }
+  file_hasher hasher(*backend, options);
+  for (const auto &path : tree.files())
+  {
+    hasher.hash_path(path.c_str());
+  }
+
+  std::int64_t mtime = digest_cache::now_ns() / 1000000000 - 3600;
+  std::uint64_t hashed = 0;
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    --mtime;
+    const timespec times[2] = {{mtime, 0}, {mtime, 0}};
+    for (std::size_t i = 0; i < tree.files().size(); ++i)
+    {
+      if (i * changed_percent / 100 != (i + 1) * changed_percent / 100)
+      {
+        ::utimensat(AT_FDCWD, tree.files()[i].c_str(), times, 0);
+      }
+    }
+    state.ResumeTiming();
+    for (const auto &path : tree.files())
+    {
+      auto result = hasher.hash_path(path.c_str());
+      hashed += result.cached ? 0 : result.bytes;
+    }
+  }
+  // Still open, any records flushed later go to the unlinked file
+  std::remove(cache_path.c_str());
+  setFileCounters(state, tree);
+  state.counters["hashed_bytes"] = benchmark::Counter(
+      static_cast<double>(hashed), benchmark::Counter::kAvgIterations);
+}
+
+void blobStoreArguments(benchmark::internal::Benchmark *b)
+{
+  b->ArgNames({"large", "overlap", "dedup"});
+  for (int64_t large : {0, 1})
+  {
+    b->Args({large, 0, 0});
+    b->Args({large, 1, 0});
+    b->Args({large, 1, 1});
+  }
+}
+
+} // namespace
+
+#define BENCHMARK_SHA256_FILE(SHA256_TYPE)                                                 \
+  BENCHMARK_TEMPLATE_DEFINE_F(file_io_fixture, BM_##SHA256_TYPE##_file, SHA256_TYPE)       \
+  (::benchmark::State & state)                                                             \
+  {                                                                                        \
+    if (path.empty())                                                                      \
+    {                                                                                      \
+      state.SkipWithError("could not create the file");                                    \
+      return;                                                                              \
+    }                                                                                      \
+    for (auto _ : state)                                                                   \
+    {                                                                                      \
+      if (cold)                                                                            \
+      {                                                                                    \
+        state.PauseTiming();                                                               \
+        drop_page_cache(path);                                                             \
+        state.ResumeTiming();                                                              \
+      }                                                                                    \
+      std::array<unsigned char, 32> result;                                                \
+      if (!hash_file(result))                                                              \
+      {                                                                                    \
+        state.SkipWithError("I/O error");                                                  \
+        break;                                                                             \
+      }                                                                                    \
+      benchmark::DoNotOptimize(result);                                                    \
+    }                                                                                      \
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(state.range(0)));        \
+    state.SetLabel(file_io_name(io));                                                      \
+  }                                                                                        \
+  BENCHMARK_REGISTER_F(file_io_fixture, BM_##SHA256_TYPE##_file)                           \
+      ->Apply(fileIoArguments)                                                             \
+      ->ArgNames({"bytes", "io", "buffer", "cold"})                                        \
+      ->UseRealTime()                                                                      \
+      ->Name(#SHA256_TYPE "_file");
+
+BENCHMARK_CAPTURE(parallel_tree, bitcoin, "bitcoin")
+    ->Apply(parallelTreeArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(parallel_tree, openssl, "openssl")
+    ->Apply(parallelTreeArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(file_read_loop, local, false)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(file_read_loop, tmpfs, true)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+#ifdef SHA256_IO_URING
+BENCHMARK_CAPTURE(file_uring, local, false)
+    ->ArgName("depth")
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(file_uring, tmpfs, true)
+    ->ArgName("depth")
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+#endif // SHA256_IO_URING
+
+BENCHMARK(tree_rescan)
+    ->ArgNames({"cache", "changed"})
+    ->Args({0, 0})
+    ->Args({1, 0})
+    ->Args({1, 10})
+    ->Args({1, 100})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(blob_store_put, bitcoin, "bitcoin")
+    ->Apply(blobStoreArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(blob_store_put, openssl, "openssl")
+    ->Apply(blobStoreArguments)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_SHA256_FILE(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256_FILE(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256_FILE(sha256_openssl_deprecated);
+BENCHMARK_SHA256_FILE(sha256_openssl);
+BENCHMARK_SHA256_FILE(sha256_openssl_pooled);
+#ifdef SHA256_AFALG
+BENCHMARK_SHA256_FILE(sha256_afalg);
+#endif
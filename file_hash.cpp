@@ -0,0 +1,229 @@
+#include "file_hash.h"
+
+#include "digest_cache.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char *io_strategy_name(io_strategy io)
+{
+  switch (io)
+  {
+  case io_strategy::read:
+    return "read";
+  case io_strategy::mmap:
+    return "mmap";
+  case io_strategy::direct:
+    return "direct";
+  }
+  return nullptr;
+}
+
+bool parse_io_strategy(const std::string &name, io_strategy &io)
+{
+  for (auto candidate : {io_strategy::read, io_strategy::mmap, io_strategy::direct})
+  {
+    if (name == io_strategy_name(candidate))
+    {
+      io = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void file_hasher::aligned_free::operator()(unsigned char *ptr) const
+{
+  std::free(ptr);
+}
+
+file_hasher::file_hasher(const sha256_backend &backend,
+                         const file_hash_options &options)
+    : engine(backend.create()), opts(options)
+{
+  opts.buffer_size = (std::max)(opts.buffer_size, direct_alignment);
+  opts.buffer_size =
+      (opts.buffer_size + direct_alignment - 1) / direct_alignment * direct_alignment;
+  buffer.reset(static_cast<unsigned char *>(
+      std::aligned_alloc(direct_alignment, opts.buffer_size)));
+  assert(buffer);
+}
+
+file_hash_result file_hasher::hash_path(const char *path)
+{
+  int fd = -1;
+  if (opts.io == io_strategy::direct)
+  {
+    fd = ::open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+  }
+  if (fd < 0)
+  {
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0)
+  {
+    file_hash_result result;
+    result.error = errno;
+    return result;
+  }
+  if (opts.cache)
+  {
+    auto result = hash_cached(fd);
+    ::close(fd);
+    return result;
+  }
+  auto result = hash_fd(fd);
+  ::close(fd);
+  return result;
+}
+
+file_hash_result file_hasher::hash_cached(int fd)
+{
+  struct stat before;
+  if (::fstat(fd, &before) != 0 || !S_ISREG(before.st_mode))
+  {
+    return hash_fd(fd);
+  }
+  file_key key = make_file_key(before);
+  file_hash_result result;
+  if (auto digest = opts.cache->find(key))
+  {
+    result.digest = *digest;
+    result.bytes = key.size;
+    result.cached = true;
+    return result;
+  }
+  std::int64_t started = digest_cache::now_ns();
+  result = hash_fd(fd);
+  // Only if nothing changed while the file was read
+  struct stat after;
+  if (result.error == 0 && result.bytes == key.size && ::fstat(fd, &after) == 0 &&
+      make_file_key(after) == key)
+  {
+    opts.cache->insert(key, result.digest, started);
+  }
+  return result;
+}
+
+file_hash_result file_hasher::hash_fd(int fd)
+{
+  engine.reset();
+  if (opts.io == io_strategy::mmap)
+  {
+    return hash_mmap(fd);
+  }
+  return hash_read(fd);
+}
+
+file_hash_result file_hasher::hash_read(int fd)
+{
+  file_hash_result result;
+  if (opts.io == io_strategy::read)
+  {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  for (;;)
+  {
+    ssize_t num = ::read(fd, buffer.get(), opts.buffer_size);
+    if (num < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      int error = errno;
+      int flags = ::fcntl(fd, F_GETFL);
+      if (error == EINVAL && flags >= 0 && (flags & O_DIRECT) &&
+          ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0)
+      {
+        // O_DIRECT was accepted by open() but not by read()
+        continue;
+      }
+      result.error = error;
+      return result;
+    }
+    if (num == 0)
+    {
+      break;
+    }
+    engine.add_bytes(buffer.get(), static_cast<std::size_t>(num));
+    result.bytes += static_cast<std::uint64_t>(num);
+  }
+  result.digest = engine.digest();
+  return result;
+}
+
+file_hash_result file_hasher::hash_mmap(int fd)
+{
+  struct stat st;
+  off_t offset = ::lseek(fd, 0, SEEK_CUR);
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset < 0 ||
+      st.st_size <= offset)
+  {
+    // Pipes, devices and empty files
+    return hash_read(fd);
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    return hash_read(fd);
+  }
+  ::madvise(map, size, MADV_SEQUENTIAL);
+
+  file_hash_result result;
+  auto offset_bytes = static_cast<std::size_t>(offset);
+  engine.add_bytes(static_cast<const unsigned char *>(map) + offset_bytes,
+                   size - offset_bytes);
+  result.bytes = size - offset_bytes;
+  result.digest = engine.digest();
+  ::munmap(map, size);
+  ::lseek(fd, st.st_size, SEEK_SET);
+  return result;
+}
+
+std::string to_hex(const sha256_digest &digest)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(2 * digest.size(), '0');
+  for (std::size_t i = 0; i < digest.size(); ++i)
+  {
+    hex[2 * i] = digits[digest[i] >> 4];
+    hex[2 * i + 1] = digits[digest[i] & 0xf];
+  }
+  return hex;
+}
+
+bool from_hex(const std::string &hex, sha256_digest &digest)
+{
+  if (hex.size() != 2 * digest.size())
+  {
+    return false;
+  }
+  auto nibble = [](char c) -> int
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  };
+  for (std::size_t i = 0; i < digest.size(); ++i)
+  {
+    int high = nibble(hex[2 * i]);
+    int low = nibble(hex[2 * i + 1]);
+    if (high < 0 || low < 0)
+    {
+      return false;
+    }
+    digest[i] = static_cast<unsigned char>(high << 4 | low);
+  }
+  return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "sha256_engine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class digest_cache;
+
+// How file contents are brought into memory
+enum class io_strategy
+{
+  // read() into a reused buffer
+  read,
+  // mmap() the whole file with MADV_SEQUENTIAL
+  mmap,
+  // read() with O_DIRECT into an aligned buffer, bypassing the page cache.
+  // Falls back to read if the file system does not support it.
+  direct,
+};
+
+// nullptr for unknown names
+const char *io_strategy_name(io_strategy io);
+bool parse_io_strategy(const std::string &name, io_strategy &io);
+
+struct file_hash_options
+{
+  io_strategy io = io_strategy::read;
+  // Size of each read; rounded up to the O_DIRECT alignment
+  std::size_t buffer_size = std::size_t(1) << 20;
+  // Consulted by hash_path before reading a regular file, and updated after
+  std::shared_ptr<digest_cache> cache;
+};
+
+struct file_hash_result
+{
+  // 0 on success, otherwise an errno value
+  int error = 0;
+  sha256_digest digest = {};
+  std::uint64_t bytes = 0;
+  // Taken from the digest cache without reading the file
+  bool cached = false;
+};
+
+// Hashes files with one backend. Owns a read buffer and an engine that are
+// reused across files, so one instance per thread avoids per-file setup.
+class file_hasher
+{
+public:
+  static constexpr std::size_t direct_alignment = 4096;
+
+  file_hasher(const sha256_backend &backend, const file_hash_options &options);
+
+  file_hash_result hash_path(const char *path);
+  // Hashes from the current position until end of file; does not close fd
+  file_hash_result hash_fd(int fd);
+
+  const file_hash_options &options() const { return opts; }
+
+private:
+  struct aligned_free
+  {
+    void operator()(unsigned char *ptr) const;
+  };
+
+  file_hash_result hash_cached(int fd);
+  file_hash_result hash_read(int fd);
+  file_hash_result hash_mmap(int fd);
+
+  sha256_engine engine;
+  file_hash_options opts;
+  std::unique_ptr<unsigned char, aligned_free> buffer;
+};
+
+std::string to_hex(const sha256_digest &digest);
+// false if hex is not 64 hexadecimal characters
+bool from_hex(const std::string &hex, sha256_digest &digest);
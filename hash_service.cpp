@@ -0,0 +1,798 @@
+#include "hash_service.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <x86intrin.h>
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free &&
+                  sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+              "futex words are shared between processes");
+
+namespace
+{
+constexpr std::uint32_t shm_magic = 0x32353653; // "S652"
+constexpr std::uint32_t shm_version = 1;
+constexpr std::uint32_t max_ring_slots = 1u << 16;
+constexpr std::uint64_t max_arena_bytes = std::uint64_t(1) << 40;
+constexpr std::size_t page_size = 4096;
+
+// Start of the memfd. Indices are free running, slots is a power of two.
+struct shm_header
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t slots;
+  std::uint32_t reserved;
+  std::uint64_t arena_bytes;
+  alignas(64) std::atomic<std::uint32_t> submit_head;   // written by the daemon
+  alignas(64) std::atomic<std::uint32_t> submit_tail;   // written by the client
+  alignas(64) std::atomic<std::uint32_t> complete_head; // written by the client
+  alignas(64) std::atomic<std::uint32_t> complete_tail; // written by the daemon
+  // Futex the client sleeps on while waiting for completions
+  alignas(64) std::atomic<std::uint32_t> client_sleeping;
+  std::atomic<std::uint32_t> client_seq;
+};
+
+struct hello_message
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t slots;
+  std::uint32_t reserved;
+  std::uint64_t arena_bytes;
+};
+
+struct welcome_message
+{
+  std::int32_t status;
+  std::uint32_t version;
+};
+
+constexpr std::size_t round_up(std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+struct shm_layout
+{
+  std::size_t requests;
+  std::size_t completions;
+  std::size_t arena;
+  std::size_t total;
+};
+
+shm_layout layout_for(std::uint32_t slots, std::uint64_t arena_bytes)
+{
+  shm_layout layout;
+  layout.requests = round_up(sizeof(shm_header), 64);
+  layout.completions = round_up(layout.requests + slots * sizeof(hash_request), 64);
+  layout.arena = round_up(layout.completions + slots * sizeof(hash_completion), page_size);
+  layout.total = layout.arena + round_up(static_cast<std::size_t>(arena_bytes), page_size);
+  return layout;
+}
+
+void futex_wait(std::atomic<std::uint32_t> &word, std::uint32_t expected, int timeout_ms)
+{
+  timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+  // Shared futex, the word lives in memory mapped by two processes
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, expected,
+            timeout_ms < 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+void futex_wake(std::atomic<std::uint32_t> &word)
+{
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+// Sends data with an optional file descriptor attached
+bool send_with_fd(int socket_fd, const void *data, std::size_t size, int fd)
+{
+  iovec iov = {const_cast<void *>(data), size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (fd >= 0)
+  {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+  ssize_t sent;
+  do
+  {
+    sent = ::sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  return sent == static_cast<ssize_t>(size);
+}
+
+// Receives exactly size bytes; fd is -1 if none was attached
+bool receive_with_fd(int socket_fd, void *data, std::size_t size, int &fd)
+{
+  fd = -1;
+  iovec iov = {data, size};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t received;
+  do
+  {
+    received = ::recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+      std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+  if (received != static_cast<ssize_t>(size) || (msg.msg_flags & MSG_CTRUNC))
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+    return false;
+  }
+  return true;
+}
+
+sockaddr_un socket_address(const std::string &path)
+{
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path))
+  {
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+[[noreturn]] void throw_errno(const char *what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+// Woken by clients that submitted work while the daemon sleeps
+struct hash_doorbell
+{
+  std::atomic<std::uint32_t> sleeping;
+  std::atomic<std::uint32_t> seq;
+};
+
+struct hash_shared_memory
+{
+  ~hash_shared_memory()
+  {
+    if (base != MAP_FAILED)
+    {
+      ::munmap(base, size);
+    }
+    if (bell != MAP_FAILED)
+    {
+      ::munmap(bell, page_size);
+    }
+  }
+
+  bool map(int fd, std::uint32_t ring_slots, std::uint64_t arena_size)
+  {
+    auto layout = layout_for(ring_slots, arena_size);
+    base = ::mmap(nullptr, layout.total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      return false;
+    }
+    size = layout.total;
+    slots = ring_slots;
+    arena_bytes = arena_size;
+    auto *bytes = static_cast<unsigned char *>(base);
+    header = reinterpret_cast<shm_header *>(bytes);
+    requests = reinterpret_cast<hash_request *>(bytes + layout.requests);
+    completions = reinterpret_cast<hash_completion *>(bytes + layout.completions);
+    arena = bytes + layout.arena;
+    return true;
+  }
+
+  void *base = MAP_FAILED;
+  std::size_t size = 0;
+  std::uint32_t slots = 0;
+  std::uint64_t arena_bytes = 0;
+  shm_header *header = nullptr;
+  hash_request *requests = nullptr;
+  hash_completion *completions = nullptr;
+  unsigned char *arena = nullptr;
+  // Mapped by clients only
+  void *bell = MAP_FAILED;
+};
+
+std::string default_hash_socket_path()
+{
+  if (const char *runtime = std::getenv("XDG_RUNTIME_DIR"))
+  {
+    return std::string(runtime) + "/sha256-comparison.sock";
+  }
+  return "/tmp/sha256-comparison-" + std::to_string(::getuid()) + ".sock";
+}
+
+hash_client::hash_client(const std::string &socket_path, std::size_t arena_bytes,
+                         std::uint32_t ring_slots)
+    : shm(std::make_unique<hash_shared_memory>())
+{
+  std::uint32_t slots = std::bit_ceil(std::clamp(ring_slots, 1u, max_ring_slots));
+  arena_bytes = (std::min)(static_cast<std::uint64_t>(arena_bytes), max_arena_bytes);
+  int memfd = -1;
+  try
+  {
+    socket_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0)
+    {
+      throw_errno("socket");
+    }
+    sockaddr_un addr = socket_address(socket_path);
+    if (::connect(socket_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+      throw_errno("connect");
+    }
+    // A stopped daemon may still hold the socket without answering
+    timeval timeout = {5, 0};
+    ::setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Sealed against shrinking, which would fault the daemon
+    memfd = ::memfd_create("sha256-client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0 ||
+        ::ftruncate(memfd, static_cast<off_t>(layout_for(slots, arena_bytes).total)) != 0 ||
+        ::fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0 ||
+        !shm->map(memfd, slots, arena_bytes))
+    {
+      throw_errno("memfd");
+    }
+    shm->header->magic = shm_magic;
+    shm->header->version = shm_version;
+    shm->header->slots = slots;
+    shm->header->arena_bytes = arena_bytes;
+
+    hello_message hello = {shm_magic, shm_version, slots, 0, arena_bytes};
+    if (!send_with_fd(socket_fd, &hello, sizeof(hello), memfd))
+    {
+      throw_errno("send");
+    }
+    ::close(memfd);
+    memfd = -1;
+
+    welcome_message welcome;
+    int bell_fd;
+    if (!receive_with_fd(socket_fd, &welcome, sizeof(welcome), bell_fd))
+    {
+      throw std::system_error(ECONNRESET, std::generic_category(), "handshake");
+    }
+    if (welcome.status != 0 || bell_fd < 0)
+    {
+      if (bell_fd >= 0)
+      {
+        ::close(bell_fd);
+      }
+      throw std::system_error(welcome.status ? welcome.status : EPROTO,
+                              std::generic_category(), "handshake");
+    }
+    shm->bell = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, bell_fd, 0);
+    ::close(bell_fd);
+    if (shm->bell == MAP_FAILED)
+    {
+      throw_errno("mmap");
+    }
+  }
+  catch (...)
+  {
+    if (memfd >= 0)
+    {
+      ::close(memfd);
+    }
+    if (socket_fd >= 0)
+    {
+      ::close(socket_fd);
+    }
+    throw;
+  }
+}
+
+hash_client::~hash_client()
+{
+  // The daemon notices the hang up and unmaps its side
+  ::close(socket_fd);
+}
+
+std::span<unsigned char> hash_client::arena()
+{
+  return {shm->arena, static_cast<std::size_t>(shm->arena_bytes)};
+}
+
+std::uint32_t hash_client::ring_slots() const
+{
+  return shm->slots;
+}
+
+bool hash_client::submit(const hash_request &request)
+{
+  auto &header = *shm->header;
+  std::uint32_t tail = header.submit_tail.load(std::memory_order_relaxed);
+  if (tail - header.submit_head.load(std::memory_order_acquire) >= shm->slots)
+  {
+    return false;
+  }
+  shm->requests[tail & (shm->slots - 1)] = request;
+  header.submit_tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+void hash_client::flush()
+{
+  auto &bell = *static_cast<hash_doorbell *>(shm->bell);
+  // Pairs with the fence in hash_server::wait_for_work
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (bell.sleeping.load(std::memory_order_relaxed))
+  {
+    bell.seq.fetch_add(1);
+    futex_wake(bell.seq);
+  }
+}
+
+std::size_t hash_client::poll(std::span<hash_completion> out)
+{
+  auto &header = *shm->header;
+  std::uint32_t head = header.complete_head.load(std::memory_order_relaxed);
+  std::uint32_t available = header.complete_tail.load(std::memory_order_acquire) - head;
+  std::size_t count = (std::min)(static_cast<std::size_t>(available), out.size());
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    out[i] = shm->completions[(head + i) & (shm->slots - 1)];
+  }
+  header.complete_head.store(head + static_cast<std::uint32_t>(count),
+                             std::memory_order_release);
+  return count;
+}
+
+std::size_t hash_client::wait(std::span<hash_completion> out, int timeout_ms)
+{
+  auto &header = *shm->header;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  // Like the server, spin briefly before sleeping: completions usually arrive
+  // within microseconds, sooner than a futex wake-up
+  constexpr int spin_rounds = 4096;
+  for (int i = 0; i < spin_rounds && timeout_ms != 0; ++i)
+  {
+    if (std::size_t count = poll(out))
+    {
+      return count;
+    }
+    _mm_pause();
+  }
+  for (;;)
+  {
+    if (std::size_t count = poll(out))
+    {
+      return count;
+    }
+    std::uint32_t seq = header.client_seq.load();
+    header.client_sleeping.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::size_t count = poll(out);
+    int slice = 100;
+    if (timeout_ms >= 0)
+    {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      slice = static_cast<int>(std::clamp<std::int64_t>(remaining.count(), 0, slice));
+    }
+    if (count == 0 && slice > 0)
+    {
+      futex_wait(header.client_seq, seq, slice);
+    }
+    header.client_sleeping.store(0);
+    if (count != 0)
+    {
+      return count;
+    }
+    if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+    {
+      return poll(out);
+    }
+    // Give up if the daemon went away
+    pollfd pfd = {socket_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR | POLLIN)))
+    {
+      return poll(out);
+    }
+  }
+}
+
+struct hash_server::connection
+{
+  ~connection()
+  {
+    ::close(fd);
+  }
+
+  int fd = -1;
+  hash_shared_memory shm;
+  // Daemon side copies, the client may scribble over the shared ones
+  std::uint32_t submit_head = 0;
+  std::uint32_t complete_tail = 0;
+  std::atomic<bool> dead{false};
+};
+
+hash_server::hash_server(const std::string &socket_path, const sha256_backend &backend,
+                         std::size_t max_batch)
+    : backend(backend), max_batch((std::max)(max_batch, std::size_t(1))), path(socket_path)
+{
+  try
+  {
+    sockaddr_un addr = socket_address(path);
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+      ::unlink(path.c_str());
+    }
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        ::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0)
+    {
+      throw_errno("listen");
+    }
+    stop_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    doorbell_fd = ::memfd_create("sha256-doorbell", MFD_CLOEXEC);
+    if (stop_fd < 0 || doorbell_fd < 0 ||
+        ::ftruncate(doorbell_fd, static_cast<off_t>(page_size)) != 0)
+    {
+      throw_errno("setup");
+    }
+    void *map = ::mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, doorbell_fd, 0);
+    if (map == MAP_FAILED)
+    {
+      throw_errno("mmap");
+    }
+    bell = static_cast<hash_doorbell *>(map);
+  }
+  catch (...)
+  {
+    for (int fd : {listen_fd, stop_fd, doorbell_fd})
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+      }
+    }
+    throw;
+  }
+}
+
+hash_server::~hash_server()
+{
+  stop();
+  if (acceptor.joinable())
+  {
+    acceptor.join();
+  }
+  clients.clear();
+  pending.clear();
+  ::munmap(bell, page_size);
+  ::close(doorbell_fd);
+  ::close(stop_fd);
+  ::close(listen_fd);
+  ::unlink(path.c_str());
+}
+
+void hash_server::stop()
+{
+  stopping.store(true);
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto written = ::write(stop_fd, &one, sizeof(one));
+  ring_doorbell();
+}
+
+hash_server_stats hash_server::stats() const
+{
+  return {requests.load(), batches.load(), bytes.load()};
+}
+
+void hash_server::ring_doorbell()
+{
+  bell->seq.fetch_add(1);
+  futex_wake(bell->seq);
+}
+
+hash_server::connection *hash_server::adopt(int fd)
+{
+  // A client that connects but never completes the handshake must not stall
+  // the acceptor
+  timeval timeout = {1, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  auto conn = std::make_unique<connection>();
+  hello_message hello;
+  int memfd;
+  if (!receive_with_fd(fd, &hello, sizeof(hello), memfd))
+  {
+    return nullptr;
+  }
+  int status = 0;
+  struct stat st;
+  if (memfd < 0 || hello.magic != shm_magic || hello.version != shm_version ||
+      hello.slots == 0 || hello.slots > max_ring_slots || !std::has_single_bit(hello.slots) ||
+      hello.arena_bytes > max_arena_bytes)
+  {
+    status = EPROTO;
+  }
+  else if (int seals = ::fcntl(memfd, F_GET_SEALS);
+           ::fstat(memfd, &st) != 0 ||
+           static_cast<std::uint64_t>(st.st_size) !=
+               layout_for(hello.slots, hello.arena_bytes).total ||
+           seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+  {
+    // Files that do not support seals fail F_GET_SEALS
+    status = EINVAL;
+  }
+  else if (!conn->shm.map(memfd, hello.slots, hello.arena_bytes))
+  {
+    status = errno;
+  }
+  if (memfd >= 0)
+  {
+    ::close(memfd);
+  }
+
+  welcome_message welcome = {status, shm_version};
+  if (!send_with_fd(fd, &welcome, sizeof(welcome), status == 0 ? doorbell_fd : -1) ||
+      status != 0)
+  {
+    return nullptr;
+  }
+  conn->fd = fd;
+  conn->submit_head = conn->shm.header->submit_head.load();
+  conn->complete_tail = conn->shm.header->complete_tail.load();
+  connection *adopted = conn.get();
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending.push_back(std::move(conn));
+  }
+  ring_doorbell();
+  return adopted;
+}
+
+void hash_server::accept_loop()
+{
+  // Watched for hang ups; connections are only freed by run() once dead
+  std::vector<connection *> watched;
+  std::vector<pollfd> fds;
+  while (!stopping.load())
+  {
+    fds.assign({{stop_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}});
+    for (auto *conn : watched)
+    {
+      fds.push_back({conn->fd, POLLIN, 0});
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0)
+    {
+      continue;
+    }
+    if (fds[0].revents)
+    {
+      break;
+    }
+    // Clients send nothing after the handshake, so any event is a hang up
+    // or a protocol violation
+    for (std::size_t i = fds.size(); i-- > 2;)
+    {
+      if (fds[i].revents)
+      {
+        watched[i - 2]->dead.store(true);
+        watched.erase(watched.begin() + static_cast<std::ptrdiff_t>(i - 2));
+        ring_doorbell();
+      }
+    }
+    if (fds[1].revents & POLLIN)
+    {
+      int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+      {
+        continue;
+      }
+      if (connection *conn = adopt(fd))
+      {
+        watched.push_back(conn);
+      }
+      else
+      {
+        ::close(fd);
+      }
+    }
+  }
+}
+
+void hash_server::wait_for_work()
+{
+  std::uint32_t seq = bell->seq.load();
+  bell->sleeping.store(1);
+  // Pairs with the fence in hash_client::flush
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool work = stopping.load();
+  for (const auto &conn : clients)
+  {
+    work = work || conn->dead.load() ||
+           conn->shm.header->submit_tail.load(std::memory_order_relaxed) != conn->submit_head;
+  }
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    work = work || !pending.empty();
+  }
+  if (!work)
+  {
+    futex_wait(bell->seq, seq, 1000);
+  }
+  bell->sleeping.store(0);
+}
+
+void hash_server::run()
+{
+  acceptor = std::thread(&hash_server::accept_loop, this);
+  sha256_engine engine = backend.create();
+
+  // Where each request of a batch came from, in gather order
+  struct origin
+  {
+    connection *conn;
+    std::uint64_t id;
+    std::int32_t status;
+    std::uint32_t op;
+    std::uint32_t input;
+  };
+  std::vector<origin> origins;
+  std::vector<sha256_input> inputs[2];
+  std::vector<sha256_digest> digests[2];
+  constexpr int spin_rounds = 4096;
+  int idle = 0;
+
+  while (!stopping.load(std::memory_order_relaxed))
+  {
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex);
+      for (auto &conn : pending)
+      {
+        clients.push_back(std::move(conn));
+      }
+      pending.clear();
+    }
+    std::erase_if(clients, [](const auto &conn)
+                  { return conn->dead.load(); });
+
+    origins.clear();
+    inputs[0].clear();
+    inputs[1].clear();
+    for (const auto &conn : clients)
+    {
+      auto &shm = conn->shm;
+      std::uint32_t mask = shm.slots - 1;
+      std::uint32_t submitted = shm.header->submit_tail.load(std::memory_order_acquire) -
+                                conn->submit_head;
+      std::uint32_t free_slots =
+          shm.slots - (conn->complete_tail -
+                       shm.header->complete_head.load(std::memory_order_acquire));
+      std::size_t take = (std::min)({static_cast<std::size_t>(submitted),
+                                     static_cast<std::size_t>((std::min)(free_slots, shm.slots)),
+                                     max_batch - origins.size()});
+      for (std::size_t i = 0; i < take; ++i)
+      {
+        hash_request request = shm.requests[(conn->submit_head + i) & mask];
+        origin o = {conn.get(), request.id, 0, request.op, 0};
+        if (request.op > hash_op_sha256d || request.offset > shm.arena_bytes ||
+            request.length > shm.arena_bytes - request.offset)
+        {
+          o.status = EINVAL;
+        }
+        else
+        {
+          o.input = static_cast<std::uint32_t>(inputs[request.op].size());
+          inputs[request.op].emplace_back(shm.arena + request.offset, request.length);
+        }
+        origins.push_back(o);
+      }
+      conn->submit_head += static_cast<std::uint32_t>(take);
+      shm.header->submit_head.store(conn->submit_head, std::memory_order_release);
+    }
+
+    if (origins.empty())
+    {
+      if (++idle < spin_rounds)
+      {
+        _mm_pause();
+      }
+      else
+      {
+        wait_for_work();
+        idle = 0;
+      }
+      continue;
+    }
+    idle = 0;
+
+    std::uint64_t batch_bytes = 0;
+    for (int op : {hash_op_sha256, hash_op_sha256d})
+    {
+      digests[op].resize(inputs[op].size());
+      if (inputs[op].empty())
+      {
+        continue;
+      }
+      if (op == hash_op_sha256)
+      {
+        engine.hash_many(inputs[op], digests[op]);
+      }
+      else
+      {
+        engine.double_hash_many(inputs[op], digests[op]);
+      }
+      for (const auto &input : inputs[op])
+      {
+        batch_bytes += input.size();
+      }
+    }
+
+    // Requests of one client are contiguous in origins
+    for (std::size_t i = 0; i < origins.size();)
+    {
+      connection *conn = origins[i].conn;
+      auto &shm = conn->shm;
+      for (; i < origins.size() && origins[i].conn == conn; ++i)
+      {
+        const auto &o = origins[i];
+        hash_completion &completion = shm.completions[conn->complete_tail++ & (shm.slots - 1)];
+        completion.id = o.id;
+        completion.status = o.status;
+        completion.reserved = 0;
+        completion.digest = o.status == 0 ? digests[o.op][o.input] : sha256_digest{};
+      }
+      shm.header->complete_tail.store(conn->complete_tail, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (shm.header->client_sleeping.load(std::memory_order_relaxed))
+      {
+        shm.header->client_seq.fetch_add(1);
+        futex_wake(shm.header->client_seq);
+      }
+    }
+
+    requests.fetch_add(origins.size(), std::memory_order_relaxed);
+    batches.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(batch_bytes, std::memory_order_relaxed);
+  }
+
+  acceptor.join();
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+// Local hashing service: clients pass payloads through a shared memory arena
+// and exchange requests and digests through two single producer, single
+// consumer rings in the same memfd. A Unix domain socket is only used to hand
+// over the memfd and to notice disconnects; futexes in shared memory wake a
+// sleeping daemon or client. Linux only.
+
+#include "sha256_engine.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum hash_op : std::uint32_t
+{
+  hash_op_sha256 = 0,
+  // SHA256(SHA256(x)); batches of 64 byte messages use the multi-lane kernels
+  hash_op_sha256d = 1,
+};
+
+// Payload is arena()[offset, offset + length)
+struct hash_request
+{
+  std::uint64_t id;
+  std::uint64_t offset;
+  std::uint32_t length;
+  std::uint32_t op;
+};
+
+struct hash_completion
+{
+  std::uint64_t id;
+  // 0 or an errno value, e.g. EINVAL for a payload outside of the arena
+  std::int32_t status;
+  std::uint32_t reserved;
+  sha256_digest digest;
+};
+
+// $XDG_RUNTIME_DIR/sha256-comparison.sock, else /tmp/sha256-comparison-<uid>.sock
+std::string default_hash_socket_path();
+
+struct hash_shared_memory;
+struct hash_doorbell;
+
+class hash_client
+{
+public:
+  // ring_slots is rounded up to a power of two. Throws std::system_error if
+  // the daemon cannot be reached.
+  explicit hash_client(const std::string &socket_path,
+                       std::size_t arena_bytes = std::size_t(64) << 20,
+                       std::uint32_t ring_slots = 1024);
+  ~hash_client();
+
+  hash_client(const hash_client &) = delete;
+  hash_client &operator=(const hash_client &) = delete;
+
+  // Payload memory shared with the daemon. A payload must not change until
+  // its completion has been received.
+  std::span<unsigned char> arena();
+  std::uint32_t ring_slots() const;
+
+  // false if the submission ring is full
+  bool submit(const hash_request &request);
+  // Wakes the daemon if it is sleeping; call after one or more submit()
+  void flush();
+  // Pops available completions without blocking
+  std::size_t poll(std::span<hash_completion> out);
+  // Blocks until at least one completion is available, or timeout_ms passed
+  // (negative waits forever)
+  std::size_t wait(std::span<hash_completion> out, int timeout_ms = -1);
+
+private:
+  std::unique_ptr<hash_shared_memory> shm;
+  int socket_fd = -1;
+};
+
+struct hash_server_stats
+{
+  std::uint64_t requests = 0;
+  std::uint64_t batches = 0;
+  std::uint64_t bytes = 0;
+};
+
+class hash_server
+{
+public:
+  // Listens on socket_path, replacing a stale socket file. Throws
+  // std::system_error on failure.
+  hash_server(const std::string &socket_path, const sha256_backend &backend,
+              std::size_t max_batch = 256);
+  ~hash_server();
+
+  hash_server(const hash_server &) = delete;
+  hash_server &operator=(const hash_server &) = delete;
+
+  // Serves clients until stop(); hashing happens on the calling thread
+  void run();
+  // Thread safe, also from a signal handler
+  void stop();
+
+  hash_server_stats stats() const;
+
+private:
+  struct connection;
+
+  void accept_loop();
+  // nullptr if the handshake failed
+  connection *adopt(int fd);
+  void wait_for_work();
+  void ring_doorbell();
+
+  const sha256_backend &backend;
+  std::size_t max_batch;
+  std::string path;
+  int listen_fd = -1;
+  int stop_fd = -1;
+  int doorbell_fd = -1;
+  hash_doorbell *bell = nullptr;
+  std::atomic<bool> stopping{false};
+
+  std::mutex pending_mutex;
+  std::vector<std::unique_ptr<connection>> pending;
+  std::vector<std::unique_ptr<connection>> clients;
+  std::thread acceptor;
+
+  std::atomic<std::uint64_t> requests{0};
+  std::atomic<std::uint64_t> batches{0};
+  std::atomic<std::uint64_t> bytes{0};
+};
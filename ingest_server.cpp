@@ -0,0 +1,331 @@
+#include "ingest_server.h"
+
+#include "bitcoin/sha256.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr std::size_t header_size = sizeof(std::uint64_t);
+constexpr std::size_t digest_size = CSHA256::OUTPUT_SIZE;
+
+// Kept small since there is one per open stream
+struct connection
+{
+  CSHA256 sha;
+  // Payload bytes of the current stream still to come
+  std::uint64_t remaining = 0;
+  unsigned char header[header_size];
+  unsigned char reply[digest_size];
+  std::uint8_t header_bytes = 0;
+  // Bytes of reply already sent, digest_size if none is pending
+  std::uint8_t reply_sent = digest_size;
+  int fd = -1;
+  // Position in event_loop::open
+  std::uint32_t index = 0;
+};
+
+[[noreturn]] void throw_errno(const char *what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::uint64_t load_le64(const unsigned char *bytes)
+{
+  std::uint64_t value = 0;
+  for (std::size_t i = header_size; i-- > 0;)
+  {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+// false if the connection has to be closed
+bool flush_reply(connection &conn)
+{
+  while (conn.reply_sent < digest_size)
+  {
+    ssize_t sent = ::send(conn.fd, conn.reply + conn.reply_sent, digest_size - conn.reply_sent,
+                          MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn.reply_sent = static_cast<std::uint8_t>(conn.reply_sent + sent);
+  }
+  return true;
+}
+} // namespace
+
+struct ingest_server::event_loop
+{
+  int listen_fd = -1;
+  int epoll_fd = -1;
+  int stop_fd = -1;
+  std::vector<connection *> open;
+};
+
+ingest_server::ingest_server(const ingest_options &options)
+    : opts(options), loops(static_cast<std::size_t>((std::max)(options.threads, 1)))
+{
+  // Picks the SHA-NI or AVX2 transform for CSHA256
+  static const int detected = SHA256AutoDetect(sha256_implementation::USE_ALL);
+  (void)detected;
+  opts.receive_buffer = (std::max)(opts.receive_buffer, header_size);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(opts.port);
+  try
+  {
+    if (::inet_pton(AF_INET, opts.address.c_str(), &addr.sin_addr) != 1)
+    {
+      throw std::system_error(EINVAL, std::generic_category(), opts.address);
+    }
+    for (auto &loop : loops)
+    {
+      loop.listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      int one = 1;
+      if (loop.listen_fd < 0 ||
+          ::setsockopt(loop.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+          ::setsockopt(loop.listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+          ::bind(loop.listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+          ::listen(loop.listen_fd, SOMAXCONN) != 0)
+      {
+        throw_errno("listen");
+      }
+      // The other loops share the port picked for the first one
+      socklen_t length = sizeof(addr);
+      ::getsockname(loop.listen_fd, reinterpret_cast<sockaddr *>(&addr), &length);
+      bound_port = ntohs(addr.sin_port);
+
+      loop.epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+      loop.stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (loop.epoll_fd < 0 || loop.stop_fd < 0)
+      {
+        throw_errno("epoll");
+      }
+      // Every event carries a pointer: connections their own, the listener and
+      // the eventfd the address of their descriptor in the loop
+      epoll_event listen_event = {EPOLLIN | EPOLLET, {.ptr = &loop.listen_fd}};
+      epoll_event stop_event = {EPOLLIN, {.ptr = &loop.stop_fd}};
+      if (::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.listen_fd, &listen_event) != 0 ||
+          ::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.stop_fd, &stop_event) != 0)
+      {
+        throw_errno("epoll_ctl");
+      }
+    }
+  }
+  catch (...)
+  {
+    for (auto &loop : loops)
+    {
+      for (int fd : {loop.listen_fd, loop.epoll_fd, loop.stop_fd})
+      {
+        if (fd >= 0)
+        {
+          ::close(fd);
+        }
+      }
+    }
+    throw;
+  }
+}
+
+ingest_server::~ingest_server()
+{
+  for (auto &loop : loops)
+  {
+    for (auto *conn : loop.open)
+    {
+      ::close(conn->fd);
+      delete conn;
+    }
+    ::close(loop.listen_fd);
+    ::close(loop.epoll_fd);
+    ::close(loop.stop_fd);
+  }
+}
+
+std::size_t ingest_server::connection_bytes()
+{
+  return sizeof(connection);
+}
+
+ingest_stats ingest_server::stats() const
+{
+  return {streams.load(), bytes.load(), connections.load(), peak_connections.load()};
+}
+
+void ingest_server::stop()
+{
+  std::uint64_t one = 1;
+  for (auto &loop : loops)
+  {
+    [[maybe_unused]] auto written = ::write(loop.stop_fd, &one, sizeof(one));
+  }
+}
+
+void ingest_server::run()
+{
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < loops.size(); ++i)
+  {
+    threads.emplace_back([this, i] { serve(loops[i]); });
+  }
+  serve(loops[0]);
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+}
+
+void ingest_server::serve(event_loop &loop)
+{
+  std::vector<unsigned char> buffer(opts.receive_buffer);
+  std::vector<epoll_event> events(256);
+
+  auto close_connection = [&](connection *conn)
+  {
+    ::close(conn->fd);
+    loop.open[conn->index] = loop.open.back();
+    loop.open[conn->index]->index = conn->index;
+    loop.open.pop_back();
+    delete conn;
+    connections.fetch_sub(1, std::memory_order_relaxed);
+  };
+
+  // Reads are limited to the end of the current stream. A digest that
+  // cannot be sent right away then never has to wait behind the payload of
+  // the next stream in the shared buffer.
+  auto receive = [&](connection &conn) -> bool
+  {
+    if (!flush_reply(conn))
+    {
+      return false;
+    }
+    std::uint64_t received = 0;
+    bool open = true;
+    while (conn.reply_sent == digest_size)
+    {
+      std::size_t wanted = conn.header_bytes < header_size
+                               ? header_size - conn.header_bytes
+                               : static_cast<std::size_t>((std::min)(
+                                     conn.remaining, static_cast<std::uint64_t>(buffer.size())));
+      unsigned char *target =
+          conn.header_bytes < header_size ? conn.header + conn.header_bytes : buffer.data();
+      ssize_t num = ::recv(conn.fd, target, wanted, 0);
+      if (num < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (num <= 0)
+      {
+        open = num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        break;
+      }
+      if (conn.header_bytes < header_size)
+      {
+        conn.header_bytes = static_cast<std::uint8_t>(conn.header_bytes + num);
+        if (conn.header_bytes < header_size)
+        {
+          continue;
+        }
+        conn.remaining = load_le64(conn.header);
+        conn.sha.Reset();
+      }
+      else
+      {
+        // Hashed straight from the receive buffer
+        conn.sha.Write(buffer.data(), static_cast<std::size_t>(num));
+        conn.remaining -= static_cast<std::uint64_t>(num);
+        received += static_cast<std::uint64_t>(num);
+      }
+      if (conn.remaining == 0)
+      {
+        conn.sha.Finalize(conn.reply);
+        conn.reply_sent = 0;
+        conn.header_bytes = 0;
+        streams.fetch_add(1, std::memory_order_relaxed);
+        if (!flush_reply(conn))
+        {
+          open = false;
+          break;
+        }
+      }
+    }
+    bytes.fetch_add(received, std::memory_order_relaxed);
+    return open;
+  };
+
+  for (;;)
+  {
+    int count = ::epoll_wait(loop.epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+      const auto &event = events[static_cast<std::size_t>(i)];
+      if (event.data.ptr == &loop.stop_fd)
+      {
+        return;
+      }
+      if (event.data.ptr == &loop.listen_fd)
+      {
+        for (;;)
+        {
+          int fd = ::accept4(loop.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+          if (fd < 0)
+          {
+            break;
+          }
+          int one = 1;
+          ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          auto *conn = new connection;
+          conn->fd = fd;
+          conn->index = static_cast<std::uint32_t>(loop.open.size());
+          epoll_event conn_event = {EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, {.ptr = conn}};
+          if (::epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &conn_event) != 0)
+          {
+            ::close(fd);
+            delete conn;
+            continue;
+          }
+          loop.open.push_back(conn);
+          auto now = connections.fetch_add(1, std::memory_order_relaxed) + 1;
+          auto peak = peak_connections.load(std::memory_order_relaxed);
+          while (now > peak && !peak_connections.compare_exchange_weak(peak, now))
+          {
+          }
+        }
+        continue;
+      }
+      auto *conn = static_cast<connection *>(event.data.ptr);
+      if ((event.events & EPOLLERR) || !receive(*conn))
+      {
+        close_connection(conn);
+      }
+    }
+  }
+}
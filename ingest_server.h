@@ -0,0 +1,67 @@
+#pragma once
+
+// Streaming ingest over TCP. A stream is an 8 byte little endian length
+// followed by that many payload bytes, the server answers with the 32 byte
+// SHA-256 of the payload. A connection carries any number of streams one
+// after another. Linux only.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ingest_options
+{
+  std::string address = "127.0.0.1";
+  // 0 picks a free port, see ingest_server::port()
+  std::uint16_t port = 0;
+  // Event loops, each with its own SO_REUSEPORT listener and epoll instance
+  int threads = 1;
+  // Receive buffer shared by all connections of an event loop
+  std::size_t receive_buffer = std::size_t(64) << 10;
+};
+
+struct ingest_stats
+{
+  std::uint64_t streams = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t connections = 0;
+  std::uint64_t peak_connections = 0;
+};
+
+class ingest_server
+{
+public:
+  // Binds the listeners; throws std::system_error on failure
+  explicit ingest_server(const ingest_options &options);
+  ~ingest_server();
+
+  ingest_server(const ingest_server &) = delete;
+  ingest_server &operator=(const ingest_server &) = delete;
+
+  std::uint16_t port() const { return bound_port; }
+
+  // Serves until stop(), one event loop runs on the calling thread
+  void run();
+  // Thread safe
+  void stop();
+
+  ingest_stats stats() const;
+  // Per-connection state kept by the server, excluding kernel socket buffers
+  static std::size_t connection_bytes();
+
+private:
+  struct event_loop;
+
+  void serve(event_loop &loop);
+
+  ingest_options opts;
+  std::uint16_t bound_port = 0;
+  std::vector<event_loop> loops;
+
+  std::atomic<std::uint64_t> streams{0};
+  std::atomic<std::uint64_t> bytes{0};
+  std::atomic<std::uint64_t> connections{0};
+  std::atomic<std::uint64_t> peak_connections{0};
+};
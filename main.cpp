@@ -1,47 +1,28 @@
 #include <benchmark/benchmark.h>
 
 #include "algorithm_wrappers.h"
+#include "allocation_counter.h"
+#include "run_context.h"
+#include "sha256_batch.h"
+#include "sha256_dispatcher.h"
+#include "sha256_engine.h"
+#include "sha256_provider.h"
+#include "skip_unavailable.h"
+#include "topology.h"
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <latch>
+#include <map>
+#include <mutex>
 #include <random>
+#include <string>
+#include <thread>
 #include <type_traits>
 #include <iostream>
 
-#include <hwloc.h>
-
-static int getPhysicalCores()
-{
-  static const int num_physical_cores = []()
-  {
-    int num_physical_cores = 8;
-    int res = 0;
-    hwloc_topology_t topology;
-    if (hwloc_topology_init(&topology) != 0)
-    {
-      goto cleanup;
-    }
-    if (hwloc_topology_load(topology) != 0)
-    {
-      goto cleanup;
-    }
-    res = hwloc_get_nbobjs_by_type(topology, hwloc_obj_type_t::HWLOC_OBJ_CORE);
-    if (res > 0)
-    {
-      num_physical_cores = res;
-    }
-  cleanup:
-    hwloc_topology_destroy(topology);
-    if (res <= 0)
-    {
-      std::cerr << "Could not determine number of physical cores\n";
-    }
-    return num_physical_cores;
-  }();
-
-  return num_physical_cores;
-}
-
 template <typename sha256_wrapper>
 class data_fixture : public benchmark::Fixture
 {
@@ -52,6 +33,10 @@ public:
 
   void SetUp(::benchmark::State &state)
   {
+    if (skipUnavailable<sha256_wrapper>(state))
+    {
+      return;
+    }
     if (state.thread_index() == 0)
     {
       global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
@@ -61,6 +46,10 @@ public:
         SHA256AutoDetect(sha256_implementation::USE_ALL);
       }
 #endif // BITCOIN_IMPL
+      if constexpr (std::is_same_v<sha256_wrapper, sha256_auto>)
+      {
+        default_sha256_dispatcher(); // Calibrate outside of the measurement
+      }
     }
     // Fill data with reproducibly random bytes
     std::mt19937_64 gen;
@@ -86,10 +75,154 @@ public:
 template <typename sha256_wrapper>
 thread_local std::vector<unsigned char> data_fixture<sha256_wrapper>::data;
 
+#ifdef BITCOIN_IMPL
+// The bitcoin implementation behind the type-erased engine, to measure the
+// cost of runtime backend selection
+struct sha256_engine_bitcoin
+{
+  sha256_engine engine = sha256_engine::create<sha256_bitcoin>();
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    engine.add_bytes(bytes, num);
+  }
+  std::array<unsigned char, 32> digest() { return engine.digest(); }
+};
+#endif // BITCOIN_IMPL
+
+// The bitcoin kernels through EVP_Digest*, from the fast provider; compare
+// with sha256_openssl_global, which differs only in the provider
+struct sha256_openssl_fast
+{
+  std::unique_ptr<EVP_MD_CTX, openssl_evp_destroyer> ctx;
+
+  static bool available() { return sha256_fast_md() != nullptr; }
+
+  sha256_openssl_fast() : ctx(EVP_MD_CTX_create())
+  {
+    assert(static_cast<bool>(ctx));
+    EVP_DigestInit_ex(ctx.get(), sha256_fast_md(), NULL);
+  }
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    EVP_DigestUpdate(ctx.get(), bytes, num);
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp;
+    EVP_DigestFinal_ex(ctx.get(), tmp.data(), nullptr);
+    return tmp;
+  }
+  void reset() { EVP_DigestInit_ex(ctx.get(), sha256_fast_md(), NULL); }
+};
+
+// Heap allocations per hash, averaged over all threads
+static void reportAllocations(::benchmark::State &state,
+                              const allocation_counts &before)
+{
+  auto after = thread_allocation_counts();
+  double iterations = static_cast<double>((std::max)(state.iterations(),
+                                                     benchmark::IterationCount(1)));
+  state.counters["allocs_per_hash"] = benchmark::Counter(
+      static_cast<double>(after.allocations - before.allocations) / iterations,
+      benchmark::Counter::kAvgThreads);
+  state.counters["alloc_bytes_per_hash"] = benchmark::Counter(
+      static_cast<double>(after.bytes - before.bytes) / iterations,
+      benchmark::Counter::kAvgThreads);
+  if (!openssl_allocations_counted())
+  {
+    state.SetLabel("OpenSSL allocations not counted");
+  }
+}
+
+// Wrappers following the hashing protocol that only move memory. Run at the
+// same chunk sizes and thread counts they bound the throughput any hash can
+// reach.
+struct roofline_read
+{
+  std::uint64_t acc = 0;
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= num; i += sizeof(std::uint64_t))
+    {
+      std::uint64_t word;
+      std::memcpy(&word, bytes + i, sizeof(word));
+      acc ^= word;
+    }
+    for (; i < num; ++i)
+    {
+      acc ^= bytes[i];
+    }
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp = {};
+    std::memcpy(tmp.data(), &acc, sizeof(acc));
+    return tmp;
+  }
+};
+
+struct roofline_memcpy
+{
+  static thread_local std::vector<unsigned char> sink;
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    if (sink.size() < num)
+    {
+      sink.resize(num);
+    }
+    std::memcpy(sink.data(), bytes, num);
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    std::array<unsigned char, 32> tmp = {};
+    std::memcpy(tmp.data(), sink.data(), (std::min)(sink.size(), tmp.size()));
+    return tmp;
+  }
+};
+
+thread_local std::vector<unsigned char> roofline_memcpy::sink;
+
+// Sequential read bandwidth per "size/threads", recorded by the roofline_read
+// benchmarks which are registered before all hash implementations. Families
+// with further arguments pass them as scope, so they are only compared with
+// roofline_read runs of the same configuration.
+class roofline
+{
+public:
+  template <typename sha256_wrapper>
+  static void report(::benchmark::State &state, double bytes_per_second,
+                     const std::string &scope = "")
+  {
+    std::string key = scope + std::to_string(state.range(0)) + "/" +
+                      std::to_string(state.threads());
+    std::lock_guard<std::mutex> lock(mutex);
+    if constexpr (std::is_same_v<sha256_wrapper, roofline_read>)
+    {
+      read_bytes_per_second[key] = bytes_per_second;
+    }
+    else
+    {
+      auto it = read_bytes_per_second.find(key);
+      if (it != read_bytes_per_second.end() && it->second > 0.0)
+      {
+        state.counters["roofline_pct"] = 100.0 * bytes_per_second / it->second;
+      }
+    }
+  }
+
+private:
+  static inline std::map<std::string, double> read_bytes_per_second;
+  static inline std::mutex mutex;
+};
+
 #define BENCHMARK_SHA256(SHA256_TYPE)                                                      \
   BENCHMARK_TEMPLATE_DEFINE_F(data_fixture, BM_##SHA256_TYPE, SHA256_TYPE)                 \
   (::benchmark::State & state)                                                             \
   {                                                                                        \
+    auto allocs_before = thread_allocation_counts();                                       \
+    auto begin = std::chrono::steady_clock::now();                                         \
     for (auto _ : state)                                                                   \
     {                                                                                      \
       SHA256_TYPE sha256_obj;                                                              \
@@ -98,10 +231,18 @@ thread_local std::vector<unsigned char> data_fixture<sha256_wrapper>::data;
       benchmark::DoNotOptimize(result);                                                    \
       benchmark::ClobberMemory();                                                          \
     }                                                                                      \
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;      \
+    reportAllocations(state, allocs_before);                                               \
     /* TODO: Check why multiplying with state.threads() became necessary. */               \
     /* https://github.com/google/benchmark/blob/main/docs/user_guide.md#custom-counters */ \
     state.SetBytesProcessed(int64_t(state.iterations()) *                                  \
                             int64_t(state.range(0)) * state.threads());                    \
+    if (state.thread_index() == 0 && elapsed.count() > 0.0)                                \
+    {                                                                                      \
+      roofline::report<SHA256_TYPE>(                                                       \
+          state, double(state.iterations()) * double(state.range(0)) * state.threads() /   \
+                     elapsed.count());                                                     \
+    }                                                                                      \
   }                                                                                        \
   BENCHMARK_REGISTER_F(data_fixture, BM_##SHA256_TYPE)                                     \
       ->Range(1LL << 8, 1LL << 16)                                                         \
@@ -109,20 +250,498 @@ thread_local std::vector<unsigned char> data_fixture<sha256_wrapper>::data;
       ->UseRealTime()                                                                      \
       ->Name(#SHA256_TYPE);
 
-// BENCHMARK_SHA256(sha256_dummy); // Do nothing
+// One object per thread, reset between messages instead of constructed anew
+#define BENCHMARK_SHA256_REUSE(SHA256_TYPE)                                                \
+  BENCHMARK_TEMPLATE_DEFINE_F(data_fixture, BM_##SHA256_TYPE##_reuse, SHA256_TYPE)         \
+  (::benchmark::State & state)                                                             \
+  {                                                                                        \
+    SHA256_TYPE sha256_obj;                                                                \
+    auto allocs_before = thread_allocation_counts();                                       \
+    for (auto _ : state)                                                                   \
+    {                                                                                      \
+      sha256_obj.reset();                                                                  \
+      sha256_obj.add_bytes(data.data(), data.size());                                      \
+      auto result = sha256_obj.digest();                                                   \
+      benchmark::DoNotOptimize(result);                                                    \
+      benchmark::ClobberMemory();                                                          \
+    }                                                                                      \
+    reportAllocations(state, allocs_before);                                               \
+    state.SetBytesProcessed(int64_t(state.iterations()) *                                  \
+                            int64_t(state.range(0)) * state.threads());                    \
+  }                                                                                        \
+  BENCHMARK_REGISTER_F(data_fixture, BM_##SHA256_TYPE##_reuse)                             \
+      ->Range(1LL << 8, 1LL << 16)                                                         \
+      ->ThreadRange(1, getPhysicalCores())                                                 \
+      ->UseRealTime()                                                                      \
+      ->Name(#SHA256_TYPE "_reuse");
+
+// Many independent messages of equal size, hashed with one hash_many call
+template <typename sha256_wrapper>
+class batch_fixture : public benchmark::Fixture
+{
+public:
+  static thread_local std::vector<unsigned char> data;
+  static thread_local std::vector<sha256_input> inputs;
+  static thread_local std::vector<sha256_digest> digests;
+
+  void SetUp(::benchmark::State &state)
+  {
+    if (skipUnavailable<sha256_wrapper>(state))
+    {
+      return;
+    }
+    if (state.thread_index() == 0)
+    {
+      global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
+#ifdef BITCOIN_IMPL
+      SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif // BITCOIN_IMPL
+    }
+    auto message_size = static_cast<std::size_t>(state.range(0));
+    auto batch_size = static_cast<std::size_t>(state.range(1));
+    std::mt19937_64 gen;
+    data.resize(message_size * batch_size);
+    for (auto &byte : data)
+    {
+      byte = static_cast<unsigned char>(gen());
+    }
+    inputs.clear();
+    for (std::size_t i = 0; i < batch_size; ++i)
+    {
+      inputs.emplace_back(data.data() + i * message_size, message_size);
+    }
+    digests.resize(batch_size);
+  }
+  void TearDown(::benchmark::State &)
+  {
+    data.clear();
+    inputs.clear();
+    digests.clear();
+  }
+};
+
+template <typename sha256_wrapper>
+thread_local std::vector<unsigned char> batch_fixture<sha256_wrapper>::data;
+template <typename sha256_wrapper>
+thread_local std::vector<sha256_input> batch_fixture<sha256_wrapper>::inputs;
+template <typename sha256_wrapper>
+thread_local std::vector<sha256_digest> batch_fixture<sha256_wrapper>::digests;
+
+#define BENCHMARK_SHA256_BATCH(SHA256_TYPE)                                                \
+  BENCHMARK_TEMPLATE_DEFINE_F(batch_fixture, BM_##SHA256_TYPE##_batch, SHA256_TYPE)        \
+  (::benchmark::State & state)                                                             \
+  {                                                                                        \
+    for (auto _ : state)                                                                   \
+    {                                                                                      \
+      hash_many<SHA256_TYPE>(inputs, digests);                                             \
+      benchmark::DoNotOptimize(digests.data());                                            \
+      benchmark::ClobberMemory();                                                          \
+    }                                                                                      \
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()) *           \
+                            state.threads());                                              \
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(inputs.size()) *         \
+                            state.threads());                                              \
+  }                                                                                        \
+  BENCHMARK_REGISTER_F(batch_fixture, BM_##SHA256_TYPE##_batch)                            \
+      ->ArgsProduct({{32, 64, 256, 1024, 4096}, {1, 16, 256, 4096}})                       \
+      ->ArgNames({"", "batch"})                                                            \
+      ->ThreadRange(1, getPhysicalCores())                                                 \
+      ->UseRealTime()                                                                      \
+      ->Name(#SHA256_TYPE "_batch");
+
+// Double hashes of 64-byte messages, e.g. Merkle tree nodes
+#define BENCHMARK_SHA256D64_BATCH(SHA256_TYPE)                                             \
+  BENCHMARK_TEMPLATE_DEFINE_F(batch_fixture, BM_##SHA256_TYPE##_d64_batch, SHA256_TYPE)    \
+  (::benchmark::State & state)                                                             \
+  {                                                                                        \
+    for (auto _ : state)                                                                   \
+    {                                                                                      \
+      double_hash_many<SHA256_TYPE>(inputs, digests);                                      \
+      benchmark::DoNotOptimize(digests.data());                                            \
+      benchmark::ClobberMemory();                                                          \
+    }                                                                                      \
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()) *           \
+                            state.threads());                                              \
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(inputs.size()) *         \
+                            state.threads());                                              \
+  }                                                                                        \
+  BENCHMARK_REGISTER_F(batch_fixture, BM_##SHA256_TYPE##_d64_batch)                        \
+      ->ArgsProduct({{64}, {1, 16, 256, 4096}})                                            \
+      ->ArgNames({"", "batch"})                                                            \
+      ->ThreadRange(1, getPhysicalCores())                                                 \
+      ->UseRealTime()                                                                      \
+      ->Name(#SHA256_TYPE "_d64_batch");
+
+// One message split into fragments of state.range(1) bytes. state.range(2)
+// selects between one add_bytes per fragment (0) and a single add_iovec (1).
+template <typename sha256_wrapper>
+class fragment_fixture : public data_fixture<sha256_wrapper>
+{
+public:
+  static thread_local std::vector<iovec> fragments;
+
+  void SetUp(::benchmark::State &state)
+  {
+    data_fixture<sha256_wrapper>::SetUp(state);
+    auto &data = data_fixture<sha256_wrapper>::data;
+    auto fragment_size = static_cast<std::size_t>(state.range(1));
+    fragments.clear();
+    for (std::size_t offset = 0; offset < data.size(); offset += fragment_size)
+    {
+      fragments.push_back({data.data() + offset,
+                           (std::min)(fragment_size, data.size() - offset)});
+    }
+  }
+  void TearDown(::benchmark::State &state)
+  {
+    fragments.clear();
+    data_fixture<sha256_wrapper>::TearDown(state);
+  }
+};
+
+template <typename sha256_wrapper>
+thread_local std::vector<iovec> fragment_fixture<sha256_wrapper>::fragments;
+
+#define BENCHMARK_SHA256_IOVEC(SHA256_TYPE)                                                \
+  BENCHMARK_TEMPLATE_DEFINE_F(fragment_fixture, BM_##SHA256_TYPE##_iovec, SHA256_TYPE)     \
+  (::benchmark::State & state)                                                             \
+  {                                                                                        \
+    for (auto _ : state)                                                                   \
+    {                                                                                      \
+      SHA256_TYPE sha256_obj;                                                              \
+      if (state.range(2))                                                                  \
+      {                                                                                    \
+        add_iovec(sha256_obj, fragments.data(), fragments.size());                         \
+      }                                                                                    \
+      else                                                                                 \
+      {                                                                                    \
+        for (const auto &fragment : fragments)                                             \
+        {                                                                                  \
+          sha256_obj.add_bytes(static_cast<const unsigned char *>(fragment.iov_base),      \
+                               fragment.iov_len);                                          \
+        }                                                                                  \
+      }                                                                                    \
+      auto result = sha256_obj.digest();                                                   \
+      benchmark::DoNotOptimize(result);                                                    \
+      benchmark::ClobberMemory();                                                          \
+    }                                                                                      \
+    state.SetBytesProcessed(int64_t(state.iterations()) *                                  \
+                            int64_t(state.range(0)) * state.threads());                    \
+  }                                                                                        \
+  BENCHMARK_REGISTER_F(fragment_fixture, BM_##SHA256_TYPE##_iovec)                         \
+      ->ArgsProduct({{1LL << 16}, {8, 24, 100, 1500, 9000}, {0, 1}})                       \
+      ->ArgNames({"", "fragment", "iovec"})                                                \
+      ->UseRealTime()                                                                      \
+      ->Name(#SHA256_TYPE "_iovec");
+
+// Background memory traffic used to emulate bandwidth-heavy neighbours
+enum noise_kernel : int64_t
+{
+  noise_copy = 0,  // c[i] = a[i]
+  noise_triad = 1, // a[i] = b[i] + q * c[i]
+};
+
+class memory_noise
+{
+public:
+  // Size of each array streamed by a single noise thread, chosen to be well
+  // beyond the last level cache of the benchmarked machines.
+  static constexpr std::size_t array_bytes = std::size_t(64) << 20;
+
+  void start(int num_threads, noise_kernel kernel, int first_core)
+  {
+    stop_requested.store(false);
+    bytes_per_second.store(0.0);
+    std::latch ready(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+    {
+      threads.emplace_back([this, kernel, &ready, core = first_core + i]()
+                           { run(kernel, core, ready); });
+    }
+    // Only start hashing once every neighbour is streaming
+    ready.wait();
+  }
+
+  // Returns the aggregate bandwidth of all noise threads in bytes per second
+  double stop()
+  {
+    stop_requested.store(true);
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+    threads.clear();
+    return bytes_per_second.load();
+  }
+
+private:
+  void run(noise_kernel kernel, int core, std::latch &ready)
+  {
+    bindThreadToCore(core);
+    constexpr std::size_t n = array_bytes / sizeof(double);
+    std::vector<double> a(n, 1.0), b(n, 2.0), c(n, 0.5);
+    ready.count_down();
+
+    const double q = 3.0;
+    std::size_t bytes = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (!stop_requested.load(std::memory_order_relaxed))
+    {
+      if (kernel == noise_copy)
+      {
+        std::memcpy(c.data(), a.data(), n * sizeof(double));
+        bytes += 2 * n * sizeof(double);
+      }
+      else
+      {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          a[i] = b[i] + q * c[i];
+        }
+        bytes += 3 * n * sizeof(double);
+      }
+      benchmark::DoNotOptimize(a.data());
+      benchmark::DoNotOptimize(c.data());
+      benchmark::ClobberMemory();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    if (elapsed.count() > 0.0)
+    {
+      double rate = static_cast<double>(bytes) / elapsed.count();
+      double current = bytes_per_second.load();
+      while (!bytes_per_second.compare_exchange_weak(current, current + rate))
+      {
+      }
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<bool> stop_requested{false};
+  std::atomic<double> bytes_per_second{0.0};
+};
+
+// Hash threads occupy the lower half of the physical cores, noise threads are
+// pinned to the remaining ones.
+static int getContentionHashThreads()
+{
+  return (std::max)(1, getPhysicalCores() / 2);
+}
+
+// Arguments: chunk size, number of noise threads, noise kernel
+static void contentionArguments(benchmark::internal::Benchmark *b)
+{
+  int max_noise = (std::max)(1, getPhysicalCores() - getContentionHashThreads());
+  for (int64_t size : {int64_t(1) << 8, int64_t(1) << 12, int64_t(1) << 16})
+  {
+    b->Args({size, 0, noise_copy});
+    for (int noise = 1;; noise = (std::min)(noise * 2, max_noise))
+    {
+      b->Args({size, noise, noise_copy});
+      b->Args({size, noise, noise_triad});
+      if (noise == max_noise)
+        break;
+    }
+  }
+}
+
+template <typename sha256_wrapper>
+class contention_fixture : public data_fixture<sha256_wrapper>
+{
+public:
+  static memory_noise noise;
+
+  // Undisturbed throughput per "name/size/threads", recorded by the runs
+  // without noise threads, which are registered first.
+  static std::map<std::string, double> baseline;
+  static std::mutex baseline_mutex;
+
+  void SetUp(::benchmark::State &state)
+  {
+    data_fixture<sha256_wrapper>::SetUp(state);
+    bindThreadToCore(state.thread_index());
+    if (state.thread_index() == 0 && state.range(1) > 0)
+    {
+      noise.start(static_cast<int>(state.range(1)),
+                  static_cast<noise_kernel>(state.range(2)),
+                  getContentionHashThreads());
+    }
+  }
+  void TearDown(::benchmark::State &state)
+  {
+    if (state.thread_index() == 0 && state.range(1) > 0)
+    {
+      state.counters["noise_bytes_per_second"] = noise.stop();
+    }
+    if (state.thread_index() == 0 && measured > 0.0)
+    {
+      roofline::report<sha256_wrapper>(state, measured,
+                                       "contended/" + std::to_string(state.range(1)) + "/" +
+                                           std::to_string(state.range(2)) + "/");
+      measured = 0.0;
+    }
+    unbindThread();
+    data_fixture<sha256_wrapper>::TearDown(state);
+  }
+
+  static void report(::benchmark::State &state, const char *name,
+                     double bytes_per_second)
+  {
+    std::string key = std::string(name) + "/" + std::to_string(state.range(0)) +
+                      "/" + std::to_string(state.threads());
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+    if (state.range(1) == 0)
+    {
+      baseline[key] = bytes_per_second;
+      return;
+    }
+    auto it = baseline.find(key);
+    if (it != baseline.end() && it->second > 0.0)
+    {
+      state.counters["degradation"] = 1.0 - bytes_per_second / it->second;
+    }
+  }
+
+protected:
+  // Throughput of the last run, set by thread 0 and reported on teardown
+  double measured = 0.0;
+};
+
+template <typename sha256_wrapper>
+memory_noise contention_fixture<sha256_wrapper>::noise;
+template <typename sha256_wrapper>
+std::map<std::string, double> contention_fixture<sha256_wrapper>::baseline;
+template <typename sha256_wrapper>
+std::mutex contention_fixture<sha256_wrapper>::baseline_mutex;
+
+#define BENCHMARK_SHA256_CONTENDED(SHA256_TYPE)                                             \
+  BENCHMARK_TEMPLATE_DEFINE_F(contention_fixture, BM_##SHA256_TYPE##_contended, SHA256_TYPE) \
+  (::benchmark::State & state)                                                              \
+  {                                                                                         \
+    auto begin = std::chrono::steady_clock::now();                                          \
+    for (auto _ : state)                                                                    \
+    {                                                                                       \
+      SHA256_TYPE sha256_obj;                                                               \
+      sha256_obj.add_bytes(data.data(), data.size());                                       \
+      auto result = sha256_obj.digest();                                                    \
+      benchmark::DoNotOptimize(result);                                                     \
+      benchmark::ClobberMemory();                                                           \
+    }                                                                                       \
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;       \
+    state.SetBytesProcessed(int64_t(state.iterations()) *                                   \
+                            int64_t(state.range(0)) * state.threads());                     \
+    if (state.thread_index() == 0 && elapsed.count() > 0.0)                                 \
+    {                                                                                       \
+      measured = double(state.iterations()) * double(state.range(0)) * state.threads() /   \
+                 elapsed.count();                                                           \
+      report(state, #SHA256_TYPE, measured);                                                \
+    }                                                                                       \
+  }                                                                                         \
+  BENCHMARK_REGISTER_F(contention_fixture, BM_##SHA256_TYPE##_contended)                    \
+      ->Apply(contentionArguments)                                                          \
+      ->ArgNames({"", "noise_threads", "noise_kernel"})                                     \
+      ->ThreadRange(1, getContentionHashThreads())                                          \
+      ->UseRealTime()                                                                       \
+      ->Name(#SHA256_TYPE "_contended");
+
+// Memory bandwidth roofline, must be registered first
+BENCHMARK_SHA256(roofline_read);
+BENCHMARK_SHA256(roofline_memcpy);
+BENCHMARK_SHA256(sha256_dummy); // Do nothing, measures the loop overhead
+
 BENCHMARK_SHA256(sha256_zedwood);
 #ifdef BITCOIN_IMPL
 BENCHMARK_SHA256(sha256_bitcoin);
+BENCHMARK_SHA256(sha256_engine_bitcoin);
 #endif // BITCOIN_IMPL
 BENCHMARK_SHA256(sha256_openssl_deprecated);
 BENCHMARK_SHA256(sha256_openssl_oneshot);
 BENCHMARK_SHA256(sha256_openssl_global);
 BENCHMARK_SHA256(sha256_openssl);
+BENCHMARK_SHA256(sha256_openssl_pooled);
+BENCHMARK_SHA256(sha256_openssl_fast);
+BENCHMARK_SHA256(sha256_auto);
 #ifdef USE_NSS
 BENCHMARK_SHA256(sha256_libnss);
 #endif
+#ifdef SHA256_AFALG
+BENCHMARK_SHA256(sha256_afalg);
+#endif
 #ifdef _WIN32
 BENCHMARK_SHA256(sha256_bcrypt);
 #endif
 
-BENCHMARK_MAIN();
+BENCHMARK_SHA256_REUSE(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256_REUSE(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256_REUSE(sha256_openssl_deprecated);
+BENCHMARK_SHA256_REUSE(sha256_openssl_global);
+BENCHMARK_SHA256_REUSE(sha256_openssl);
+BENCHMARK_SHA256_REUSE(sha256_openssl_pooled);
+BENCHMARK_SHA256_REUSE(sha256_openssl_fast);
+#ifdef USE_NSS
+BENCHMARK_SHA256_REUSE(sha256_libnss);
+#endif
+#ifdef SHA256_AFALG
+BENCHMARK_SHA256_REUSE(sha256_afalg);
+#endif
+#ifdef _WIN32
+BENCHMARK_SHA256_REUSE(sha256_bcrypt);
+#endif
+
+BENCHMARK_SHA256_BATCH(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256_BATCH(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256_BATCH(sha256_openssl_deprecated);
+BENCHMARK_SHA256_BATCH(sha256_openssl_oneshot);
+BENCHMARK_SHA256_BATCH(sha256_openssl_global);
+BENCHMARK_SHA256_BATCH(sha256_openssl);
+BENCHMARK_SHA256_BATCH(sha256_openssl_pooled);
+BENCHMARK_SHA256_BATCH(sha256_openssl_fast);
+#ifdef USE_NSS
+BENCHMARK_SHA256_BATCH(sha256_libnss);
+#endif
+#ifdef _WIN32
+BENCHMARK_SHA256_BATCH(sha256_bcrypt);
+#endif
+
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256D64_BATCH(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256D64_BATCH(sha256_openssl_deprecated);
+BENCHMARK_SHA256D64_BATCH(sha256_openssl_global);
+
+BENCHMARK_SHA256_IOVEC(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256_IOVEC(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256_IOVEC(sha256_openssl_deprecated);
+BENCHMARK_SHA256_IOVEC(sha256_openssl);
+
+BENCHMARK_SHA256_CONTENDED(roofline_read);
+BENCHMARK_SHA256_CONTENDED(sha256_zedwood);
+#ifdef BITCOIN_IMPL
+BENCHMARK_SHA256_CONTENDED(sha256_bitcoin);
+#endif // BITCOIN_IMPL
+BENCHMARK_SHA256_CONTENDED(sha256_openssl_deprecated);
+BENCHMARK_SHA256_CONTENDED(sha256_openssl_oneshot);
+BENCHMARK_SHA256_CONTENDED(sha256_openssl_global);
+BENCHMARK_SHA256_CONTENDED(sha256_openssl);
+#ifdef _WIN32
+BENCHMARK_SHA256_CONTENDED(sha256_bcrypt);
+#endif
+
+int main(int argc, char **argv)
+{
+  addRunContext();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+  {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
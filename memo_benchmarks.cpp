@@ -0,0 +1,137 @@
+// Digest memoization benchmarks, registered next to the in-memory ones in
+// main.cpp.
+
+#include "algorithm_wrappers.h"
+#include "digest_memo.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t hot_messages = 64;
+constexpr std::size_t schedule_size = 4096;
+
+// Messages of state.range(0) bytes, of which state.range(1) percent repeat one
+// of a few hot messages and the others are new. Without memoization, every
+// message is hashed by the wrapper directly.
+template <typename sha256_wrapper, bool memoize>
+void memo_hash(benchmark::State &state)
+{
+  // Shared by all threads and cleared for each run
+  static digest_memo memo;
+  auto size = static_cast<std::size_t>(state.range(0));
+  auto hit_percent = static_cast<std::uint64_t>(state.range(1));
+
+  std::mt19937_64 gen(42);
+  std::vector<unsigned char> hot(hot_messages * size);
+  for (auto &byte : hot)
+  {
+    byte = static_cast<unsigned char>(gen());
+  }
+  std::vector<bool> schedule(schedule_size);
+  for (std::size_t i = 0; i < schedule_size; ++i)
+  {
+    schedule[i] = gen() % 100 < hit_percent;
+  }
+  // New messages differ in their first 16 bytes: a counter and the thread
+  std::vector<unsigned char> cold(size);
+  for (auto &byte : cold)
+  {
+    byte = static_cast<unsigned char>(gen());
+  }
+  std::uint64_t counter = 0;
+  auto thread = static_cast<std::uint64_t>(state.thread_index());
+  std::memcpy(cold.data() + 8, &thread, sizeof(thread));
+
+  if (state.thread_index() == 0)
+  {
+#ifdef BITCOIN_IMPL
+    SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif
+    // The other threads do not touch the memo before the timed loop starts
+    memo.clear();
+    sha256_memoized<sha256_wrapper> warm(memo);
+    for (std::size_t i = 0; i < hot_messages; ++i)
+    {
+      warm.add_bytes(hot.data() + i * size, size);
+      warm.digest();
+      warm.reset();
+    }
+  }
+  digest_memo_stats before = memo.stats();
+
+  std::conditional_t<memoize, sha256_memoized<sha256_wrapper>, sha256_wrapper> sha_obj = [&]
+  {
+    if constexpr (memoize)
+    {
+      return sha256_memoized<sha256_wrapper>(memo);
+    }
+    else
+    {
+      return sha256_wrapper();
+    }
+  }();
+  std::size_t i = 0;
+  for (auto _ : state)
+  {
+    const unsigned char *message;
+    if (schedule[i % schedule_size])
+    {
+      message = hot.data() + i % hot_messages * size;
+    }
+    else
+    {
+      ++counter;
+      std::memcpy(cold.data(), &counter, sizeof(counter));
+      message = cold.data();
+    }
+    ++i;
+    sha_obj.add_bytes(message, size);
+    benchmark::DoNotOptimize(sha_obj.digest());
+    sha_obj.reset();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+  if (memoize && state.thread_index() == 0)
+  {
+    // All threads have left the loop, the counts cover them
+    digest_memo_stats after = memo.stats();
+    auto hits = after.hits - before.hits;
+    auto lookups = after.lookups - before.lookups;
+    state.counters["hit_rate"] = lookups ? double(hits) / double(lookups) : 0.0;
+    state.counters["bytes_saved_per_second"] = benchmark::Counter(
+        static_cast<double>(after.bytes_saved - before.bytes_saved), benchmark::Counter::kIsRate);
+  }
+}
+
+void memo_args(benchmark::internal::Benchmark *b)
+{
+  b->ArgNames({"size", "hit_percent"});
+  for (int64_t size : {64, 256, 1024})
+  {
+    for (int64_t hit_percent : {0, 25, 50, 75, 90, 99})
+    {
+      b->Args({size, hit_percent});
+    }
+  }
+}
+
+} // namespace
+
+#ifdef BITCOIN_IMPL
+BENCHMARK_TEMPLATE(memo_hash, sha256_bitcoin, false)->Apply(memo_args);
+BENCHMARK_TEMPLATE(memo_hash, sha256_bitcoin, true)->Apply(memo_args);
+BENCHMARK_TEMPLATE(memo_hash, sha256_bitcoin, true)
+    ->ArgNames({"size", "hit_percent"})
+    ->Args({256, 90})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+#endif // BITCOIN_IMPL
+BENCHMARK_TEMPLATE(memo_hash, sha256_openssl, false)->Apply(memo_args);
+BENCHMARK_TEMPLATE(memo_hash, sha256_openssl, true)->Apply(memo_args);
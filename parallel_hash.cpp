@@ -0,0 +1,162 @@
+#include "parallel_hash.h"
+
+#include "topology.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include <sys/stat.h>
+
+namespace
+{
+// Consecutive entries of the size-sorted order
+struct task
+{
+  std::size_t first;
+  std::size_t count;
+};
+
+struct work_queue
+{
+  std::mutex mutex;
+  std::deque<task> tasks;
+
+  bool pop_front(task &t)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty())
+    {
+      return false;
+    }
+    t = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+
+  bool steal_back(task &t)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty())
+    {
+      return false;
+    }
+    t = tasks.back();
+    tasks.pop_back();
+    return true;
+  }
+};
+
+// Run body(worker index) on num_threads threads, including the calling one
+template <typename Body>
+void run_on_threads(int num_threads, Body body)
+{
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i)
+  {
+    threads.emplace_back(body, i);
+  }
+  body(0);
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+}
+} // namespace
+
+parallel_file_hasher::parallel_file_hasher(const sha256_backend &backend,
+                                           const file_hash_options &options,
+                                           const parallel_hash_options &parallel)
+    : parallel(parallel)
+{
+  int num_threads = parallel.num_threads > 0 ? parallel.num_threads : getPhysicalCores();
+  hashers.reserve(static_cast<std::size_t>(num_threads));
+  for (int i = 0; i < num_threads; ++i)
+  {
+    hashers.emplace_back(backend, options);
+  }
+}
+
+std::vector<file_hash_result>
+parallel_file_hasher::hash(const std::vector<std::string> &paths)
+{
+  std::vector<file_hash_result> results(paths.size());
+  if (paths.empty())
+  {
+    return results;
+  }
+  const int num_threads = threads();
+
+  // Sizes, collected in parallel since stat dominates for small files
+  std::vector<std::uint64_t> sizes(paths.size(), 0);
+  {
+    std::atomic<std::size_t> next{0};
+    run_on_threads(num_threads, [&](int)
+                   {
+      for (std::size_t i = next++; i < paths.size(); i = next++)
+      {
+        struct stat st;
+        if (::stat(paths[i].c_str(), &st) == 0)
+        {
+          sizes[i] = static_cast<std::uint64_t>(st.st_size);
+        }
+      } });
+  }
+
+  // Largest first; ties keep the input order
+  std::vector<std::size_t> order(paths.size());
+  std::iota(order.begin(), order.end(), std::size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                   { return sizes[a] > sizes[b]; });
+
+  std::vector<task> tasks;
+  for (std::size_t first = 0; first < order.size();)
+  {
+    std::size_t count = 0;
+    std::uint64_t bytes = 0;
+    do
+    {
+      bytes += sizes[order[first + count]];
+      ++count;
+    } while (first + count < order.size() && count < parallel.batch_files &&
+             bytes + sizes[order[first + count]] <= parallel.batch_bytes);
+    tasks.push_back({first, count});
+    first += count;
+  }
+
+  // Deal round-robin so every worker starts with its largest task. Owners
+  // take from the front, thieves from the back where the small batches are.
+  std::vector<work_queue> queues(static_cast<std::size_t>(num_threads));
+  for (std::size_t i = 0; i < tasks.size(); ++i)
+  {
+    queues[i % queues.size()].tasks.push_back(tasks[i]);
+  }
+
+  run_on_threads(num_threads, [&](int worker)
+                 {
+    auto &hasher = hashers[static_cast<std::size_t>(worker)];
+    auto own = static_cast<std::size_t>(worker);
+    task t;
+    for (;;)
+    {
+      bool found = queues[own].pop_front(t);
+      for (std::size_t i = 1; !found && i < queues.size(); ++i)
+      {
+        found = queues[(own + i) % queues.size()].steal_back(t);
+      }
+      if (!found)
+      {
+        // No task creates new tasks, so empty queues mean we are done
+        return;
+      }
+      for (std::size_t i = t.first; i < t.first + t.count; ++i)
+      {
+        results[order[i]] = hasher.hash_path(paths[order[i]].c_str());
+      }
+    } });
+
+  return results;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "file_hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct parallel_hash_options
+{
+  // 0 uses one thread per physical core
+  int num_threads = 0;
+  // Files smaller than this are grouped into batches of about this many bytes
+  std::uint64_t batch_bytes = std::uint64_t(1) << 20;
+  std::size_t batch_files = 64;
+};
+
+// Hashes many files on a work-stealing pool. Every worker owns a file_hasher,
+// so read buffers and hash contexts are reused across files. Large files are
+// scheduled first to avoid stragglers, small files are handed out in batches.
+class parallel_file_hasher
+{
+public:
+  parallel_file_hasher(const sha256_backend &backend,
+                       const file_hash_options &options,
+                       const parallel_hash_options &parallel = {});
+
+  // results[i] belongs to paths[i], independent of the scheduling
+  std::vector<file_hash_result> hash(const std::vector<std::string> &paths);
+
+  int threads() const { return static_cast<int>(hashers.size()); }
+
+private:
+  parallel_hash_options parallel;
+  std::vector<file_hasher> hashers;
+};
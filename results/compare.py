@@ -0,0 +1,100 @@
+"""Compare benchmark throughput against a stored baseline.
+
+Usage: python compare.py baseline.json output.json [--min-threshold PCT] [--sigmas N]
+
+Both files are produced with --benchmark_out. When the runs used
+--benchmark_repetitions, the spread of the repetitions widens the threshold
+above which a change is reported, so noisy benchmarks do not raise false
+alarms. Exits with status 1 if any benchmark regressed.
+"""
+
+import argparse
+import json
+import math
+import statistics
+import sys
+
+CONTEXT_KEYS = [
+    "cpu_model",
+    "cpu_flags",
+    "cpu_microcode",
+    "cpu_governor",
+    "smt",
+    "compiler",
+    "openssl_version",
+    "library_build_type",
+]
+
+
+def load(file_path):
+    with open(file_path) as f:
+        data = json.load(f)
+
+    samples = {}
+    for benchmark in data["benchmarks"]:
+        if benchmark.get("run_type") == "aggregate":
+            continue
+        if "bytes_per_second" not in benchmark:
+            continue
+        name = benchmark.get("run_name", benchmark["name"])
+        samples.setdefault(name, []).append(benchmark["bytes_per_second"])
+
+    throughput = {}
+    for name, values in samples.items():
+        mean = statistics.fmean(values)
+        cv = statistics.stdev(values) / mean if len(values) > 1 and mean > 0 else 0.0
+        throughput[name] = (mean, cv, len(values))
+    return data.get("context", {}), throughput
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--min-threshold", type=float, default=5.0,
+                        help="smallest change in percent that is reported")
+    parser.add_argument("--sigmas", type=float, default=3.0,
+                        help="multiple of the combined relative standard deviation "
+                             "a change has to exceed")
+    args = parser.parse_args()
+
+    base_context, base = load(args.baseline)
+    current_context, current = load(args.current)
+
+    for key in CONTEXT_KEYS:
+        before, after = base_context.get(key), current_context.get(key)
+        if before != after:
+            print(f"context {key}: {before} -> {after}")
+
+    regressions = 0
+    print(f"{'benchmark':<70} {'baseline MB/s':>14} {'current MB/s':>14} "
+          f"{'delta %':>8} {'thresh %':>8}")
+    for name in sorted(base.keys() & current.keys()):
+        base_mean, base_cv, _ = base[name]
+        current_mean, current_cv, _ = current[name]
+        if base_mean <= 0:
+            continue
+        delta = 100.0 * (current_mean - base_mean) / base_mean
+        threshold = max(args.min_threshold,
+                        100.0 * args.sigmas * math.hypot(base_cv, current_cv))
+        if delta < -threshold:
+            verdict = "REGRESSION"
+            regressions += 1
+        elif delta > threshold:
+            verdict = "improvement"
+        else:
+            verdict = ""
+        print(f"{name:<70} {base_mean / 1e6:>14.1f} {current_mean / 1e6:>14.1f} "
+              f"{delta:>8.1f} {threshold:>8.1f} {verdict}")
+
+    for name in sorted(base.keys() - current.keys()):
+        print(f"{name:<70} missing in {args.current}")
+    for name in sorted(current.keys() - base.keys()):
+        print(f"{name:<70} missing in {args.baseline}")
+
+    print(f"{regressions} regression(s)")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,6 +8,10 @@ with open(file_path) as f:
     data = json.load(f)
 
 benchmark_data = data["benchmarks"]
+context = data.get("context", {})
+machine = ", ".join(
+    context[key] for key in ("cpu_model", "compiler", "openssl_version") if key in context
+)
 df = pd.json_normalize(benchmark_data)
 
 df["MB_per_second"] = df["bytes_per_second"] / 1e6
@@ -43,7 +47,8 @@ for num_bytes in batchsizes:
 
     plt.xlabel("Thread count")
     plt.ylabel("Throughput (MB/s)")
-    plt.title(f"SHA256 throughput by thread count for {num_bytes} byte chunks")
+    plt.title(f"SHA256 throughput by thread count for {num_bytes} byte chunks"
+              + (f"\n{machine}" if machine else ""))
 
     all_thread_counts = np.array(sorted(df["threads"].unique()))
     x_center_pos = mapping(all_thread_counts) + (num_implementations / 2.) * width - width / 2
@@ -0,0 +1,222 @@
+#include "resumable_hash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr char magic[8] = {'S', 'H', 'A', '2', '5', '6', 'C', 'K'};
+constexpr std::uint32_t format_version = 1;
+
+// Native byte order, like the digest cache
+struct checkpoint_record
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t size;
+  std::uint64_t dev;
+  std::uint64_t ino;
+  std::uint64_t file_size;
+  std::int64_t mtime_ns;
+  std::int64_t ctime_ns;
+  std::uint32_t h[8];
+  unsigned char block[64];
+  std::uint64_t bytes;
+  // FNV-1a of the bytes above
+  std::uint64_t check;
+};
+
+std::uint64_t fnv1a(const void *data, std::size_t num)
+{
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < num; ++i)
+  {
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+bool write_all(int fd, const void *data, std::size_t num)
+{
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  while (num > 0)
+  {
+    ssize_t written = ::write(fd, bytes, num);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    num -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+// Makes a rename in the directory of path durable
+void sync_directory(const std::string &path)
+{
+  auto slash = path.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0)
+  {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+} // namespace
+
+bool save_checkpoint(const std::string &path, const hash_checkpoint &checkpoint)
+{
+  checkpoint_record r = {};
+  std::memcpy(r.magic, magic, sizeof(magic));
+  r.version = format_version;
+  r.size = sizeof(r);
+  r.dev = checkpoint.file.dev;
+  r.ino = checkpoint.file.ino;
+  r.file_size = checkpoint.file.size;
+  r.mtime_ns = checkpoint.file.mtime_ns;
+  r.ctime_ns = checkpoint.file.ctime_ns;
+  std::copy(checkpoint.state.h.begin(), checkpoint.state.h.end(), r.h);
+  std::copy(checkpoint.state.block.begin(), checkpoint.state.block.end(), r.block);
+  r.bytes = checkpoint.state.bytes;
+  r.check = fnv1a(&r, offsetof(checkpoint_record, check));
+
+  std::string temp_path = path + ".tmp";
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return false;
+  }
+  if (!write_all(fd, &r, sizeof(r)) || ::fsync(fd) != 0)
+  {
+    int error = errno;
+    ::close(fd);
+    ::unlink(temp_path.c_str());
+    errno = error;
+    return false;
+  }
+  ::close(fd);
+  if (::rename(temp_path.c_str(), path.c_str()) != 0)
+  {
+    int error = errno;
+    ::unlink(temp_path.c_str());
+    errno = error;
+    return false;
+  }
+  sync_directory(path);
+  return true;
+}
+
+std::optional<hash_checkpoint> load_checkpoint(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return std::nullopt;
+  }
+  checkpoint_record r;
+  ssize_t num = ::pread(fd, &r, sizeof(r), 0);
+  ::close(fd);
+  if (num != static_cast<ssize_t>(sizeof(r)) ||
+      std::memcmp(r.magic, magic, sizeof(magic)) != 0 || r.version != format_version ||
+      r.size != sizeof(r) || r.check != fnv1a(&r, offsetof(checkpoint_record, check)))
+  {
+    return std::nullopt;
+  }
+  hash_checkpoint checkpoint;
+  checkpoint.file = {r.dev, r.ino, r.file_size, r.mtime_ns, r.ctime_ns};
+  std::copy(r.h, r.h + 8, checkpoint.state.h.begin());
+  std::copy(r.block, r.block + 64, checkpoint.state.block.begin());
+  checkpoint.state.bytes = r.bytes;
+  return checkpoint;
+}
+
+resumable_hash_result hash_resumable(const sha256_backend &backend, const char *path,
+                                     const std::string &checkpoint_path,
+                                     const resumable_hash_options &options)
+{
+  resumable_hash_result result;
+  if (!backend.has(sha256_midstate))
+  {
+    result.error = ENOTSUP;
+    return result;
+  }
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    result.error = fd < 0 ? errno : S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    return result;
+  }
+  file_key key = make_file_key(st);
+
+  auto engine = backend.create();
+  std::uint64_t offset = 0;
+  auto checkpoint = load_checkpoint(checkpoint_path);
+  if (checkpoint && checkpoint->file == key && checkpoint->state.bytes <= key.size)
+  {
+    engine.load_state(checkpoint->state);
+    offset = checkpoint->state.bytes;
+    result.resumed_from = offset;
+  }
+
+  posix_fadvise(fd, static_cast<off_t>(offset), 0, POSIX_FADV_SEQUENTIAL);
+  std::size_t buffer_size = (std::max)(options.buffer_size, std::size_t(4096));
+  std::unique_ptr<unsigned char[]> buffer(new unsigned char[buffer_size]);
+  std::uint64_t interval = (std::max)(options.interval, std::uint64_t(1));
+  // At the first read past each multiple of the interval
+  std::uint64_t next_checkpoint = (offset / interval + 1) * interval;
+  for (;;)
+  {
+    ssize_t num = ::pread(fd, buffer.get(), buffer_size, static_cast<off_t>(offset));
+    if (num < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      result.error = errno;
+      break;
+    }
+    if (num == 0)
+    {
+      break;
+    }
+    engine.add_bytes(buffer.get(), static_cast<std::size_t>(num));
+    offset += static_cast<std::uint64_t>(num);
+    if (offset >= next_checkpoint)
+    {
+      if (!save_checkpoint(checkpoint_path, {key, engine.save_state()}))
+      {
+        result.error = errno;
+        break;
+      }
+      ++result.checkpoints;
+      next_checkpoint = (offset / interval + 1) * interval;
+    }
+  }
+  ::close(fd);
+  if (result.error == 0)
+  {
+    result.digest = engine.digest();
+    result.bytes = offset;
+    ::unlink(checkpoint_path.c_str());
+  }
+  return result;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// Hashing of files large enough that a crash or preemption while hashing
+// them is likely. The intermediate state is saved to a checkpoint file every
+// so often, and hashing starts over from the last checkpoint as long as the
+// file looks unchanged.
+
+#include "digest_cache.h"
+#include "file_hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+struct hash_checkpoint
+{
+  // The file when hashing started
+  file_key file;
+  // Covers the first state.bytes bytes of the file
+  sha256_state state = {};
+};
+
+// Writes a temporary file next to path, syncs it and renames it over path, so
+// path always holds a complete checkpoint. false with errno set on failure.
+bool save_checkpoint(const std::string &path, const hash_checkpoint &checkpoint);
+// std::nullopt if path is missing, damaged or from another format version
+std::optional<hash_checkpoint> load_checkpoint(const std::string &path);
+
+struct resumable_hash_options
+{
+  // Bytes hashed between checkpoints
+  std::uint64_t interval = std::uint64_t(1) << 30;
+  std::size_t buffer_size = std::size_t(1) << 20;
+};
+
+struct resumable_hash_result : file_hash_result
+{
+  // Offset hashing resumed at, 0 if it started from the beginning
+  std::uint64_t resumed_from = 0;
+  // Checkpoints saved by this call
+  std::uint64_t checkpoints = 0;
+};
+
+// Hashes a regular file with a backend that has sha256_midstate (ENOTSUP
+// otherwise), resuming from checkpoint_path if its device, inode, size and
+// timestamps still match the file. The checkpoint is removed once the digest
+// is computed; failing to save one fails the call.
+resumable_hash_result hash_resumable(const sha256_backend &backend, const char *path,
+                                     const std::string &checkpoint_path,
+                                     const resumable_hash_options &options = {});
@@ -0,0 +1,161 @@
+#include "run_context.h"
+
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <hwloc.h>
+#include <openssl/crypto.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace
+{
+
+std::string readFirstLine(const char *path)
+{
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Value of the first "key : value" line in /proc/cpuinfo
+std::string readCpuInfo(const std::string &key)
+{
+  std::ifstream file("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.compare(0, key.size(), key) != 0)
+    {
+      continue;
+    }
+    auto colon = line.find(':');
+    if (colon == std::string::npos)
+    {
+      continue;
+    }
+    auto begin = line.find_first_not_of(" \t", colon + 1);
+    return begin == std::string::npos ? std::string() : line.substr(begin);
+  }
+  return {};
+}
+
+std::string cpuFlags()
+{
+  std::string flags;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  unsigned int leaf1_ecx = 0, leaf1_edx = 0, leaf7_ebx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    leaf1_ecx = ecx;
+    leaf1_edx = edx;
+  }
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+  {
+    leaf7_ebx = ebx;
+  }
+  const std::vector<std::pair<const char *, bool>> features = {
+      {"sse2", leaf1_edx & bit_SSE2},
+      {"ssse3", leaf1_ecx & bit_SSSE3},
+      {"sse4_1", leaf1_ecx & bit_SSE4_1},
+      {"sse4_2", leaf1_ecx & bit_SSE4_2},
+      {"avx", leaf1_ecx & bit_AVX},
+      {"avx2", leaf7_ebx & bit_AVX2},
+      {"bmi2", leaf7_ebx & bit_BMI2},
+      {"avx512f", leaf7_ebx & bit_AVX512F},
+      {"sha_ni", leaf7_ebx & bit_SHA},
+  };
+  for (const auto &[name, present] : features)
+  {
+    if (present)
+    {
+      flags += flags.empty() ? name : std::string(" ") + name;
+    }
+  }
+#endif
+  return flags;
+}
+
+std::string compilerVersion()
+{
+#if defined(__clang__)
+  return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+  return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+  return "msvc " + std::to_string(_MSC_FULL_VER);
+#else
+  return "unknown";
+#endif
+}
+
+void addTopologyContext()
+{
+  hwloc_topology_t topology;
+  if (hwloc_topology_init(&topology) != 0)
+  {
+    return;
+  }
+  if (hwloc_topology_load(topology) == 0)
+  {
+    int cores = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_CORE);
+    int pus = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PU);
+    int packages = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PACKAGE);
+    int numa_nodes = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_NUMANODE);
+    benchmark::AddCustomContext("hwloc_packages", std::to_string(packages));
+    benchmark::AddCustomContext("hwloc_cores", std::to_string(cores));
+    benchmark::AddCustomContext("hwloc_pus", std::to_string(pus));
+    benchmark::AddCustomContext("hwloc_numa_nodes", std::to_string(numa_nodes));
+    benchmark::AddCustomContext("smt", cores > 0 && pus > cores ? "on" : "off");
+
+    hwloc_obj_t package = hwloc_get_obj_by_type(topology, HWLOC_OBJ_PACKAGE, 0);
+    const char *model =
+        package ? hwloc_obj_get_info_by_name(package, "CPUModel") : nullptr;
+    if (model)
+    {
+      benchmark::AddCustomContext("cpu_model", model);
+    }
+  }
+  hwloc_topology_destroy(topology);
+}
+
+} // namespace
+
+void addRunContext()
+{
+  addTopologyContext();
+  benchmark::AddCustomContext("cpu_flags", cpuFlags());
+
+  std::string microcode = readCpuInfo("microcode");
+  if (!microcode.empty())
+  {
+    benchmark::AddCustomContext("cpu_microcode", microcode);
+  }
+  std::string governor =
+      readFirstLine("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+  if (!governor.empty())
+  {
+    benchmark::AddCustomContext("cpu_governor", governor);
+  }
+  std::string smt_active = readFirstLine("/sys/devices/system/cpu/smt/active");
+  if (!smt_active.empty())
+  {
+    benchmark::AddCustomContext("smt_active", smt_active);
+  }
+
+  benchmark::AddCustomContext("compiler", compilerVersion());
+  benchmark::AddCustomContext("openssl_version", OpenSSL_version(OPENSSL_VERSION));
+  unsigned hwloc_version = hwloc_get_api_version();
+  benchmark::AddCustomContext("hwloc_api_version",
+                              std::to_string(hwloc_version >> 16) + "." +
+                                  std::to_string((hwloc_version >> 8) & 0xff) + "." +
+                                  std::to_string(hwloc_version & 0xff));
+}
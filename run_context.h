@@ -0,0 +1,6 @@
+#pragma once
+
+// Adds machine and build information (CPU model and flags, microcode,
+// frequency governor, SMT state, compiler, library versions) to the
+// benchmark output via benchmark::AddCustomContext.
+void addRunContext();
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "sha256_hasher.h"
+
+#include <array>
+#include <cassert>
+#include <span>
+
+using sha256_digest = std::array<unsigned char, 32>;
+using sha256_input = std::span<const unsigned char>;
+
+// Hash inputs[i] into out[i]. One hasher is reset between the messages, which
+// amortizes e.g. the EVP_MD_CTX of the OpenSSL wrappers. Wrappers with a
+// faster path provide a hash_many member.
+template <Sha256Hasher T>
+void hash_many(T &hasher, std::span<const sha256_input> inputs,
+               std::span<sha256_digest> out)
+{
+  assert(out.size() >= inputs.size());
+  if constexpr (requires { hasher.hash_many(inputs, out); })
+  {
+    hasher.hash_many(inputs, out);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+      hasher.reset();
+      hasher.add_bytes(inputs[i].data(), inputs[i].size());
+      out[i] = hasher.digest();
+    }
+  }
+}
+
+template <Sha256Hasher T>
+void hash_many(std::span<const sha256_input> inputs, std::span<sha256_digest> out)
+{
+  T hasher;
+  hash_many(hasher, inputs, out);
+}
+
+// out[i] = SHA256(SHA256(inputs[i])). Wrappers with a faster path provide a
+// double_hash_many member.
+template <Sha256Hasher T>
+void double_hash_many(T &hasher, std::span<const sha256_input> inputs,
+                      std::span<sha256_digest> out)
+{
+  assert(out.size() >= inputs.size());
+  if constexpr (requires { hasher.double_hash_many(inputs, out); })
+  {
+    hasher.double_hash_many(inputs, out);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+      hasher.reset();
+      hasher.add_bytes(inputs[i].data(), inputs[i].size());
+      auto first = hasher.digest();
+      hasher.reset();
+      hasher.add_bytes(first.data(), first.size());
+      out[i] = hasher.digest();
+    }
+  }
+}
+
+template <Sha256Hasher T>
+void double_hash_many(std::span<const sha256_input> inputs,
+                      std::span<sha256_digest> out)
+{
+  T hasher;
+  double_hash_many(hasher, inputs, out);
+}
@@ -0,0 +1,120 @@
+// Local SHA-256 daemon serving hash_client connections over a Unix socket.
+//
+// Usage: sha256_daemon [--socket=PATH] [--backend=NAME] [--max-batch=N] [--stats]
+
+#include "hash_service.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+namespace
+{
+hash_server *running_server = nullptr;
+
+void handle_signal(int)
+{
+  if (running_server)
+  {
+    running_server->stop();
+  }
+}
+
+// Matches "--name=value"
+bool option_value(const char *arg, const char *name, std::string &value)
+{
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, "--", 2) == 0 && std::strncmp(arg + 2, name, length) == 0 &&
+      arg[2 + length] == '=')
+  {
+    value = arg + 3 + length;
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::string socket_path = default_hash_socket_path();
+  std::string backend_name;
+  std::size_t max_batch = 256;
+  bool stats = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string value;
+    if (option_value(argv[i], "socket", value))
+    {
+      socket_path = value;
+    }
+    else if (option_value(argv[i], "backend", value))
+    {
+      backend_name = value;
+    }
+    else if (option_value(argv[i], "max-batch", value))
+    {
+      max_batch = static_cast<std::size_t>(std::strtoull(value.c_str(), nullptr, 10));
+    }
+    else if (std::strcmp(argv[i], "--stats") == 0)
+    {
+      stats = true;
+    }
+    else
+    {
+      std::fprintf(stderr,
+                   "Usage: %s [--socket=PATH] [--backend=NAME] [--max-batch=N] [--stats]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  const sha256_backend *backend = nullptr;
+  if (backend_name.empty())
+  {
+    // Has the multi-lane SHA256D64 kernels
+    backend = find_sha256_backend("bitcoin");
+    if (!backend)
+    {
+      backend = find_sha256_backend("openssl_deprecated");
+    }
+  }
+  else
+  {
+    backend = find_sha256_backend(backend_name);
+  }
+  if (!backend || !backend->has(sha256_incremental))
+  {
+    std::fprintf(stderr, "Unknown or non-incremental backend '%s'\n", backend_name.c_str());
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    hash_server server(socket_path, *backend, max_batch);
+    running_server = &server;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+    std::fprintf(stderr, "Serving %s on %s\n", std::string(backend->name).c_str(),
+                 socket_path.c_str());
+    server.run();
+    running_server = nullptr;
+    if (stats)
+    {
+      auto s = server.stats();
+      std::fprintf(stderr, "%llu requests in %llu batches (%.1f per batch), %llu bytes\n",
+                   static_cast<unsigned long long>(s.requests),
+                   static_cast<unsigned long long>(s.batches),
+                   s.batches ? static_cast<double>(s.requests) / s.batches : 0.0,
+                   static_cast<unsigned long long>(s.bytes));
+    }
+  }
+  catch (const std::system_error &e)
+  {
+    std::fprintf(stderr, "%s: %s\n", socket_path.c_str(), e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
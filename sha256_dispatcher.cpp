@@ -0,0 +1,268 @@
+#include "sha256_dispatcher.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace
+{
+constexpr const char *profile_header = "sha256-comparison tuning profile v1";
+
+// Best throughput of a few short rounds, in bytes per second
+double measure(const sha256_backend &backend, const unsigned char *data,
+               std::size_t size)
+{
+  using clock = std::chrono::steady_clock;
+  constexpr auto round_time = std::chrono::milliseconds(2);
+  constexpr int rounds = 3;
+
+  double best = 0.0;
+  std::array<unsigned char, 32> sink = {};
+  for (int round = 0; round < rounds; ++round)
+  {
+    std::size_t iterations = 0;
+    auto begin = clock::now();
+    auto now = begin;
+    do
+    {
+      auto engine = backend.create();
+      engine.add_bytes(data, size);
+      auto digest = engine.digest();
+      sink[iterations % sink.size()] ^= digest[0];
+      ++iterations;
+      now = clock::now();
+    } while (now - begin < round_time);
+    std::chrono::duration<double> elapsed = now - begin;
+    best = (std::max)(best, static_cast<double>(iterations * size) / elapsed.count());
+  }
+  volatile unsigned char keep = sink[0];
+  (void)keep;
+  return best;
+}
+
+std::string default_profile_path()
+{
+  if (const char *path = std::getenv("SHA256_TUNING_PROFILE"))
+  {
+    return path;
+  }
+  std::filesystem::path dir;
+  if (const char *cache = std::getenv("XDG_CACHE_HOME"))
+  {
+    dir = cache;
+  }
+  else if (const char *home = std::getenv("HOME"))
+  {
+    dir = std::filesystem::path(home) / ".cache";
+  }
+  else if (const char *local = std::getenv("LOCALAPPDATA"))
+  {
+    dir = local;
+  }
+  else
+  {
+    return {};
+  }
+  return (dir / "sha256-comparison" / "tuning_profile.txt").string();
+}
+} // namespace
+
+sha256_dispatcher::sha256_dispatcher(std::vector<entry> table)
+    : crossovers(std::move(table))
+{
+}
+
+const std::string &sha256_dispatcher::cpu_key()
+{
+  static const std::string key = []()
+  {
+    std::ostringstream out;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int regs[12] = {};
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+      __get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1],
+                  &regs[4 * i + 2], &regs[4 * i + 3]);
+    }
+    char brand[sizeof(regs) + 1] = {};
+    std::memcpy(brand, regs, sizeof(regs));
+    std::string model(brand);
+    model.erase(0, model.find_first_not_of(' '));
+
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    unsigned int leaf1_ecx = 0, leaf7_ebx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+      leaf1_ecx = ecx;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+      leaf7_ebx = ebx;
+    }
+    out << model << " [" << std::hex << leaf1_ecx << ":" << leaf7_ebx << "]";
+#else
+    out << "unknown";
+#endif
+    return out.str();
+  }();
+  return key;
+}
+
+sha256_dispatcher sha256_dispatcher::calibrate()
+{
+  // Reproducibly random bytes, as in the benchmark fixture
+  std::vector<unsigned char> data(calibration_sizes.back());
+  std::mt19937_64 gen;
+  for (auto &byte : data)
+  {
+    byte = static_cast<unsigned char>(gen());
+  }
+
+  std::vector<entry> table;
+  for (std::size_t size : calibration_sizes)
+  {
+    const sha256_backend *fastest = nullptr;
+    double fastest_rate = 0.0;
+    for (const auto &backend : sha256_backends())
+    {
+      if (!backend.has(sha256_incremental))
+      {
+        continue;
+      }
+      double rate = measure(backend, data.data(), size);
+      if (rate > fastest_rate)
+      {
+        fastest_rate = rate;
+        fastest = &backend;
+      }
+    }
+    assert(fastest);
+    if (!table.empty() && table.back().backend == fastest)
+    {
+      table.back().max_size = size;
+    }
+    else
+    {
+      table.push_back({size, fastest});
+    }
+  }
+  return sha256_dispatcher(std::move(table));
+}
+
+std::optional<sha256_dispatcher> sha256_dispatcher::load(const std::string &path)
+{
+  std::ifstream file(path);
+  std::string line;
+  if (!std::getline(file, line) || line != profile_header)
+  {
+    return std::nullopt;
+  }
+  if (!std::getline(file, line) || line != "cpu " + cpu_key())
+  {
+    return std::nullopt;
+  }
+  std::vector<entry> table;
+  std::size_t max_size;
+  std::string name;
+  while (file >> max_size >> name)
+  {
+    const sha256_backend *backend = find_sha256_backend(name);
+    if (!backend || !backend->has(sha256_incremental))
+    {
+      return std::nullopt;
+    }
+    table.push_back({max_size, backend});
+  }
+  if (table.empty())
+  {
+    return std::nullopt;
+  }
+  return sha256_dispatcher(std::move(table));
+}
+
+bool sha256_dispatcher::save(const std::string &path) const
+{
+  std::error_code ec;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+  {
+    std::filesystem::create_directories(parent, ec);
+  }
+  // Written next to the profile and renamed over it, so an interrupted write
+  // never leaves a partial table behind. The suffix keeps processes that
+  // calibrate at the same time apart.
+  std::string temp_path = path + ".tmp" + std::to_string(std::random_device()());
+  {
+    std::ofstream file(temp_path, std::ios::trunc);
+    file << profile_header << "\n"
+         << "cpu " << cpu_key() << "\n";
+    for (const auto &e : crossovers)
+    {
+      file << e.max_size << " " << e.backend->name << "\n";
+    }
+    file.close();
+    if (!file)
+    {
+      std::filesystem::remove(temp_path, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec)
+  {
+    std::filesystem::remove(temp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+sha256_dispatcher &default_sha256_dispatcher()
+{
+  static sha256_dispatcher dispatcher = []()
+  {
+    std::string path = default_profile_path();
+    auto loaded = path.empty() ? std::nullopt : sha256_dispatcher::load(path);
+    if (loaded)
+    {
+      return std::move(*loaded);
+    }
+    auto calibrated = sha256_dispatcher::calibrate();
+    if (!path.empty())
+    {
+      calibrated.save(path);
+    }
+    return calibrated;
+  }();
+  static const bool forced = []()
+  {
+    if (const char *name = std::getenv("SHA256_BACKEND"))
+    {
+      // A typo must not silently change the dispatch
+      const sha256_backend *backend = find_sha256_backend(name);
+      if (!backend)
+      {
+        std::fprintf(stderr, "SHA256_BACKEND: unknown backend '%s', keeping the tuned choice\n",
+                     name);
+      }
+      else if (!dispatcher.force(backend))
+      {
+        std::fprintf(stderr,
+                     "SHA256_BACKEND: backend '%s' is not incremental, keeping the tuned choice\n",
+                     name);
+      }
+    }
+    return true;
+  }();
+  (void)forced;
+  return dispatcher;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "sha256_engine.h"
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Routes each hash to the backend that was measured to be fastest for its
+// message size. The size-to-backend table comes from a short calibration run
+// and can be persisted to a profile file keyed by the CPU model and flags.
+class sha256_dispatcher
+{
+public:
+  struct entry
+  {
+    // Messages of up to max_size bytes use backend
+    std::size_t max_size;
+    const sha256_backend *backend;
+  };
+
+  // Sizes at which the backends are compared
+  static constexpr std::array<std::size_t, 7> calibration_sizes = {
+      64, 256, 1024, 4096, 16384, 65536, 262144};
+
+  // Time every incremental backend at each calibration size. sha256_auto feeds
+  // the selected backend message pieces, so one-shot backends are left out.
+  static sha256_dispatcher calibrate();
+
+  // nullopt if the file is missing, malformed, written for a different CPU or
+  // names a backend that is not part of this build or not incremental
+  static std::optional<sha256_dispatcher> load(const std::string &path);
+  bool save(const std::string &path) const;
+
+  // Identifies the CPU model and relevant instruction set extensions
+  static const std::string &cpu_key();
+
+  const sha256_backend &select(std::size_t size) const
+  {
+    if (forced)
+    {
+      return *forced;
+    }
+    for (const auto &e : crossovers)
+    {
+      if (size <= e.max_size)
+      {
+        return *e.backend;
+      }
+    }
+    return *crossovers.back().backend;
+  }
+
+  std::array<unsigned char, 32> hash(const unsigned char *bytes,
+                                     std::size_t num) const
+  {
+    auto engine = select(num).create();
+    engine.add_bytes(bytes, num);
+    return engine.digest();
+  }
+
+  // Route every message to one backend, e.g. for deterministic benchmarks.
+  // nullptr restores size based selection. Backends that are not incremental
+  // are refused and false is returned. Not safe to call concurrently with
+  // hashing.
+  bool force(const sha256_backend *backend)
+  {
+    if (backend && !backend->has(sha256_incremental))
+    {
+      return false;
+    }
+    forced = backend;
+    return true;
+  }
+
+  // Consecutive size classes with the same backend are merged
+  std::span<const entry> table() const { return crossovers; }
+
+private:
+  explicit sha256_dispatcher(std::vector<entry> table);
+
+  std::vector<entry> crossovers;
+  const sha256_backend *forced = nullptr;
+};
+
+// Process-wide dispatcher. The profile is read from SHA256_TUNING_PROFILE or a
+// file in the user's cache directory; if it does not match, the dispatcher is
+// calibrated on first use and the profile is written. Setting SHA256_BACKEND to
+// a backend name forces that backend; unknown names and backends that are not
+// incremental are reported on stderr and ignored.
+sha256_dispatcher &default_sha256_dispatcher();
+
+// Hasher protocol on top of the default dispatcher. The backend is chosen by
+// the size of the first add_bytes call.
+struct sha256_auto
+{
+  std::optional<sha256_engine> engine;
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    if (!engine)
+    {
+      engine.emplace(default_sha256_dispatcher().select(num).create());
+    }
+    engine->add_bytes(bytes, num);
+  }
+  std::array<unsigned char, 32> digest()
+  {
+    if (!engine)
+    {
+      engine.emplace(default_sha256_dispatcher().select(0).create());
+    }
+    return engine->digest();
+  }
+  // The next message selects its backend again
+  void reset() { engine.reset(); }
+};
@@ -0,0 +1,60 @@
+#include "sha256_engine.h"
+
+namespace
+{
+template <Sha256Hasher T>
+sha256_engine create_engine()
+{
+  return sha256_engine::create<T>();
+}
+
+constexpr unsigned streaming = sha256_incremental | sha256_one_shot;
+
+const sha256_backend backends[] = {
+#ifdef BITCOIN_IMPL
+    {"bitcoin", streaming | sha256_batch | sha256_midstate, create_engine<sha256_bitcoin>},
+#endif
+    {"openssl_deprecated", streaming, create_engine<sha256_openssl_deprecated>},
+    {"openssl_oneshot", sha256_one_shot, create_engine<sha256_openssl_oneshot>},
+    {"openssl_global", streaming | sha256_batch, create_engine<sha256_openssl_global>},
+    {"openssl", streaming | sha256_batch, create_engine<sha256_openssl>},
+    {"openssl_pooled", streaming | sha256_batch, create_engine<sha256_openssl_pooled>},
+#ifdef USE_NSS
+    {"libnss", streaming, create_engine<sha256_libnss>},
+#endif
+#ifdef _WIN32
+    {"bcrypt", streaming, create_engine<sha256_bcrypt>},
+#endif
+    {"zedwood", streaming, create_engine<sha256_zedwood>},
+};
+
+void initialize_backends()
+{
+  if (!global_md)
+  {
+    global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
+  }
+#ifdef BITCOIN_IMPL
+  SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif
+}
+} // namespace
+
+std::span<const sha256_backend> sha256_backends()
+{
+  static const bool initialized = (initialize_backends(), true);
+  (void)initialized;
+  return backends;
+}
+
+const sha256_backend *find_sha256_backend(std::string_view name)
+{
+  for (const auto &backend : sha256_backends())
+  {
+    if (backend.name == name)
+    {
+      return &backend;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "sha256_batch.h"
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+enum sha256_capability : unsigned
+{
+  // add_bytes may be called repeatedly before digest()
+  sha256_incremental = 1 << 0,
+  // A complete message can be hashed with a single add_bytes call
+  sha256_one_shot = 1 << 1,
+  // hash_many is faster than hashing the messages one by one
+  sha256_batch = 1 << 2,
+  // The intermediate state can be exported and restored
+  sha256_midstate = 1 << 3,
+};
+
+struct sha256_engine_vtable
+{
+  void (*add_bytes)(void *, const unsigned char *, std::size_t);
+  std::array<unsigned char, 32> (*digest)(void *);
+  void (*reset)(void *);
+  void (*add_iovec)(void *, const struct iovec *, std::size_t);
+  void (*hash_many)(void *, std::span<const sha256_input>, std::span<sha256_digest>);
+  void (*double_hash_many)(void *, std::span<const sha256_input>,
+                           std::span<sha256_digest>);
+  // nullptr unless the hasher is Sha256Resumable
+  sha256_state (*save_state)(const void *);
+  void (*load_state)(void *, const sha256_state &);
+  void (*move_construct)(void *, void *);
+  void (*destroy)(void *);
+};
+
+template <Sha256Hasher T>
+constexpr sha256_state (*sha256_save_state_for())(const void *)
+{
+  if constexpr (Sha256Resumable<T>)
+  {
+    return [](const void *obj) { return static_cast<const T *>(obj)->save_state(); };
+  }
+  return nullptr;
+}
+
+template <Sha256Hasher T>
+constexpr void (*sha256_load_state_for())(void *, const sha256_state &)
+{
+  if constexpr (Sha256Resumable<T>)
+  {
+    return [](void *obj, const sha256_state &state)
+    { static_cast<T *>(obj)->load_state(state); };
+  }
+  return nullptr;
+}
+
+template <Sha256Hasher T>
+inline constexpr sha256_engine_vtable sha256_engine_vtable_for = {
+    [](void *obj, const unsigned char *bytes, std::size_t num)
+    { static_cast<T *>(obj)->add_bytes(bytes, num); },
+    [](void *obj) { return static_cast<T *>(obj)->digest(); },
+    [](void *obj) { static_cast<T *>(obj)->reset(); },
+    [](void *obj, const struct iovec *iov, std::size_t iovcnt)
+    { ::add_iovec(*static_cast<T *>(obj), iov, iovcnt); },
+    [](void *obj, std::span<const sha256_input> inputs, std::span<sha256_digest> out)
+    { ::hash_many(*static_cast<T *>(obj), inputs, out); },
+    [](void *obj, std::span<const sha256_input> inputs, std::span<sha256_digest> out)
+    { ::double_hash_many(*static_cast<T *>(obj), inputs, out); },
+    sha256_save_state_for<T>(),
+    sha256_load_state_for<T>(),
+    [](void *dst, void *src)
+    { ::new (dst) T(std::move(*static_cast<T *>(src))); },
+    [](void *obj) { static_cast<T *>(obj)->~T(); },
+};
+
+// Type-erased hasher. The wrapped object lives in inline storage, so creating
+// an engine never allocates by itself, and every call costs one indirect call.
+class sha256_engine
+{
+public:
+  static constexpr std::size_t storage_size = 256;
+
+  template <Sha256Hasher T>
+  static sha256_engine create()
+  {
+    static_assert(sizeof(T) <= storage_size, "Increase storage_size");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "Overaligned hasher");
+    sha256_engine engine;
+    ::new (static_cast<void *>(engine.storage)) T();
+    engine.vtable = &sha256_engine_vtable_for<T>;
+    return engine;
+  }
+
+  sha256_engine(sha256_engine &&other) noexcept : vtable(other.vtable)
+  {
+    if (vtable)
+    {
+      vtable->move_construct(storage, other.storage);
+    }
+  }
+  sha256_engine &operator=(sha256_engine &&other) noexcept
+  {
+    if (this != &other)
+    {
+      reset_storage();
+      vtable = other.vtable;
+      if (vtable)
+      {
+        vtable->move_construct(storage, other.storage);
+      }
+    }
+    return *this;
+  }
+  sha256_engine(const sha256_engine &) = delete;
+  sha256_engine &operator=(const sha256_engine &) = delete;
+  ~sha256_engine() { reset_storage(); }
+
+  void add_bytes(const unsigned char *bytes, std::size_t num)
+  {
+    vtable->add_bytes(storage, bytes, num);
+  }
+  std::array<unsigned char, 32> digest() { return vtable->digest(storage); }
+  // Start a new message, reusing the backend's resources
+  void reset() { vtable->reset(storage); }
+  void add_iovec(const struct iovec *iov, std::size_t iovcnt)
+  {
+    vtable->add_iovec(storage, iov, iovcnt);
+  }
+  void hash_many(std::span<const sha256_input> inputs, std::span<sha256_digest> out)
+  {
+    vtable->hash_many(storage, inputs, out);
+  }
+  void double_hash_many(std::span<const sha256_input> inputs,
+                        std::span<sha256_digest> out)
+  {
+    vtable->double_hash_many(storage, inputs, out);
+  }
+  // Only for backends with sha256_midstate
+  sha256_state save_state() const { return vtable->save_state(storage); }
+  void load_state(const sha256_state &state) { vtable->load_state(storage, state); }
+
+private:
+  sha256_engine() = default;
+
+  void reset_storage()
+  {
+    if (vtable)
+    {
+      vtable->destroy(storage);
+      vtable = nullptr;
+    }
+  }
+
+  const sha256_engine_vtable *vtable = nullptr;
+  alignas(std::max_align_t) unsigned char storage[storage_size];
+};
+
+struct sha256_backend
+{
+  std::string_view name;
+  unsigned capabilities;
+  sha256_engine (*create)();
+
+  bool has(sha256_capability capability) const
+  {
+    return (capabilities & capability) != 0;
+  }
+};
+
+// All backends compiled into this build. The first call performs the one-time
+// initialization the backends need (CPU feature detection, global fetches).
+std::span<const sha256_backend> sha256_backends();
+
+// nullptr if no backend with this name is available
+const sha256_backend *find_sha256_backend(std::string_view name);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "algorithm_wrappers.h"
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef SHA256_IOVEC_DEFINED
+#define SHA256_IOVEC_DEFINED
+// Scatter/gather buffer as declared in POSIX <sys/uio.h>
+struct iovec
+{
+  void *iov_base;
+  std::size_t iov_len;
+};
+#endif
+#else
+#include <sys/uio.h>
+#endif
+
+// The protocol shared by all wrappers in algorithm_wrappers.h
+template <typename T>
+concept Sha256Hasher =
+    std::default_initializable<T> &&
+    requires(T hasher, const unsigned char *bytes, std::size_t num) {
+      hasher.add_bytes(bytes, num);
+      { hasher.digest() } -> std::same_as<std::array<unsigned char, 32>>;
+      hasher.reset();
+    };
+
+static_assert(Sha256Hasher<sha256_zedwood>);
+static_assert(Sha256Hasher<sha256_openssl_deprecated>);
+static_assert(Sha256Hasher<sha256_openssl>);
+static_assert(Sha256Hasher<sha256_openssl_global>);
+static_assert(Sha256Hasher<sha256_openssl_pooled>);
+static_assert(Sha256Hasher<sha256_openssl_oneshot>);
+#ifdef BITCOIN_IMPL
+static_assert(Sha256Hasher<sha256_bitcoin>);
+#endif
+#ifdef _WIN32
+static_assert(Sha256Hasher<sha256_bcrypt>);
+#endif
+#ifdef USE_NSS
+static_assert(Sha256Hasher<sha256_libnss>);
+#endif
+#ifdef SHA256_AFALG
+static_assert(Sha256Hasher<sha256_afalg>);
+#endif
+
+// Wrappers whose intermediate state can be exported and restored, e.g. to
+// resume hashing a long stream after a restart
+template <typename T>
+concept Sha256Resumable =
+    Sha256Hasher<T> && requires(T hasher, const T &saved, const sha256_state &state) {
+      { saved.save_state() } -> std::same_as<sha256_state>;
+      hasher.load_state(state);
+    };
+
+static_assert(Sha256Resumable<sha256_zedwood>);
+#ifdef BITCOIN_IMPL
+static_assert(Sha256Resumable<sha256_bitcoin>);
+#endif
+
+// Feed a chain of fragments as if they were one contiguous buffer. Wrappers
+// that can do better than one add_bytes per fragment provide an add_iovec
+// member.
+template <Sha256Hasher T>
+void add_iovec(T &hasher, const struct iovec *iov, std::size_t iovcnt)
+{
+  if constexpr (requires { hasher.add_iovec(iov, iovcnt); })
+  {
+    hasher.add_iovec(iov, iovcnt);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < iovcnt; ++i)
+    {
+      hasher.add_bytes(static_cast<const unsigned char *>(iov[i].iov_base),
+                       iov[i].iov_len);
+    }
+  }
+}
@@ -0,0 +1,97 @@
+// TCP ingest server hashing length-prefixed streams, see ingest_server.h.
+//
+// Usage: sha256_ingest [--address=IPV4] [--port=N] [--threads=N] [--stats]
+
+#include "ingest_server.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+namespace
+{
+ingest_server *running_server = nullptr;
+
+void handle_signal(int)
+{
+  if (running_server)
+  {
+    running_server->stop();
+  }
+}
+
+// Matches "--name=value"
+bool option_value(const char *arg, const char *name, std::string &value)
+{
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, "--", 2) == 0 && std::strncmp(arg + 2, name, length) == 0 &&
+      arg[2 + length] == '=')
+  {
+    value = arg + 3 + length;
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+  ingest_options options;
+  options.port = 7878;
+  bool stats = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string value;
+    if (option_value(argv[i], "address", value))
+    {
+      options.address = value;
+    }
+    else if (option_value(argv[i], "port", value))
+    {
+      options.port = static_cast<std::uint16_t>(std::atoi(value.c_str()));
+    }
+    else if (option_value(argv[i], "threads", value))
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+    else if (std::strcmp(argv[i], "--stats") == 0)
+    {
+      stats = true;
+    }
+    else
+    {
+      std::fprintf(stderr, "Usage: %s [--address=IPV4] [--port=N] [--threads=N] [--stats]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  try
+  {
+    ingest_server server(options);
+    running_server = &server;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+    std::fprintf(stderr, "Listening on %s:%u, %zu bytes per connection\n",
+                 options.address.c_str(), server.port(), ingest_server::connection_bytes());
+    server.run();
+    running_server = nullptr;
+    if (stats)
+    {
+      auto s = server.stats();
+      std::fprintf(stderr, "%llu streams, %llu bytes, peak %llu connections\n",
+                   static_cast<unsigned long long>(s.streams),
+                   static_cast<unsigned long long>(s.bytes),
+                   static_cast<unsigned long long>(s.peak_connections));
+    }
+  }
+  catch (const std::system_error &e)
+  {
+    std::fprintf(stderr, "%s: %s\n", options.address.c_str(), e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
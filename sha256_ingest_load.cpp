@@ -0,0 +1,410 @@
+// Load generator for ingest_server. Opens --connections sockets from a single
+// epoll loop and streams --size byte payloads over each of them back to back.
+// Without --connect an in-process server on a free loopback port is used,
+// which also allows measuring the memory taken per connection.
+//
+// Usage: sha256_ingest_load [--connect=IPV4:PORT] [--connections=N] [--size=BYTES]
+//                           [--seconds=S] [--threads=N]
+
+#include "ingest_server.h"
+
+#include "bitcoin/sha256.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+
+struct load_options
+{
+  std::optional<std::string> connect;
+  int connections = 1000;
+  std::size_t size = std::size_t(1) << 20;
+  double seconds = 2.0;
+  int threads = 1;
+};
+
+using clock_type = std::chrono::steady_clock;
+constexpr std::size_t header_size = sizeof(std::uint64_t);
+
+struct stream_state
+{
+  int fd = -1;
+  // Bytes of header and payload sent for the current stream
+  std::size_t sent = 0;
+  std::size_t digest_bytes = 0;
+  bool active = false;
+  clock_type::time_point last_byte;
+  std::array<unsigned char, CSHA256::OUTPUT_SIZE> digest;
+};
+
+struct load_result
+{
+  std::uint64_t streams = 0;
+  std::uint64_t mismatches = 0;
+  std::vector<double> latencies_us;
+};
+
+[[noreturn]] void throw_errno(const char *what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::size_t resident_bytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// Every connection needs one descriptor, two with the in-process server
+void raise_fd_limit()
+{
+  rlimit limit = {};
+  if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+int open_connection(const sockaddr_in &addr)
+{
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    throw_errno("socket");
+  }
+  if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0)
+  {
+    int error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(), "connect");
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int flags = ::fcntl(fd, F_GETFL);
+  ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  return fd;
+}
+
+class load_generator
+{
+public:
+  load_generator(const load_options &options, const sockaddr_in &addr)
+      : options(options), payload(options.size), streams(static_cast<std::size_t>(options.connections))
+  {
+    std::mt19937_64 gen(0);
+    for (auto &byte : payload)
+    {
+      byte = static_cast<unsigned char>(gen());
+    }
+    std::uint64_t length = options.size;
+    for (std::size_t i = 0; i < header_size; ++i)
+    {
+      header[i] = static_cast<unsigned char>(length >> (8 * i));
+    }
+    CSHA256().Write(payload.data(), payload.size()).Finalize(expected.data());
+
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+      throw_errno("epoll_create1");
+    }
+    for (auto &stream : streams)
+    {
+      stream.fd = open_connection(addr);
+      epoll_event event = {EPOLLIN | EPOLLOUT | EPOLLET, {.ptr = &stream}};
+      if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream.fd, &event) != 0)
+      {
+        throw_errno("epoll_ctl");
+      }
+    }
+  }
+
+  ~load_generator()
+  {
+    for (auto &stream : streams)
+    {
+      if (stream.fd >= 0)
+      {
+        ::close(stream.fd);
+      }
+    }
+    if (epoll_fd >= 0)
+    {
+      ::close(epoll_fd);
+    }
+  }
+
+  load_result run()
+  {
+    load_result result;
+    result.latencies_us.reserve(1 << 20);
+    deadline = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(
+                                         std::chrono::duration<double>(options.seconds));
+    std::size_t active = streams.size();
+    for (auto &stream : streams)
+    {
+      stream.active = true;
+    }
+    std::vector<epoll_event> events(256);
+    while (active > 0)
+    {
+      int count = ::epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 1000);
+      if (count < 0 && errno != EINTR)
+      {
+        throw_errno("epoll_wait");
+      }
+      if (count == 0)
+      {
+        throw std::system_error(ETIMEDOUT, std::generic_category(), "server stopped responding");
+      }
+      for (int i = 0; i < count; ++i)
+      {
+        auto &stream = *static_cast<stream_state *>(events[static_cast<std::size_t>(i)].data.ptr);
+        if (stream.active && !progress(stream, result))
+        {
+          stream.active = false;
+          --active;
+        }
+      }
+    }
+    return result;
+  }
+
+private:
+  // Sends and receives as far as the socket allows, false once done
+  bool progress(stream_state &stream, load_result &result)
+  {
+    const std::size_t total = header_size + payload.size();
+    for (;;)
+    {
+      while (stream.sent < total)
+      {
+        const unsigned char *data = stream.sent < header_size
+                                        ? header + stream.sent
+                                        : payload.data() + (stream.sent - header_size);
+        std::size_t length = stream.sent < header_size ? header_size - stream.sent
+                                                       : total - stream.sent;
+        ssize_t sent = ::send(stream.fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+          if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+          {
+            return true;
+          }
+          throw_errno("send");
+        }
+        stream.sent += static_cast<std::size_t>(sent);
+        if (stream.sent == total)
+        {
+          stream.last_byte = clock_type::now();
+        }
+      }
+      while (stream.digest_bytes < stream.digest.size())
+      {
+        ssize_t num = ::recv(stream.fd, stream.digest.data() + stream.digest_bytes,
+                             stream.digest.size() - stream.digest_bytes, 0);
+        if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+          return true;
+        }
+        if (num <= 0)
+        {
+          throw std::system_error(num == 0 ? ECONNRESET : errno, std::generic_category(), "recv");
+        }
+        stream.digest_bytes += static_cast<std::size_t>(num);
+      }
+      auto now = clock_type::now();
+      result.latencies_us.push_back(
+          std::chrono::duration<double, std::micro>(now - stream.last_byte).count());
+      ++result.streams;
+      result.mismatches += stream.digest != expected;
+      stream.sent = 0;
+      stream.digest_bytes = 0;
+      if (now >= deadline)
+      {
+        return false;
+      }
+    }
+  }
+
+  const load_options &options;
+  std::vector<unsigned char> payload;
+  unsigned char header[header_size];
+  std::array<unsigned char, CSHA256::OUTPUT_SIZE> expected;
+  std::vector<stream_state> streams;
+  int epoll_fd = -1;
+  clock_type::time_point deadline;
+};
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+  {
+    return 0.0;
+  }
+  auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+// Matches "--name=value"
+bool option_value(const char *arg, const char *name, std::string &value)
+{
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, "--", 2) == 0 && std::strncmp(arg + 2, name, length) == 0 &&
+      arg[2 + length] == '=')
+  {
+    value = arg + 3 + length;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  load_options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string value;
+    if (option_value(argv[i], "connect", value))
+    {
+      options.connect = value;
+    }
+    else if (option_value(argv[i], "connections", value))
+    {
+      options.connections = (std::max)(std::atoi(value.c_str()), 1);
+    }
+    else if (option_value(argv[i], "size", value))
+    {
+      options.size = static_cast<std::size_t>(std::strtoull(value.c_str(), nullptr, 10));
+    }
+    else if (option_value(argv[i], "seconds", value))
+    {
+      options.seconds = std::atof(value.c_str());
+    }
+    else if (option_value(argv[i], "threads", value))
+    {
+      options.threads = (std::max)(std::atoi(value.c_str()), 1);
+    }
+    else
+    {
+      std::fprintf(stderr,
+                   "Usage: %s [--connect=IPV4:PORT] [--connections=N] [--size=BYTES]\n"
+                   "          [--seconds=S] [--threads=N]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  raise_fd_limit();
+
+  std::unique_ptr<ingest_server> server;
+  std::thread server_thread;
+  auto stop_server = [&]
+  {
+    if (server_thread.joinable())
+    {
+      server->stop();
+      server_thread.join();
+    }
+  };
+  try
+  {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    if (options.connect)
+    {
+      auto colon = options.connect->rfind(':');
+      if (colon == std::string::npos ||
+          ::inet_pton(AF_INET, options.connect->substr(0, colon).c_str(), &addr.sin_addr) != 1)
+      {
+        std::fprintf(stderr, "Expected --connect=IPV4:PORT\n");
+        return EXIT_FAILURE;
+      }
+      addr.sin_port = htons(static_cast<std::uint16_t>(std::atoi(options.connect->c_str() + colon + 1)));
+    }
+    else
+    {
+      ingest_options server_options;
+      server_options.threads = options.threads;
+      server = std::make_unique<ingest_server>(server_options);
+      ::inet_pton(AF_INET, server_options.address.c_str(), &addr.sin_addr);
+      addr.sin_port = htons(server->port());
+      server_thread = std::thread([&] { server->run(); });
+    }
+
+    std::size_t resident_before = resident_bytes();
+    load_generator generator(options, addr);
+    if (server)
+    {
+      // Wait for the server to accept everything before sampling memory
+      while (server->stats().connections < static_cast<std::uint64_t>(options.connections))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    std::size_t resident_after = resident_bytes();
+
+    auto begin = clock_type::now();
+    auto result = generator.run();
+    std::chrono::duration<double> elapsed = clock_type::now() - begin;
+    stop_server();
+
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    double bytes = static_cast<double>(result.streams) * static_cast<double>(options.size);
+    std::printf("ingest:     %d connections, %zu byte streams\n", options.connections,
+                options.size);
+    std::printf("            %llu streams, %.2f Gb/s\n",
+                static_cast<unsigned long long>(result.streams), bytes * 8 / elapsed.count() / 1e9);
+    std::printf("            digest after last byte p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+                percentile(result.latencies_us, 0.5), percentile(result.latencies_us, 0.99),
+                percentile(result.latencies_us, 0.999));
+    if (server)
+    {
+      // Resident growth covers both ends of the connection in user space
+      std::printf("memory:     %zu bytes server state, %.0f bytes resident per connection\n",
+                  ingest_server::connection_bytes(),
+                  static_cast<double>(resident_after - (std::min)(resident_before, resident_after)) /
+                      options.connections);
+    }
+    if (result.mismatches)
+    {
+      std::printf("            %llu wrong digests\n",
+                  static_cast<unsigned long long>(result.mismatches));
+      return EXIT_FAILURE;
+    }
+  }
+  catch (const std::system_error &e)
+  {
+    stop_server();
+    std::fprintf(stderr, "%s\n", e.what());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
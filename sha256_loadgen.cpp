@@ -0,0 +1,301 @@
+// Load generator for sha256_daemon. Every client thread keeps --depth requests
+// of --size bytes in flight and records their round-trip latency. The same
+// messages are then hashed in-process, in batches of --depth, for comparison.
+//
+// Usage: sha256_loadgen [--socket=PATH] [--clients=N] [--depth=N] [--size=BYTES]
+//                       [--op=sha256|sha256d] [--seconds=S] [--backend=NAME]
+
+#include "hash_service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct load_options
+{
+  std::string socket_path = default_hash_socket_path();
+  std::string backend = "bitcoin";
+  int clients = 1;
+  std::uint32_t depth = 64;
+  std::size_t size = 64;
+  hash_op op = hash_op_sha256;
+  double seconds = 2.0;
+};
+
+struct client_result
+{
+  std::uint64_t requests = 0;
+  std::uint64_t errors = 0;
+  std::uint64_t mismatches = 0;
+  std::vector<double> latencies_us;
+};
+
+using clock_type = std::chrono::steady_clock;
+
+void fill_random(std::span<unsigned char> bytes, std::uint64_t seed)
+{
+  std::mt19937_64 gen(seed);
+  for (auto &byte : bytes)
+  {
+    byte = static_cast<unsigned char>(gen());
+  }
+}
+
+// Reference digests computed in-process
+std::vector<sha256_digest> expected_digests(const sha256_backend &backend,
+                                            std::span<const unsigned char> arena,
+                                            const load_options &options)
+{
+  std::vector<sha256_input> inputs;
+  for (std::uint32_t i = 0; i < options.depth; ++i)
+  {
+    inputs.push_back(arena.subspan(i * options.size, options.size));
+  }
+  std::vector<sha256_digest> digests(inputs.size());
+  auto engine = backend.create();
+  if (options.op == hash_op_sha256d)
+  {
+    engine.double_hash_many(inputs, digests);
+  }
+  else
+  {
+    engine.hash_many(inputs, digests);
+  }
+  return digests;
+}
+
+void run_client(const load_options &options, const sha256_backend &backend, int index,
+                client_result &result)
+{
+  hash_client client(options.socket_path, options.depth * options.size, options.depth);
+  auto arena = client.arena();
+  fill_random(arena, static_cast<std::uint64_t>(index));
+  auto expected = expected_digests(backend, arena, options);
+
+  // Request ids are slot indices, each slot reuses its part of the arena
+  std::vector<clock_type::time_point> submitted(options.depth);
+  std::vector<hash_completion> completions(options.depth);
+  result.latencies_us.reserve(1 << 20);
+  auto submit = [&](std::uint32_t slot)
+  {
+    submitted[slot] = clock_type::now();
+    client.submit({slot, std::uint64_t(slot) * options.size,
+                   static_cast<std::uint32_t>(options.size), options.op});
+  };
+  for (std::uint32_t slot = 0; slot < options.depth; ++slot)
+  {
+    submit(slot);
+  }
+  client.flush();
+
+  auto deadline = clock_type::now() + std::chrono::duration<double>(options.seconds);
+  std::uint32_t in_flight = options.depth;
+  while (in_flight > 0)
+  {
+    std::size_t count = client.wait(completions, 1000);
+    if (count == 0)
+    {
+      std::fprintf(stderr, "client %d: daemon stopped responding\n", index);
+      break;
+    }
+    auto now = clock_type::now();
+    bool resubmit = now < deadline;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const auto &completion = completions[i];
+      auto slot = static_cast<std::uint32_t>(completion.id);
+      result.latencies_us.push_back(
+          std::chrono::duration<double, std::micro>(now - submitted[slot]).count());
+      ++result.requests;
+      result.errors += completion.status != 0;
+      result.mismatches += completion.status == 0 && completion.digest != expected[slot];
+      if (resubmit)
+      {
+        submit(slot);
+      }
+      else
+      {
+        --in_flight;
+      }
+    }
+    client.flush();
+  }
+}
+
+// Hashes the same messages in batches of depth, without the daemon
+double in_process_rate(const load_options &options, const sha256_backend &backend)
+{
+  std::vector<unsigned char> data(options.depth * options.size);
+  fill_random(data, 0);
+  std::vector<sha256_input> inputs;
+  for (std::uint32_t i = 0; i < options.depth; ++i)
+  {
+    inputs.push_back(std::span<const unsigned char>(data).subspan(i * options.size,
+                                                                  options.size));
+  }
+  std::vector<sha256_digest> digests(inputs.size());
+  auto engine = backend.create();
+  std::uint64_t hashes = 0;
+  auto begin = clock_type::now();
+  auto deadline = begin + std::chrono::duration<double>(options.seconds);
+  while (clock_type::now() < deadline)
+  {
+    if (options.op == hash_op_sha256d)
+    {
+      engine.double_hash_many(inputs, digests);
+    }
+    else
+    {
+      engine.hash_many(inputs, digests);
+    }
+    hashes += inputs.size();
+  }
+  std::chrono::duration<double> elapsed = clock_type::now() - begin;
+  return static_cast<double>(hashes) / elapsed.count();
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+  {
+    return 0.0;
+  }
+  auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+// Matches "--name=value"
+bool option_value(const char *arg, const char *name, std::string &value)
+{
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, "--", 2) == 0 && std::strncmp(arg + 2, name, length) == 0 &&
+      arg[2 + length] == '=')
+  {
+    value = arg + 3 + length;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  load_options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string value;
+    if (option_value(argv[i], "socket", value))
+    {
+      options.socket_path = value;
+    }
+    else if (option_value(argv[i], "backend", value))
+    {
+      options.backend = value;
+    }
+    else if (option_value(argv[i], "clients", value))
+    {
+      options.clients = (std::max)(std::atoi(value.c_str()), 1);
+    }
+    else if (option_value(argv[i], "depth", value))
+    {
+      options.depth = static_cast<std::uint32_t>(
+          std::clamp(std::atoi(value.c_str()), 1, 1 << 16));
+    }
+    else if (option_value(argv[i], "size", value))
+    {
+      options.size = static_cast<std::size_t>(std::strtoull(value.c_str(), nullptr, 10));
+    }
+    else if (option_value(argv[i], "op", value) && (value == "sha256" || value == "sha256d"))
+    {
+      options.op = value == "sha256d" ? hash_op_sha256d : hash_op_sha256;
+    }
+    else if (option_value(argv[i], "seconds", value))
+    {
+      options.seconds = std::atof(value.c_str());
+    }
+    else
+    {
+      std::fprintf(stderr,
+                   "Usage: %s [--socket=PATH] [--clients=N] [--depth=N] [--size=BYTES]\n"
+                   "          [--op=sha256|sha256d] [--seconds=S] [--backend=NAME]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  const sha256_backend *backend = find_sha256_backend(options.backend);
+  if (!backend)
+  {
+    std::fprintf(stderr, "Unknown backend '%s'\n", options.backend.c_str());
+    return EXIT_FAILURE;
+  }
+
+  std::vector<client_result> results(static_cast<std::size_t>(options.clients));
+  std::vector<std::thread> threads;
+  std::atomic<bool> failed{false};
+  auto begin = clock_type::now();
+  for (int i = 0; i < options.clients; ++i)
+  {
+    threads.emplace_back([&, i]
+                         {
+      try
+      {
+        run_client(options, *backend, i, results[static_cast<std::size_t>(i)]);
+      }
+      catch (const std::system_error &e)
+      {
+        std::fprintf(stderr, "%s: %s\n", options.socket_path.c_str(), e.what());
+        failed = true;
+      } });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = clock_type::now() - begin;
+  if (failed)
+  {
+    return EXIT_FAILURE;
+  }
+
+  client_result total;
+  for (auto &result : results)
+  {
+    total.requests += result.requests;
+    total.errors += result.errors;
+    total.mismatches += result.mismatches;
+    total.latencies_us.insert(total.latencies_us.end(), result.latencies_us.begin(),
+                              result.latencies_us.end());
+  }
+  std::sort(total.latencies_us.begin(), total.latencies_us.end());
+  double rate = static_cast<double>(total.requests) / elapsed.count();
+  std::printf("daemon:     %d clients x %u in flight, %zu byte %s\n", options.clients,
+              options.depth, options.size, options.op == hash_op_sha256d ? "sha256d" : "sha256");
+  std::printf("            %.0f req/s, %.1f MB/s\n", rate,
+              rate * static_cast<double>(options.size) / 1e6);
+  std::printf("            latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+              percentile(total.latencies_us, 0.5), percentile(total.latencies_us, 0.99),
+              percentile(total.latencies_us, 0.999));
+  if (total.errors || total.mismatches)
+  {
+    std::printf("            %llu errors, %llu wrong digests\n",
+                static_cast<unsigned long long>(total.errors),
+                static_cast<unsigned long long>(total.mismatches));
+  }
+
+  double local = in_process_rate(options, *backend);
+  std::printf("in-process: %.0f hashes/s, %.1f MB/s on one thread (%s)\n", local,
+              local * static_cast<double>(options.size) / 1e6, options.backend.c_str());
+  return total.errors || total.mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+#include "sha256_provider.h"
+
+#include "bitcoin/sha256.h"
+
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+
+#include <cstddef>
+#include <new>
+
+namespace
+{
+constexpr std::size_t digest_size = CSHA256::OUTPUT_SIZE;
+constexpr std::size_t block_size = 64;
+
+// The digest context is the CSHA256 itself
+
+void *digest_newctx(void *)
+{
+  return new (std::nothrow) CSHA256();
+}
+
+void digest_freectx(void *ctx)
+{
+  delete static_cast<CSHA256 *>(ctx);
+}
+
+void *digest_dupctx(void *ctx)
+{
+  return new (std::nothrow) CSHA256(*static_cast<const CSHA256 *>(ctx));
+}
+
+int digest_init(void *ctx, const OSSL_PARAM[])
+{
+  static_cast<CSHA256 *>(ctx)->Reset();
+  return 1;
+}
+
+int digest_update(void *ctx, const unsigned char *in, std::size_t inl)
+{
+  static_cast<CSHA256 *>(ctx)->Write(in, inl);
+  return 1;
+}
+
+int digest_final(void *ctx, unsigned char *out, std::size_t *outl, std::size_t outsz)
+{
+  if (outsz < digest_size)
+  {
+    return 0;
+  }
+  static_cast<CSHA256 *>(ctx)->Finalize(out);
+  *outl = digest_size;
+  return 1;
+}
+
+int digest_oneshot(void *, const unsigned char *in, std::size_t inl, unsigned char *out,
+                   std::size_t *outl, std::size_t outsz)
+{
+  if (outsz < digest_size)
+  {
+    return 0;
+  }
+  CSHA256().Write(in, inl).Finalize(out);
+  *outl = digest_size;
+  return 1;
+}
+
+const OSSL_PARAM *digest_gettable_params(void *)
+{
+  static const OSSL_PARAM params[] = {
+      OSSL_PARAM_size_t(OSSL_DIGEST_PARAM_BLOCK_SIZE, nullptr),
+      OSSL_PARAM_size_t(OSSL_DIGEST_PARAM_SIZE, nullptr),
+      OSSL_PARAM_int(OSSL_DIGEST_PARAM_XOF, nullptr),
+      OSSL_PARAM_int(OSSL_DIGEST_PARAM_ALGID_ABSENT, nullptr),
+      OSSL_PARAM_END,
+  };
+  return params;
+}
+
+int digest_get_params(OSSL_PARAM params[])
+{
+  OSSL_PARAM *p;
+  if ((p = OSSL_PARAM_locate(params, OSSL_DIGEST_PARAM_BLOCK_SIZE)) &&
+      !OSSL_PARAM_set_size_t(p, block_size))
+  {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_DIGEST_PARAM_SIZE)) &&
+      !OSSL_PARAM_set_size_t(p, digest_size))
+  {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_DIGEST_PARAM_XOF)) && !OSSL_PARAM_set_int(p, 0))
+  {
+    return 0;
+  }
+  // Like the default provider, the AlgorithmIdentifier has no parameters
+  if ((p = OSSL_PARAM_locate(params, OSSL_DIGEST_PARAM_ALGID_ABSENT)) &&
+      !OSSL_PARAM_set_int(p, 1))
+  {
+    return 0;
+  }
+  return 1;
+}
+
+const OSSL_DISPATCH sha256_functions[] = {
+    {OSSL_FUNC_DIGEST_NEWCTX, reinterpret_cast<void (*)()>(digest_newctx)},
+    {OSSL_FUNC_DIGEST_FREECTX, reinterpret_cast<void (*)()>(digest_freectx)},
+    {OSSL_FUNC_DIGEST_DUPCTX, reinterpret_cast<void (*)()>(digest_dupctx)},
+    {OSSL_FUNC_DIGEST_INIT, reinterpret_cast<void (*)()>(digest_init)},
+    {OSSL_FUNC_DIGEST_UPDATE, reinterpret_cast<void (*)()>(digest_update)},
+    {OSSL_FUNC_DIGEST_FINAL, reinterpret_cast<void (*)()>(digest_final)},
+    {OSSL_FUNC_DIGEST_DIGEST, reinterpret_cast<void (*)()>(digest_oneshot)},
+    {OSSL_FUNC_DIGEST_GETTABLE_PARAMS, reinterpret_cast<void (*)()>(digest_gettable_params)},
+    {OSSL_FUNC_DIGEST_GET_PARAMS, reinterpret_cast<void (*)()>(digest_get_params)},
+    {0, nullptr},
+};
+
+// The names of the default provider, so fetches by any of them find it
+const OSSL_ALGORITHM digests[] = {
+    {"SHA2-256:SHA-256:SHA256:2.16.840.1.101.3.4.2.1", "provider=fast", sha256_functions,
+     "SHA2-256 on the bitcoin kernels"},
+    {nullptr, nullptr, nullptr, nullptr},
+};
+
+const OSSL_ALGORITHM *query_operation(void *, int operation_id, int *no_cache)
+{
+  *no_cache = 0;
+  return operation_id == OSSL_OP_DIGEST ? digests : nullptr;
+}
+
+const OSSL_PARAM *provider_gettable_params(void *)
+{
+  static const OSSL_PARAM params[] = {
+      OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, nullptr, 0),
+      OSSL_PARAM_int(OSSL_PROV_PARAM_STATUS, nullptr),
+      OSSL_PARAM_END,
+  };
+  return params;
+}
+
+int provider_get_params(void *, OSSL_PARAM params[])
+{
+  OSSL_PARAM *p;
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) &&
+      !OSSL_PARAM_set_utf8_ptr(p, "sha256-comparison fast provider"))
+  {
+    return 0;
+  }
+  if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) && !OSSL_PARAM_set_int(p, 1))
+  {
+    return 0;
+  }
+  return 1;
+}
+
+void provider_teardown(void *) {}
+
+const OSSL_DISPATCH provider_functions[] = {
+    {OSSL_FUNC_PROVIDER_QUERY_OPERATION, reinterpret_cast<void (*)()>(query_operation)},
+    {OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, reinterpret_cast<void (*)()>(provider_gettable_params)},
+    {OSSL_FUNC_PROVIDER_GET_PARAMS, reinterpret_cast<void (*)()>(provider_get_params)},
+    {OSSL_FUNC_PROVIDER_TEARDOWN, reinterpret_cast<void (*)()>(provider_teardown)},
+    {0, nullptr},
+};
+} // namespace
+
+extern "C" int sha256_fast_provider_init(const OSSL_CORE_HANDLE *, const OSSL_DISPATCH *,
+                                         const OSSL_DISPATCH **out, void **provctx)
+{
+  SHA256AutoDetect(sha256_implementation::USE_ALL);
+  *out = provider_functions;
+  *provctx = nullptr;
+  return 1;
+}
+
+#ifdef SHA256_PROVIDER_MODULE
+// Entry point OpenSSL looks up when it loads the module
+extern "C" OSSL_provider_init_fn OSSL_provider_init;
+extern "C" int OSSL_provider_init(const OSSL_CORE_HANDLE *handle, const OSSL_DISPATCH *in,
+                                  const OSSL_DISPATCH **out, void **provctx)
+{
+  return sha256_fast_provider_init(handle, in, out, provctx);
+}
+#else
+bool load_sha256_fast_provider(OSSL_LIB_CTX *libctx)
+{
+  // Loading any provider explicitly stops the default one from being loaded
+  // implicitly
+  return OSSL_PROVIDER_add_builtin(libctx, "fast", sha256_fast_provider_init) &&
+         OSSL_PROVIDER_load(libctx, "default") && OSSL_PROVIDER_load(libctx, "fast");
+}
+
+const EVP_MD *sha256_fast_md()
+{
+  static EVP_MD *md =
+      load_sha256_fast_provider() ? EVP_MD_fetch(nullptr, "SHA256", "provider=fast") : nullptr;
+  return md;
+}
+#endif // SHA256_PROVIDER_MODULE
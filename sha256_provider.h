@@ -0,0 +1,20 @@
+#pragma once
+
+// OpenSSL 3 provider named "fast" whose SHA2-256 runs on the bitcoin kernels
+// (SHA-NI, AVX2 or SSE4, whichever the CPU supports), so code hashing through
+// EVP_Digest* gets them without changes. It is linked into the executables
+// here and also built as a loadable module, sha256_fast, for other programs.
+
+#include <openssl/core.h>
+#include <openssl/evp.h>
+
+extern "C" OSSL_provider_init_fn sha256_fast_provider_init;
+
+// Registers the provider as a built-in and loads it into libctx (nullptr for
+// the default context) together with the default provider. false if OpenSSL
+// failed to load either.
+bool load_sha256_fast_provider(OSSL_LIB_CTX *libctx = nullptr);
+
+// SHA2-256 of the provider in the default context, loaded on first use;
+// nullptr if that failed
+const EVP_MD *sha256_fast_md();
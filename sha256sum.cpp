@@ -0,0 +1,577 @@
+// sha256sum compatible file hashing with a selectable backend and I/O strategy.
+//
+// Usage: sha256sum [OPTION]... [FILE]...
+// Output and check file formats follow GNU coreutils sha256sum.
+
+#include "digest_cache.h"
+#include "file_hash.h"
+#include "parallel_hash.h"
+#include "resumable_hash.h"
+#ifdef SHA256_IO_URING
+#include "uring_hash.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+
+struct cli_options
+{
+  std::string backend;
+  file_hash_options hash;
+  bool check = false;
+  bool binary = false;
+  bool quiet = false;
+  bool status = false;
+  bool strict = false;
+  bool warn = false;
+  bool stats = false;
+  int threads = 1;
+  bool uring = false;
+  unsigned queue_depth = 16;
+  std::string checkpoint;
+};
+
+struct throughput
+{
+  std::uint64_t bytes = 0;
+  double seconds = 0.0;
+  // Files whose digest came from --cache
+  std::uint64_t cached = 0;
+};
+
+void usage(std::ostream &out)
+{
+  out << "Usage: sha256sum [OPTION]... [FILE]...\n"
+         "Print or check SHA256 (256-bit) checksums.\n"
+         "With no FILE, or when FILE is -, read standard input.\n\n"
+         "  -b, --binary          read in binary mode\n"
+         "  -c, --check           read checksums from the FILEs and check them\n"
+         "  -t, --text            read in text mode (default)\n"
+         "      --backend=NAME    hash implementation:";
+  for (const auto &backend : sha256_backends())
+  {
+    out << " " << backend.name;
+  }
+  out << "\n"
+         "      --io=STRATEGY     read (default), mmap, direct (O_DIRECT)"
+#ifdef SHA256_IO_URING
+         " or uring"
+#endif
+         "\n"
+         "      --buffer-size=N   bytes per read (default 1048576)\n"
+         "      --threads=N       hash files in parallel, 0 for one per core (default 1)\n"
+#ifdef SHA256_IO_URING
+         "      --queue-depth=N   reads in flight with --io=uring (default 16)\n"
+#endif
+         "      --cache=FILE      reuse digests of unchanged files recorded in FILE\n"
+         "      --checkpoint=FILE save the progress of hashing a single FILE every GiB\n"
+         "                        and resume from it if interrupted\n"
+         "      --stats           report throughput on standard error\n\n"
+         "The following options are useful only when verifying checksums:\n"
+         "      --quiet           don't print OK for each successfully verified file\n"
+         "      --status          don't output anything, status code shows success\n"
+         "      --strict          exit non-zero for improperly formatted checksum lines\n"
+         "  -w, --warn            warn about improperly formatted checksum lines\n"
+         "      --help            display this help and exit\n";
+}
+
+// GNU sha256sum escapes backslashes and newlines and marks such lines with a
+// leading backslash
+std::string escape_name(const std::string &name, bool &escaped)
+{
+  escaped = false;
+  std::string out;
+  for (char c : name)
+  {
+    if (c == '\\')
+    {
+      out += "\\\\";
+      escaped = true;
+    }
+    else if (c == '\n')
+    {
+      out += "\\n";
+      escaped = true;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  return out;
+}
+
+bool unescape_name(const std::string &name, std::string &out)
+{
+  out.clear();
+  for (std::size_t i = 0; i < name.size(); ++i)
+  {
+    if (name[i] != '\\')
+    {
+      out += name[i];
+      continue;
+    }
+    if (++i == name.size())
+    {
+      return false;
+    }
+    if (name[i] == '\\')
+    {
+      out += '\\';
+    }
+    else if (name[i] == 'n')
+    {
+      out += '\n';
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+file_hash_result hash_named(file_hasher &hasher, const std::string &name,
+                            throughput &total, const cli_options &options)
+{
+  auto begin = std::chrono::steady_clock::now();
+  auto result = name == "-" ? hasher.hash_fd(STDIN_FILENO)
+                            : hasher.hash_path(name.c_str());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  if (result.error == 0)
+  {
+    total.bytes += result.bytes;
+    total.seconds += elapsed.count();
+    total.cached += result.cached;
+    if (options.stats)
+    {
+      std::fprintf(stderr, "%s: %llu bytes in %.3f s (%.1f MB/s)\n", name.c_str(),
+                   static_cast<unsigned long long>(result.bytes), elapsed.count(),
+                   elapsed.count() > 0.0 ? result.bytes / elapsed.count() / 1e6 : 0.0);
+    }
+  }
+  return result;
+}
+
+void print_result(const std::string &name, const file_hash_result &result,
+                  const cli_options &options, int &status)
+{
+  if (result.error != 0)
+  {
+    std::fprintf(stderr, "sha256sum: %s: %s\n", name.c_str(),
+                 std::strerror(result.error));
+    status = EXIT_FAILURE;
+    return;
+  }
+  bool escaped;
+  std::string printed = escape_name(name, escaped);
+  std::printf("%s%s %c%s\n", escaped ? "\\" : "", to_hex(result.digest).c_str(),
+              options.binary ? '*' : ' ', printed.c_str());
+}
+
+int compute(file_hasher &hasher, const std::vector<std::string> &files,
+            const cli_options &options, throughput &total)
+{
+  int status = EXIT_SUCCESS;
+  for (const auto &name : files)
+  {
+    print_result(name, hash_named(hasher, name, total, options), options, status);
+  }
+  return status;
+}
+
+// Output stays in argument order, per-file statistics are not available
+int compute_parallel(const sha256_backend &backend, const std::vector<std::string> &files,
+                     const cli_options &options, throughput &total)
+{
+  parallel_hash_options parallel;
+  parallel.num_threads = options.threads;
+  parallel_file_hasher hasher(backend, options.hash, parallel);
+  auto begin = std::chrono::steady_clock::now();
+  auto results = hasher.hash(files);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  total.seconds = elapsed.count();
+
+  int status = EXIT_SUCCESS;
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    total.bytes += results[i].bytes;
+    total.cached += results[i].cached;
+    print_result(files[i], results[i], options, status);
+  }
+  return status;
+}
+
+int compute_resumable(const sha256_backend &backend, const std::vector<std::string> &files,
+                      const cli_options &options, throughput &total)
+{
+  if (files.size() != 1 || files[0] == "-")
+  {
+    std::fprintf(stderr, "sha256sum: --checkpoint needs exactly one FILE\n");
+    return EXIT_FAILURE;
+  }
+  resumable_hash_options resumable;
+  resumable.buffer_size = options.hash.buffer_size;
+  auto begin = std::chrono::steady_clock::now();
+  auto result = hash_resumable(backend, files[0].c_str(), options.checkpoint, resumable);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  total.seconds = elapsed.count();
+  total.bytes = result.bytes - result.resumed_from;
+  if (options.stats && result.resumed_from > 0)
+  {
+    std::fprintf(stderr, "resumed at %llu bytes\n",
+                 static_cast<unsigned long long>(result.resumed_from));
+  }
+  int status = EXIT_SUCCESS;
+  print_result(files[0], result, options, status);
+  return status;
+}
+
+#ifdef SHA256_IO_URING
+// Overlaps reading of several files with hashing on one thread
+int compute_uring(const sha256_backend &backend, const std::vector<std::string> &files,
+                  const cli_options &options, throughput &total)
+{
+  uring_hash_options uring;
+  uring.queue_depth = options.queue_depth;
+  uring.buffer_size = (std::min)(options.hash.buffer_size, std::size_t(1) << 20);
+  uring_file_hasher hasher(backend, uring);
+  if (!hasher.available() && options.stats)
+  {
+    std::fprintf(stderr, "io_uring not available (%s), using read\n",
+                 std::strerror(hasher.setup_error()));
+  }
+  auto begin = std::chrono::steady_clock::now();
+  auto results = hasher.hash(files);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  total.seconds = elapsed.count();
+
+  int status = EXIT_SUCCESS;
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    total.bytes += results[i].bytes;
+    print_result(files[i], results[i], options, status);
+  }
+  return status;
+}
+#endif // SHA256_IO_URING
+
+int check(file_hasher &hasher, const std::vector<std::string> &files,
+          const cli_options &options, throughput &total)
+{
+  std::size_t malformed = 0, mismatched = 0, unreadable = 0, verified = 0;
+  for (const auto &list_name : files)
+  {
+    std::ifstream list_file;
+    if (list_name != "-")
+    {
+      list_file.open(list_name);
+      if (!list_file)
+      {
+        std::fprintf(stderr, "sha256sum: %s: %s\n", list_name.c_str(),
+                     std::strerror(errno));
+        ++unreadable;
+        continue;
+      }
+    }
+    std::istream &list = list_name == "-" ? std::cin : list_file;
+
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(list, line))
+    {
+      ++line_number;
+      if (!line.empty() && line.back() == '\r')
+      {
+        line.pop_back();
+      }
+      bool escaped = !line.empty() && line[0] == '\\';
+      std::string rest = escaped ? line.substr(1) : line;
+      sha256_digest expected;
+      std::string name;
+      if (rest.size() < 67 || !from_hex(rest.substr(0, 64), expected) ||
+          rest[64] != ' ' || (rest[65] != ' ' && rest[65] != '*') ||
+          !(escaped ? unescape_name(rest.substr(66), name)
+                    : (name = rest.substr(66), true)))
+      {
+        ++malformed;
+        if (options.warn)
+        {
+          std::fprintf(stderr,
+                       "sha256sum: %s: %zu: improperly formatted SHA256 checksum line\n",
+                       list_name.c_str(), line_number);
+        }
+        continue;
+      }
+
+      auto result = hash_named(hasher, name, total, options);
+      if (result.error != 0)
+      {
+        ++unreadable;
+        if (!options.status)
+        {
+          std::fprintf(stderr, "sha256sum: %s: %s\n", name.c_str(),
+                       std::strerror(result.error));
+          std::printf("%s: FAILED open or read\n", name.c_str());
+        }
+        continue;
+      }
+      ++verified;
+      if (result.digest != expected)
+      {
+        ++mismatched;
+        if (!options.status)
+        {
+          std::printf("%s: FAILED\n", name.c_str());
+        }
+      }
+      else if (!options.quiet && !options.status)
+      {
+        std::printf("%s: OK\n", name.c_str());
+      }
+    }
+  }
+
+  std::fflush(stdout);
+  if (!options.status)
+  {
+    if (malformed)
+    {
+      std::fprintf(stderr, "sha256sum: WARNING: %zu line%s improperly formatted\n",
+                   malformed, malformed == 1 ? " is" : "s are");
+    }
+    if (unreadable)
+    {
+      std::fprintf(stderr, "sha256sum: WARNING: %zu listed file%s could not be read\n",
+                   unreadable, unreadable == 1 ? "" : "s");
+    }
+    if (mismatched)
+    {
+      std::fprintf(stderr, "sha256sum: WARNING: %zu computed checksum%s did NOT match\n",
+                   mismatched, mismatched == 1 ? "" : "s");
+    }
+    if (verified == 0 && malformed > 0)
+    {
+      std::fprintf(stderr, "sha256sum: no properly formatted SHA256 checksum lines found\n");
+    }
+  }
+  bool ok = mismatched == 0 && unreadable == 0 && verified > 0 &&
+            !(options.strict && malformed > 0);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Matches "--name=value" and "--name value"
+bool option_value(const std::string &arg, const char *name, int &i, int argc,
+                  char **argv, std::string &value)
+{
+  std::string prefix = std::string("--") + name;
+  if (arg == prefix && i + 1 < argc)
+  {
+    value = argv[++i];
+    return true;
+  }
+  if (arg.compare(0, prefix.size() + 1, prefix + "=") == 0)
+  {
+    value = arg.substr(prefix.size() + 1);
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  cli_options options;
+  std::vector<std::string> files;
+  bool only_files = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    std::string value;
+    if (only_files || arg == "-" || arg[0] != '-')
+    {
+      files.push_back(arg);
+    }
+    else if (arg == "--")
+    {
+      only_files = true;
+    }
+    else if (arg == "-c" || arg == "--check")
+    {
+      options.check = true;
+    }
+    else if (arg == "-b" || arg == "--binary")
+    {
+      options.binary = true;
+    }
+    else if (arg == "-t" || arg == "--text")
+    {
+      options.binary = false;
+    }
+    else if (arg == "-w" || arg == "--warn")
+    {
+      options.warn = true;
+    }
+    else if (arg == "--quiet")
+    {
+      options.quiet = true;
+    }
+    else if (arg == "--status")
+    {
+      options.status = true;
+    }
+    else if (arg == "--strict")
+    {
+      options.strict = true;
+    }
+    else if (arg == "--stats")
+    {
+      options.stats = true;
+    }
+    else if (arg == "--help")
+    {
+      usage(std::cout);
+      return EXIT_SUCCESS;
+    }
+    else if (option_value(arg, "backend", i, argc, argv, value))
+    {
+      options.backend = value;
+    }
+    else if (option_value(arg, "io", i, argc, argv, value))
+    {
+#ifdef SHA256_IO_URING
+      if (value == "uring")
+      {
+        options.uring = true;
+        continue;
+      }
+#endif
+      if (!parse_io_strategy(value, options.hash.io))
+      {
+        std::fprintf(stderr, "sha256sum: invalid I/O strategy '%s'\n", value.c_str());
+        return EXIT_FAILURE;
+      }
+    }
+    else if (option_value(arg, "cache", i, argc, argv, value))
+    {
+      try
+      {
+        options.hash.cache = std::make_shared<digest_cache>(value);
+      }
+      catch (const std::system_error &e)
+      {
+        std::fprintf(stderr, "sha256sum: %s\n", e.what());
+        return EXIT_FAILURE;
+      }
+    }
+    else if (option_value(arg, "checkpoint", i, argc, argv, value))
+    {
+      options.checkpoint = value;
+    }
+    else if (option_value(arg, "buffer-size", i, argc, argv, value))
+    {
+      options.hash.buffer_size = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    else if (option_value(arg, "threads", i, argc, argv, value))
+    {
+      options.threads = std::atoi(value.c_str());
+    }
+#ifdef SHA256_IO_URING
+    else if (option_value(arg, "queue-depth", i, argc, argv, value))
+    {
+      options.queue_depth = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    }
+#endif
+    else
+    {
+      std::fprintf(stderr, "sha256sum: unrecognized option '%s'\n", arg.c_str());
+      usage(std::cerr);
+      return EXIT_FAILURE;
+    }
+  }
+  if (files.empty())
+  {
+    files.push_back("-");
+  }
+
+  const sha256_backend *backend = nullptr;
+  if (options.backend.empty())
+  {
+    // Fastest streaming backend in most of the benchmarks
+    backend = find_sha256_backend("bitcoin");
+    if (!backend)
+    {
+      backend = find_sha256_backend("openssl_deprecated");
+    }
+  }
+  else
+  {
+    backend = find_sha256_backend(options.backend);
+  }
+  if (!backend || !backend->has(sha256_incremental))
+  {
+    std::fprintf(stderr, "sha256sum: unknown or non-incremental backend '%s'\n",
+                 options.backend.c_str());
+    return EXIT_FAILURE;
+  }
+
+  file_hasher hasher(*backend, options.hash);
+  throughput total;
+  // Standard input can only be read once, so it keeps the sequential path
+  bool has_stdin = std::find(files.begin(), files.end(), "-") != files.end();
+  const char *io_name = io_strategy_name(hasher.options().io);
+  int status;
+  if (options.check)
+  {
+    status = check(hasher, files, options, total);
+  }
+  else if (!options.checkpoint.empty())
+  {
+    status = compute_resumable(*backend, files, options, total);
+  }
+#ifdef SHA256_IO_URING
+  // The io_uring hasher does not consult the cache
+  else if (options.uring && !has_stdin && !options.hash.cache)
+  {
+    status = compute_uring(*backend, files, options, total);
+    io_name = "uring";
+  }
+#endif
+  else if (options.threads != 1 && !has_stdin)
+  {
+    status = compute_parallel(*backend, files, options, total);
+  }
+  else
+  {
+    status = compute(hasher, files, options, total);
+  }
+  if (options.stats)
+  {
+    std::fprintf(stderr, "total: %llu bytes in %.3f s (%.1f MB/s) using %s/%s\n",
+                 static_cast<unsigned long long>(total.bytes), total.seconds,
+                 total.seconds > 0.0 ? total.bytes / total.seconds / 1e6 : 0.0,
+                 std::string(backend->name).c_str(),
+                 io_name);
+    if (options.hash.cache)
+    {
+      std::fprintf(stderr, "cache: %llu files unchanged\n",
+                   static_cast<unsigned long long>(total.cached));
+    }
+  }
+  return status;
+}
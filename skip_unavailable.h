@@ -0,0 +1,19 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+// For wrappers that depend on support from the system. The benchmark loop
+// does not run after SkipWithError.
+template <typename sha256_wrapper>
+bool skipUnavailable(benchmark::State &state)
+{
+  if constexpr (requires { sha256_wrapper::available(); })
+  {
+    if (!sha256_wrapper::available())
+    {
+      state.SkipWithError("not supported by this system");
+      return true;
+    }
+  }
+  return false;
+}
@@ -1,9 +1,27 @@
 #include "algorithm_wrappers.h"
+#include "cdc.h"
+#include "digest_memo.h"
+#include "digest_set.h"
+#include "sha256_batch.h"
+#include "sha256_dispatcher.h"
+#include "sha256_engine.h"
+#include "sha256_provider.h"
 
 #include <catch2/catch_template_test_macros.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <openssl/provider.h>
 
 #ifdef _WIN32
 #define SHA256_BCRYPT , sha256_bcrypt
@@ -17,10 +35,48 @@
 #define SHA256_BITCOIN
 #endif
 
+#ifdef USE_NSS
+#define SHA256_NSS , sha256_libnss
+#else
+#define SHA256_NSS
+#endif
+
+#ifndef _WIN32
+#include "blob_store.h"
+#include "digest_cache.h"
+#include "file_hash.h"
+#include "parallel_hash.h"
+#include "resumable_hash.h"
+#ifdef SHA256_IO_URING
+#include "uring_hash.h"
+#endif
+#endif
+
+#ifdef SHA256_HASH_SERVICE
+#include "hash_service.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef SHA256_INGEST_SERVER
+#include "ingest_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
 TEMPLATE_TEST_CASE("Well-known values", "[sha256_well_known]", sha256_zedwood,
-                   sha256_openssl,
+                   sha256_openssl, sha256_openssl_pooled, sha256_memoized<sha256_openssl>,
                    sha256_openssl_oneshot,
-                   sha256_openssl_deprecated SHA256_BCRYPT SHA256_BITCOIN) {
+                   sha256_openssl_deprecated SHA256_BCRYPT SHA256_BITCOIN SHA256_NSS) {
   {
     TestType sha_obj;
     sha_obj.add_bytes(nullptr, 0);
@@ -44,3 +100,1172 @@ TEMPLATE_TEST_CASE("Well-known values", "[sha256_well_known]", sha256_zedwood,
                           0x04, 0xfb, 0x11, 0xb6, 0x76, 0x7e, 0x84, 0x93});
   }
 }
+
+TEMPLATE_TEST_CASE("Reset", "[sha256_reset]", sha256_zedwood, sha256_openssl,
+                   sha256_openssl_global, sha256_openssl_pooled, sha256_memoized<sha256_openssl>,
+                   sha256_openssl_oneshot,
+                   sha256_openssl_deprecated SHA256_BCRYPT SHA256_BITCOIN SHA256_NSS) {
+  global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
+  const char *str = "gjdfjajbsdtejewtjwtersfdfsdfsdfsdghthertertqwerwer";
+  auto bytes = reinterpret_cast<const unsigned char *>(str);
+  TestType sha_obj;
+  sha_obj.add_bytes(bytes, 10);
+  sha_obj.reset();
+  sha_obj.add_bytes(bytes, std::strlen(str));
+  auto first = sha_obj.digest();
+  sha_obj.reset();
+  sha_obj.add_bytes(bytes, std::strlen(str));
+  auto second = sha_obj.digest();
+  REQUIRE(first == std::array<unsigned char, 32>{
+                       0xf7, 0x55, 0x9d, 0x5a, 0x69, 0xb0, 0xd6, 0xd2,
+                       0xb9, 0x1b, 0xfc, 0x24, 0x47, 0x67, 0x50, 0x98,
+                       0x72, 0x15, 0x7b, 0x4d, 0xd3, 0x81, 0x7a, 0xce,
+                       0x04, 0xfb, 0x11, 0xb6, 0x76, 0x7e, 0x84, 0x93});
+  REQUIRE(second == first);
+}
+
+TEMPLATE_TEST_CASE("Batch hashing", "[sha256_batch]", sha256_zedwood,
+                   sha256_openssl, sha256_openssl_global, sha256_openssl_pooled,
+                   sha256_openssl_oneshot,
+                   sha256_openssl_deprecated SHA256_BCRYPT SHA256_BITCOIN SHA256_NSS) {
+  global_md.reset(EVP_MD_fetch(NULL, "SHA256", NULL));
+#ifdef BITCOIN_IMPL
+  SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif
+  // Runs of 64-byte messages interrupted by other sizes
+  const std::size_t sizes[] = {64, 64, 64, 0,  64, 64, 64, 64, 64, 64, 64, 64,
+                               64, 1,  55, 56, 64, 64, 65, 64, 64, 64, 64, 1000};
+  std::mt19937_64 gen;
+  std::vector<std::vector<unsigned char>> messages;
+  for (std::size_t size : sizes) {
+    std::vector<unsigned char> message(size);
+    for (auto &byte : message) {
+      byte = static_cast<unsigned char>(gen());
+    }
+    messages.push_back(std::move(message));
+  }
+  std::vector<sha256_input> inputs(messages.begin(), messages.end());
+
+  std::vector<sha256_digest> single(inputs.size());
+  std::vector<sha256_digest> twice(inputs.size());
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    TestType sha_obj;
+    sha_obj.add_bytes(inputs[i].data(), inputs[i].size());
+    single[i] = sha_obj.digest();
+    TestType outer;
+    outer.add_bytes(single[i].data(), single[i].size());
+    twice[i] = outer.digest();
+  }
+
+  std::vector<sha256_digest> out(inputs.size());
+  hash_many<TestType>(inputs, out);
+  REQUIRE(out == single);
+  double_hash_many<TestType>(inputs, out);
+  REQUIRE(out == twice);
+}
+
+TEMPLATE_TEST_CASE("Scatter/gather input", "[sha256_iovec]", sha256_zedwood,
+                   sha256_openssl, sha256_openssl_pooled,
+                   sha256_openssl_deprecated SHA256_BCRYPT SHA256_BITCOIN SHA256_NSS) {
+#ifdef BITCOIN_IMPL
+  SHA256AutoDetect(sha256_implementation::USE_ALL);
+#endif
+  std::mt19937_64 gen;
+  std::vector<unsigned char> message(5000);
+  for (auto &byte : message) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  TestType reference;
+  reference.add_bytes(message.data(), message.size());
+  auto expected = reference.digest();
+
+  const std::size_t fragment_sizes[] = {0, 1, 7, 63, 64, 65, 128, 200, 1500};
+  for (std::size_t prefix : {0, 10, 64}) {
+    std::vector<iovec> iov;
+    std::size_t offset = prefix;
+    while (offset < message.size()) {
+      std::size_t size = std::min(fragment_sizes[gen() % std::size(fragment_sizes)],
+                                  message.size() - offset);
+      iov.push_back({message.data() + offset, size});
+      offset += size;
+    }
+    TestType sha_obj;
+    sha_obj.add_bytes(message.data(), prefix);
+    add_iovec(sha_obj, iov.data(), iov.size());
+    REQUIRE(sha_obj.digest() == expected);
+  }
+}
+
+#ifdef SHA256_AFALG
+TEST_CASE("Kernel crypto API", "[sha256_afalg]") {
+  if (!sha256_afalg::available()) {
+    WARN("AF_ALG sha256 not available");
+    return;
+  }
+  std::mt19937_64 gen;
+  std::vector<unsigned char> message(300000);
+  for (auto &byte : message) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  sha256_zedwood reference;
+  reference.add_bytes(message.data(), message.size());
+  auto expected = reference.digest();
+
+  sha256_afalg afalg;
+  REQUIRE(afalg.digest() == sha256_zedwood().digest());
+  for (std::size_t split : {0, 1, 64, 1000, 200000}) {
+    afalg.reset();
+    afalg.add_bytes(message.data(), split);
+    afalg.add_bytes(message.data() + split, message.size() - split);
+    REQUIRE(afalg.digest() == expected);
+  }
+  // Resetting drops a partial message
+  afalg.add_bytes(message.data(), 100);
+  afalg.reset();
+  afalg.add_bytes(message.data(), message.size());
+  REQUIRE(afalg.digest() == expected);
+
+  auto path = (std::filesystem::temp_directory_path() / "sha256_afalg_test.bin").string();
+  std::ofstream(path, std::ios::binary)
+      .write(reinterpret_cast<const char *>(message.data()), message.size());
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  REQUIRE(fd >= 0);
+  REQUIRE(::lseek(fd, 1000, SEEK_SET) == 1000);
+  afalg.add_bytes(message.data(), 1000);
+  REQUIRE(afalg.add_fd(fd) == static_cast<long long>(message.size() - 1000));
+  REQUIRE(afalg.digest() == expected);
+  ::close(fd);
+  std::filesystem::remove(path);
+
+  int pipe_fds[2];
+  REQUIRE(::pipe(pipe_fds) == 0);
+  std::thread writer([&] {
+    const unsigned char *bytes = message.data();
+    for (std::size_t left = message.size(); left > 0;) {
+      ssize_t written = ::write(pipe_fds[1], bytes, std::min<std::size_t>(left, 7000));
+      if (written <= 0) {
+        break;
+      }
+      bytes += written;
+      left -= static_cast<std::size_t>(written);
+    }
+    ::close(pipe_fds[1]);
+  });
+  REQUIRE(afalg.add_fd(pipe_fds[0]) == static_cast<long long>(message.size()));
+  writer.join();
+  ::close(pipe_fds[0]);
+  REQUIRE(afalg.digest() == expected);
+}
+#endif // SHA256_AFALG
+
+TEST_CASE("Engine registry", "[sha256_engine]") {
+  const char *str = "gjdfjajbsdtejewtjwtersfdfsdfsdfsdghthertertqwerwer";
+  const std::array<unsigned char, 32> expected = {
+      0xf7, 0x55, 0x9d, 0x5a, 0x69, 0xb0, 0xd6, 0xd2, 0xb9, 0x1b, 0xfc,
+      0x24, 0x47, 0x67, 0x50, 0x98, 0x72, 0x15, 0x7b, 0x4d, 0xd3, 0x81,
+      0x7a, 0xce, 0x04, 0xfb, 0x11, 0xb6, 0x76, 0x7e, 0x84, 0x93};
+
+  REQUIRE(!sha256_backends().empty());
+  for (const auto &backend : sha256_backends()) {
+    INFO(backend.name);
+    REQUIRE(find_sha256_backend(backend.name) == &backend);
+
+    auto engine = backend.create();
+    engine.add_bytes(reinterpret_cast<const unsigned char *>(str),
+                     std::strlen(str));
+    auto moved = std::move(engine);
+    REQUIRE(moved.digest() == expected);
+
+    if (backend.has(sha256_incremental)) {
+      auto split = backend.create();
+      split.add_bytes(reinterpret_cast<const unsigned char *>(str), 7);
+      split.add_bytes(reinterpret_cast<const unsigned char *>(str) + 7,
+                      std::strlen(str) - 7);
+      REQUIRE(split.digest() == expected);
+    }
+  }
+  REQUIRE(find_sha256_backend("does_not_exist") == nullptr);
+}
+
+TEST_CASE("OpenSSL provider", "[sha256_provider]") {
+  // A context of its own, so the other tests keep the default provider
+  std::unique_ptr<OSSL_LIB_CTX, decltype(&OSSL_LIB_CTX_free)> libctx(OSSL_LIB_CTX_new(),
+                                                                      OSSL_LIB_CTX_free);
+  REQUIRE(load_sha256_fast_provider(libctx.get()));
+  std::unique_ptr<EVP_MD, openssl_md_destroyer> fast(
+      EVP_MD_fetch(libctx.get(), "SHA256", "provider=fast"));
+  REQUIRE(fast);
+  REQUIRE(std::string(OSSL_PROVIDER_get0_name(EVP_MD_get0_provider(fast.get()))) == "fast");
+  REQUIRE(EVP_MD_get_size(fast.get()) == 32);
+  REQUIRE(EVP_MD_get_block_size(fast.get()) == 64);
+
+  std::mt19937_64 gen;
+  std::vector<unsigned char> message(100000);
+  for (auto &byte : message) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  for (std::size_t size : {0, 3, 55, 56, 64, 1000, 100000}) {
+    INFO(size << " bytes");
+    sha256_zedwood reference;
+    reference.add_bytes(message.data(), size);
+    auto expected = reference.digest();
+
+    std::array<unsigned char, 32> digest;
+    unsigned int length = 0;
+    REQUIRE(EVP_Digest(message.data(), size, digest.data(), &length, fast.get(), nullptr));
+    REQUIRE(length == 32);
+    REQUIRE(digest == expected);
+
+    // Incremental, with a copy of the context taken halfway
+    std::unique_ptr<EVP_MD_CTX, openssl_evp_destroyer> ctx(EVP_MD_CTX_new());
+    std::unique_ptr<EVP_MD_CTX, openssl_evp_destroyer> copy(EVP_MD_CTX_new());
+    REQUIRE(EVP_DigestInit_ex(ctx.get(), fast.get(), nullptr));
+    REQUIRE(EVP_DigestUpdate(ctx.get(), message.data(), size / 2));
+    REQUIRE(EVP_MD_CTX_copy_ex(copy.get(), ctx.get()));
+    for (auto *c : {ctx.get(), copy.get()}) {
+      REQUIRE(EVP_DigestUpdate(c, message.data() + size / 2, size - size / 2));
+      REQUIRE(EVP_DigestFinal_ex(c, digest.data(), nullptr));
+      REQUIRE(digest == expected);
+    }
+  }
+
+  // A default property query makes plain fetches, as in the existing
+  // wrappers, prefer the provider
+  REQUIRE(EVP_set_default_properties(libctx.get(), "?provider=fast"));
+  std::unique_ptr<EVP_MD, openssl_md_destroyer> preferred(
+      EVP_MD_fetch(libctx.get(), "SHA2-256", nullptr));
+  REQUIRE(preferred);
+  REQUIRE(EVP_MD_get0_provider(preferred.get()) == EVP_MD_get0_provider(fast.get()));
+  REQUIRE(sha256_fast_md() != nullptr);
+}
+
+TEST_CASE("Size-adaptive dispatcher", "[sha256_dispatcher]") {
+  const char *str = "gjdfjajbsdtejewtjwtersfdfsdfsdfsdghthertertqwerwer";
+  const std::array<unsigned char, 32> expected = {
+      0xf7, 0x55, 0x9d, 0x5a, 0x69, 0xb0, 0xd6, 0xd2, 0xb9, 0x1b, 0xfc,
+      0x24, 0x47, 0x67, 0x50, 0x98, 0x72, 0x15, 0x7b, 0x4d, 0xd3, 0x81,
+      0x7a, 0xce, 0x04, 0xfb, 0x11, 0xb6, 0x76, 0x7e, 0x84, 0x93};
+  auto bytes = reinterpret_cast<const unsigned char *>(str);
+
+  auto dispatcher = sha256_dispatcher::calibrate();
+  REQUIRE(!dispatcher.table().empty());
+  REQUIRE(dispatcher.table().back().max_size ==
+          sha256_dispatcher::calibration_sizes.back());
+  REQUIRE(dispatcher.hash(bytes, std::strlen(str)) == expected);
+
+  auto path = (std::filesystem::temp_directory_path() /
+               "sha256_dispatcher_test_profile.txt")
+                  .string();
+  {
+    // Replaced as a whole, without leaving the temporary file behind
+    std::ofstream stale(path);
+    stale << "stale profile\n";
+  }
+  REQUIRE(dispatcher.save(path));
+  for (const auto &item : std::filesystem::directory_iterator(
+           std::filesystem::path(path).parent_path())) {
+    REQUIRE(item.path().filename().string().rfind(
+                "sha256_dispatcher_test_profile.txt.tmp", 0) != 0);
+  }
+  auto loaded = sha256_dispatcher::load(path);
+  std::filesystem::remove(path);
+  REQUIRE(loaded);
+  REQUIRE(loaded->table().size() == dispatcher.table().size());
+  for (std::size_t size : sha256_dispatcher::calibration_sizes) {
+    REQUIRE(&loaded->select(size) == &dispatcher.select(size));
+  }
+  REQUIRE(!sha256_dispatcher::load(path));
+  {
+    std::ofstream oneshot_profile(path);
+    oneshot_profile << "sha256-comparison tuning profile v1\n"
+                    << "cpu " << sha256_dispatcher::cpu_key() << "\n"
+                    << "262144 openssl_oneshot\n";
+  }
+  REQUIRE(!sha256_dispatcher::load(path));
+  std::filesystem::remove(path);
+
+  for (const auto &e : dispatcher.table()) {
+    REQUIRE(e.backend->has(sha256_incremental));
+  }
+  const sha256_backend *oneshot = find_sha256_backend("openssl_oneshot");
+  REQUIRE(oneshot);
+  REQUIRE(!loaded->force(oneshot));
+
+  const sha256_backend *zedwood = find_sha256_backend("zedwood");
+  REQUIRE(zedwood);
+  REQUIRE(loaded->force(zedwood));
+  REQUIRE(&loaded->select(64) == zedwood);
+  REQUIRE(&loaded->select(1 << 20) == zedwood);
+  REQUIRE(loaded->hash(bytes, std::strlen(str)) == expected);
+
+  // A message split across calls, whichever backend the first piece selects
+  for (std::size_t split : {std::size_t(0), std::size_t(1), std::size_t(20)}) {
+    sha256_auto sha256;
+    sha256.add_bytes(bytes, split);
+    sha256.add_bytes(bytes + split, std::strlen(str) - split);
+    REQUIRE(sha256.digest() == expected);
+  }
+}
+
+TEST_CASE("Content-defined chunking", "[cdc]") {
+  std::mt19937_64 gen;
+  std::vector<unsigned char> data(std::size_t(3) << 20);
+  for (auto &byte : data) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  cdc_options chunking;
+  chunking.avg_size = 4096;
+  const sha256_backend *backend = find_sha256_backend("bitcoin");
+  if (!backend) {
+    backend = &*sha256_backends().begin();
+  }
+
+  auto chunk_all = [&](const std::vector<unsigned char> &bytes, bool pipelined) {
+    cdc_stream_options options;
+    // Small regions so that chunks cross many region boundaries
+    options.region_size = 1;
+    options.batch_chunks = 5;
+    options.pipelined = pipelined;
+    cdc_stream stream(*backend, chunking, options);
+    std::vector<cdc_chunk> chunks;
+    std::size_t written = 0;
+    for (std::size_t piece = 1; written < bytes.size(); piece = piece * 13 % 100003 + 7) {
+      auto length = std::min(piece, bytes.size() - written);
+      stream.write(std::span<const unsigned char>(bytes).subspan(written, length));
+      written += length;
+      stream.drain(chunks);
+    }
+    auto rest = stream.finish();
+    chunks.insert(chunks.end(), rest.begin(), rest.end());
+    // The stream starts over after finish()
+    stream.write(std::span<const unsigned char>(bytes).first(100));
+    auto again = stream.finish();
+    REQUIRE(again.size() == 1);
+    REQUIRE(again[0].offset == 0);
+    return chunks;
+  };
+
+  auto chunks = chunk_all(data, true);
+  fastcdc cdc(chunking);
+  std::uint64_t offset = 0;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    const auto &chunk = chunks[i];
+    REQUIRE(chunk.offset == offset);
+    REQUIRE(chunk.length <= cdc.max_size());
+    if (i + 1 < chunks.size()) {
+      REQUIRE(chunk.length > cdc.min_size());
+    }
+    // Boundaries only depend on the data from the chunk start
+    auto rest = std::span<const unsigned char>(data).subspan(offset);
+    REQUIRE(cdc.cut(rest, true) == chunk.length);
+    sha256_zedwood reference;
+    reference.add_bytes(data.data() + offset, chunk.length);
+    REQUIRE(chunk.digest == reference.digest());
+    offset += chunk.length;
+  }
+  REQUIRE(offset == data.size());
+  double average = static_cast<double>(data.size()) / static_cast<double>(chunks.size());
+  REQUIRE(average > 2048);
+  REQUIRE(average < 8192);
+
+  auto serial = chunk_all(data, false);
+  REQUIRE(serial.size() == chunks.size());
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    REQUIRE(serial[i].digest == chunks[i].digest);
+  }
+
+  // An insertion only changes the chunks around it
+  auto edited = data;
+  edited.insert(edited.begin() + static_cast<std::ptrdiff_t>(data.size() / 2), 17, 0x5a);
+  auto changed = chunk_all(edited, true);
+  std::size_t shared = 0;
+  for (const auto &chunk : chunks) {
+    shared += std::any_of(changed.begin(), changed.end(), [&chunk](const cdc_chunk &other) {
+      return other.digest == chunk.digest;
+    });
+  }
+  REQUIRE(shared + 3 >= chunks.size());
+}
+
+TEST_CASE("Digest set", "[digest_set]") {
+  std::mt19937_64 gen;
+  auto random_digest = [&] {
+    sha256_digest digest;
+    for (auto &byte : digest) {
+      byte = static_cast<unsigned char>(gen());
+    }
+    return digest;
+  };
+  std::vector<sha256_digest> digests(50000);
+  for (auto &digest : digests) {
+    digest = random_digest();
+  }
+  // Same bucket bits and tag, so they fill several buckets in a row
+  for (std::size_t i = 0; i < 100; ++i) {
+    digests[i] = digests[0];
+    digests[i][31] = static_cast<unsigned char>(i);
+  }
+
+  SECTION("one thread") {
+    // Resizes several times
+    digest_set set(10);
+    std::vector<std::uint64_t> ids;
+    for (const auto &digest : digests) {
+      auto [id, inserted] = set.insert(digest);
+      REQUIRE(inserted);
+      ids.push_back(id);
+    }
+    REQUIRE(set.size() == digests.size());
+    REQUIRE(set.capacity() >= digests.size());
+    for (std::size_t i = 0; i < digests.size(); ++i) {
+      REQUIRE(set.insert(digests[i]) == std::make_pair(ids[i], false));
+      REQUIRE(set.find(digests[i]) == ids[i]);
+      REQUIRE(set.at(ids[i]) == digests[i]);
+    }
+    auto missing = digests[5];
+    missing[31] = 200;
+    REQUIRE_FALSE(set.contains(missing));
+    REQUIRE_FALSE(set.contains(random_digest()));
+    REQUIRE(set.size() == digests.size());
+  }
+
+  SECTION("concurrent inserts") {
+    // Every digest is inserted by two threads
+    constexpr std::size_t num_threads = 8;
+    digest_set set;
+    std::vector<std::vector<std::pair<std::uint64_t, bool>>> results(num_threads);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t] {
+        std::size_t begin = digests.size() / num_threads * (t / 2 * 2);
+        for (std::size_t i = 0; i < digests.size(); ++i) {
+          results[t].push_back(set.insert(digests[(begin + i) % digests.size()]));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    REQUIRE(set.size() == digests.size());
+    std::vector<int> inserted(digests.size());
+    for (std::size_t t = 0; t < num_threads; ++t) {
+      std::size_t begin = digests.size() / num_threads * (t / 2 * 2);
+      for (std::size_t i = 0; i < digests.size(); ++i) {
+        std::size_t index = (begin + i) % digests.size();
+        REQUIRE(results[t][i].first == set.find(digests[index]));
+        inserted[index] += results[t][i].second;
+      }
+    }
+    REQUIRE(std::count(inserted.begin(), inserted.end(), 1) == static_cast<long>(digests.size()));
+  }
+}
+
+TEST_CASE("Digest memoization", "[digest_memo]") {
+  std::mt19937_64 gen;
+  std::vector<unsigned char> message(3000);
+  for (auto &byte : message) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  auto reference = [&](std::size_t size) {
+    sha256_zedwood sha_obj;
+    sha_obj.add_bytes(message.data(), size);
+    return sha_obj.digest();
+  };
+
+  SECTION("front-end") {
+    digest_memo memo({100, std::size_t(1) << 20, 4});
+    sha256_memoized<sha256_zedwood> sha_obj(memo);
+    // Twice each, split into two calls; 150 and 3000 bytes are not cached
+    for (int round = 0; round < 2; ++round) {
+      for (std::size_t size : {0, 1, 64, 99, 100, 101, 150, 3000}) {
+        sha_obj.add_bytes(message.data(), size / 3);
+        sha_obj.add_bytes(message.data() + size / 3, size - size / 3);
+        REQUIRE(sha_obj.digest() == reference(size));
+        sha_obj.reset();
+      }
+    }
+    auto stats = memo.stats();
+    REQUIRE(stats.lookups == 10);
+    REQUIRE(stats.hits == 5);
+    REQUIRE(stats.bytes_saved == 0 + 1 + 64 + 99 + 100);
+    REQUIRE(stats.entries == 5);
+    REQUIRE(stats.hit_rate() == 0.5);
+  }
+
+  SECTION("fingerprint collision") {
+    digest_memo memo;
+    auto first = reference(10);
+    memo.insert(message.data(), 10, 42, first);
+    REQUIRE(memo.find(message.data(), 10, 42) == first);
+    REQUIRE_FALSE(memo.find(message.data() + 1, 10, 42));
+    REQUIRE_FALSE(memo.find(message.data(), 9, 42));
+    // The newer message replaces the older one
+    memo.insert(message.data(), 9, 42, reference(9));
+    REQUIRE(memo.find(message.data(), 9, 42) == reference(9));
+    REQUIRE_FALSE(memo.find(message.data(), 10, 42));
+    REQUIRE(memo.stats().entries == 1);
+  }
+
+  SECTION("least recently used") {
+    // Room for four 100-byte messages in a single shard
+    digest_memo memo({100, 4 * (100 + digest_memo::entry_overhead), 1});
+    auto insert = [&](std::size_t i) {
+      memo.insert(message.data() + i, 100, digest_memo::fingerprint(message.data() + i, 100),
+                  reference(0));
+    };
+    auto contains = [&](std::size_t i) {
+      return memo.find(message.data() + i, 100, digest_memo::fingerprint(message.data() + i, 100))
+          .has_value();
+    };
+    for (std::size_t i = 0; i < 4; ++i) {
+      insert(i);
+    }
+    REQUIRE(contains(0));
+    insert(4);
+    REQUIRE_FALSE(contains(1));
+    insert(5);
+    REQUIRE_FALSE(contains(2));
+    for (std::size_t i : {0, 3, 4, 5}) {
+      REQUIRE(contains(i));
+    }
+    REQUIRE(memo.stats().bytes == 4 * (100 + digest_memo::entry_overhead));
+    memo.clear();
+    REQUIRE_FALSE(contains(0));
+    REQUIRE(memo.stats().entries == 0);
+  }
+
+  SECTION("concurrent") {
+    digest_memo memo({1024, std::size_t(1) << 16, 4});
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 8; ++t) {
+      threads.emplace_back([&, t] {
+        sha256_memoized<sha256_zedwood> sha_obj(memo);
+        for (std::size_t i = 0; i < 2000; ++i) {
+          std::size_t size = (i * 7 + static_cast<std::size_t>(t)) % 200;
+          sha_obj.add_bytes(message.data(), size);
+          wrong += sha_obj.digest() != reference(size);
+          sha_obj.reset();
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(memo.stats().hits > 0);
+    REQUIRE(memo.stats().bytes <= std::size_t(1) << 16);
+  }
+}
+
+#ifndef _WIN32
+TEST_CASE("File hashing", "[file_hash]") {
+  std::mt19937_64 gen;
+  std::vector<unsigned char> content(300007);
+  for (auto &byte : content) {
+    byte = static_cast<unsigned char>(gen());
+  }
+  auto path = (std::filesystem::temp_directory_path() / "sha256_file_hash_test.bin")
+                  .string();
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(content.data()),
+               static_cast<std::streamsize>(content.size()));
+  }
+  sha256_zedwood reference;
+  reference.add_bytes(content.data(), content.size());
+  auto expected = reference.digest();
+  REQUIRE(to_hex(expected).size() == 64);
+  sha256_digest parsed;
+  REQUIRE(from_hex(to_hex(expected), parsed));
+  REQUIRE(parsed == expected);
+
+  for (const auto &backend : sha256_backends()) {
+    if (!backend.has(sha256_incremental)) {
+      continue;
+    }
+    for (auto io : {io_strategy::read, io_strategy::mmap, io_strategy::direct}) {
+      for (std::size_t buffer_size : {std::size_t(1), std::size_t(1) << 20}) {
+        INFO(backend.name << " " << io_strategy_name(io) << " " << buffer_size);
+        file_hasher hasher(backend, {io, buffer_size, {}});
+        auto result = hasher.hash_path(path.c_str());
+        REQUIRE(result.error == 0);
+        REQUIRE(result.bytes == content.size());
+        REQUIRE(result.digest == expected);
+      }
+    }
+  }
+  std::filesystem::remove(path);
+
+  file_hasher hasher(*sha256_backends().begin(), {});
+  REQUIRE(hasher.hash_path(path.c_str()).error == ENOENT);
+}
+
+// Files of the given sizes with random contents in dir, and their digests
+static std::vector<sha256_digest>
+write_random_files(const std::filesystem::path &dir, std::initializer_list<std::size_t> sizes,
+                   std::vector<std::string> &paths) {
+  std::filesystem::create_directories(dir);
+  std::mt19937_64 gen;
+  std::vector<sha256_digest> expected;
+  for (std::size_t size : sizes) {
+    std::vector<unsigned char> content(size);
+    for (auto &byte : content) {
+      byte = static_cast<unsigned char>(gen());
+    }
+    paths.push_back((dir / ("f" + std::to_string(paths.size()))).string());
+    std::ofstream file(paths.back(), std::ios::binary);
+    file.write(reinterpret_cast<const char *>(content.data()),
+               static_cast<std::streamsize>(content.size()));
+    sha256_zedwood reference;
+    reference.add_bytes(content.data(), content.size());
+    expected.push_back(reference.digest());
+  }
+  return expected;
+}
+
+TEST_CASE("Parallel file hashing", "[file_hash]") {
+  auto dir = std::filesystem::temp_directory_path() / "sha256_parallel_hash_test";
+  std::vector<std::string> paths;
+  // Small files end up in batches, the large ones are hashed on their own
+  auto expected = write_random_files(
+      dir, {0, 1, 64, 3000, 2000000, 100, 65536, 1500000, 7}, paths);
+  paths.push_back((dir / "missing").string());
+
+  for (int threads : {1, 3, 16}) {
+    INFO(threads << " threads");
+    parallel_hash_options parallel;
+    parallel.num_threads = threads;
+    parallel.batch_files = 2;
+    parallel_file_hasher hasher(*sha256_backends().begin(), {}, parallel);
+    REQUIRE(hasher.threads() == threads);
+    auto results = hasher.hash(paths);
+    REQUIRE(results.size() == paths.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      REQUIRE(results[i].error == 0);
+      REQUIRE(results[i].digest == expected[i]);
+    }
+    REQUIRE(results.back().error == ENOENT);
+    REQUIRE(hasher.hash({}).empty());
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("File digest cache", "[file_hash]") {
+  auto dir = std::filesystem::temp_directory_path() / "sha256_digest_cache_test";
+  std::vector<std::string> paths;
+  auto expected = write_random_files(dir, {0, 5000, 100000}, paths);
+  auto cache_path = (dir / "cache").string();
+  const sha256_backend &backend = *sha256_backends().begin();
+
+  // Just written, so too recent to be cached with the default window
+  {
+    file_hash_options options;
+    options.cache = std::make_shared<digest_cache>(cache_path);
+    file_hasher hasher(backend, options);
+    auto result = hasher.hash_path(paths[1].c_str());
+    REQUIRE(result.digest == expected[1]);
+    REQUIRE_FALSE(result.cached);
+    REQUIRE(options.cache->size() == 0);
+  }
+
+  digest_cache_options cache_options;
+  cache_options.racy_window_ns = 0;
+  {
+    file_hash_options options;
+    options.cache = std::make_shared<digest_cache>(cache_path, cache_options);
+    file_hasher hasher(backend, options);
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      auto miss = hasher.hash_path(paths[i].c_str());
+      REQUIRE_FALSE(miss.cached);
+      auto hit = hasher.hash_path(paths[i].c_str());
+      REQUIRE(hit.cached);
+      REQUIRE(hit.digest == expected[i]);
+      REQUIRE(hit.bytes == miss.bytes);
+    }
+    REQUIRE(options.cache->size() == paths.size());
+
+    // A new modification time is a new key
+    std::filesystem::last_write_time(
+        paths[2], std::filesystem::last_write_time(paths[2]) - std::chrono::hours(1));
+    REQUIRE_FALSE(hasher.hash_path(paths[2].c_str()).cached);
+    REQUIRE(hasher.hash_path(paths[2].c_str()).cached);
+  }
+
+  // Records persist and other instances pick up appends
+  digest_cache reader(cache_path, cache_options);
+  REQUIRE(reader.size() == paths.size() + 1);
+  struct stat st;
+  REQUIRE(::stat(paths[1].c_str(), &st) == 0);
+  REQUIRE(reader.find(make_file_key(st)) == expected[1]);
+  {
+    digest_cache writer(cache_path, cache_options);
+    file_key key = {1, 2, 3, 4, 5};
+    REQUIRE(writer.insert(key, expected[0], digest_cache::now_ns()));
+    file_key changed = {1, 2, 3, 4, digest_cache::now_ns()};
+    REQUIRE_FALSE(writer.insert(changed, expected[0], changed.ctime_ns));
+  }
+  REQUIRE(reader.refresh() == 1);
+  REQUIRE(reader.find({1, 2, 3, 4, 5}) == expected[0]);
+
+  // A torn record is skipped and the next append starts after it
+  {
+    std::ofstream out(cache_path, std::ios::binary | std::ios::app);
+    out << "torn";
+  }
+  {
+    digest_cache writer(cache_path, cache_options);
+    REQUIRE(writer.size() == paths.size() + 2);
+    REQUIRE(writer.insert({1, 2, 3, 4, 6}, expected[1], digest_cache::now_ns()));
+  }
+  REQUIRE(std::filesystem::file_size(cache_path) % 80 == 0);
+  REQUIRE(reader.refresh() == 1);
+  REQUIRE(reader.find({1, 2, 3, 4, 6}) == expected[1]);
+
+  // One record per file remains
+  digest_cache stale(cache_path, cache_options);
+  reader.compact();
+  REQUIRE(reader.size() == paths.size() + 1);
+  REQUIRE(std::filesystem::file_size(cache_path) == 80 * (paths.size() + 2));
+  REQUIRE(reader.find({1, 2, 3, 4, 6}) == expected[1]);
+  REQUIRE(digest_cache(cache_path).size() == paths.size() + 1);
+
+  // Instances that still have the old file open append to the new one
+  REQUIRE(stale.insert({1, 2, 3, 4, 7}, expected[2], digest_cache::now_ns()));
+  stale.flush();
+  REQUIRE(std::filesystem::file_size(cache_path) == 80 * (paths.size() + 3));
+  REQUIRE(reader.refresh() == 1);
+  REQUIRE(reader.find({1, 2, 3, 4, 7}) == expected[2]);
+  REQUIRE(digest_cache(cache_path).find({1, 2, 3, 4, 7}) == expected[2]);
+
+  REQUIRE_THROWS_AS(digest_cache(paths[1]), std::system_error);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Resumable hashing", "[file_hash]") {
+  auto dir = std::filesystem::temp_directory_path() / "sha256_resumable_hash_test";
+  std::vector<std::string> paths;
+  auto expected = write_random_files(dir, {300007}, paths);
+  std::vector<unsigned char> content(300007);
+  std::ifstream(paths[0], std::ios::binary)
+      .read(reinterpret_cast<char *>(content.data()), content.size());
+  auto checkpoint_path = (dir / "checkpoint").string();
+
+  // The state is the same for every backend, so one can resume another
+  std::vector<const sha256_backend *> resumable;
+  for (const auto &backend : sha256_backends()) {
+    if (backend.has(sha256_midstate)) {
+      resumable.push_back(&backend);
+    }
+  }
+  REQUIRE_FALSE(resumable.empty());
+  for (const auto *first : resumable) {
+    for (const auto *second : resumable) {
+      for (std::size_t split : {0, 1, 63, 64, 65, 1000, 300007}) {
+        INFO(first->name << " then " << second->name << " at " << split);
+        auto engine = first->create();
+        engine.add_bytes(content.data(), split);
+        sha256_state state = engine.save_state();
+        REQUIRE(state.bytes == split);
+        auto resumed = second->create();
+        resumed.add_bytes(content.data(), 5);
+        resumed.load_state(state);
+        resumed.add_bytes(content.data() + split, content.size() - split);
+        REQUIRE(resumed.digest() == expected[0]);
+      }
+    }
+  }
+
+  const sha256_backend &backend = *resumable.front();
+  resumable_hash_options options;
+  options.interval = 50000;
+  options.buffer_size = 4096;
+  auto result = hash_resumable(backend, paths[0].c_str(), checkpoint_path, options);
+  REQUIRE(result.error == 0);
+  REQUIRE(result.digest == expected[0]);
+  REQUIRE(result.bytes == content.size());
+  REQUIRE(result.resumed_from == 0);
+  REQUIRE(result.checkpoints == 6);
+  REQUIRE_FALSE(std::filesystem::exists(checkpoint_path));
+
+  // As if interrupted after 100000 bytes
+  struct stat st;
+  REQUIRE(::stat(paths[0].c_str(), &st) == 0);
+  auto engine = backend.create();
+  engine.add_bytes(content.data(), 100000);
+  REQUIRE(save_checkpoint(checkpoint_path, {make_file_key(st), engine.save_state()}));
+  auto loaded = load_checkpoint(checkpoint_path);
+  REQUIRE(loaded);
+  REQUIRE(loaded->file == make_file_key(st));
+  REQUIRE(loaded->state.bytes == 100000);
+  result = hash_resumable(backend, paths[0].c_str(), checkpoint_path, options);
+  REQUIRE(result.digest == expected[0]);
+  REQUIRE(result.resumed_from == 100000);
+  REQUIRE(result.checkpoints == 4);
+
+  // Not resumed from a checkpoint of a file that changed since
+  REQUIRE(save_checkpoint(checkpoint_path, {make_file_key(st), engine.save_state()}));
+  std::filesystem::last_write_time(
+      paths[0], std::filesystem::last_write_time(paths[0]) - std::chrono::hours(1));
+  result = hash_resumable(backend, paths[0].c_str(), checkpoint_path, options);
+  REQUIRE(result.digest == expected[0]);
+  REQUIRE(result.resumed_from == 0);
+
+  // Nor from a damaged one
+  REQUIRE(::stat(paths[0].c_str(), &st) == 0);
+  REQUIRE(save_checkpoint(checkpoint_path, {make_file_key(st), engine.save_state()}));
+  {
+    std::fstream file(checkpoint_path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(100);
+    file.put('x');
+  }
+  REQUIRE_FALSE(load_checkpoint(checkpoint_path));
+  REQUIRE(hash_resumable(backend, paths[0].c_str(), checkpoint_path, options).resumed_from == 0);
+
+  REQUIRE(hash_resumable(*find_sha256_backend("openssl"), paths[0].c_str(), checkpoint_path)
+              .error == ENOTSUP);
+  // zedwood's 32-bit length would give wrong digests past 2^29 bytes
+  REQUIRE(hash_resumable(*find_sha256_backend("zedwood"), paths[0].c_str(), checkpoint_path)
+              .error == ENOTSUP);
+  REQUIRE(hash_resumable(backend, dir.c_str(), checkpoint_path).error == EISDIR);
+  std::filesystem::remove_all(dir);
+}
+
+#ifdef SHA256_IO_URING
+struct uring_hash_test_access {
+  static void set_short_read_limit(uring_file_hasher &hasher, unsigned limit) {
+    hasher.short_read_limit = limit;
+  }
+};
+
+TEST_CASE("io_uring file hashing", "[file_hash]") {
+  auto dir = std::filesystem::temp_directory_path() / "sha256_uring_hash_test";
+  std::vector<std::string> paths;
+  // Sizes around the 4 KiB buffers
+  auto expected = write_random_files(
+      dir, {0, 1, 4095, 4096, 4097, 100000, 12288, 300007}, paths);
+  paths.push_back((dir / "missing").string());
+  paths.push_back(dir.string());
+
+  if (!uring_file_hasher(*sha256_backends().begin(), {}).available()) {
+    WARN("io_uring not available");
+    std::filesystem::remove_all(dir);
+    return;
+  }
+  for (unsigned queue_depth : {1u, 3u, 16u}) {
+    for (unsigned max_open_files : {1u, 4u}) {
+      INFO(queue_depth << " deep, " << max_open_files << " files");
+      uring_hash_options options;
+      options.queue_depth = queue_depth;
+      options.buffer_size = 4096;
+      options.max_open_files = max_open_files;
+      uring_file_hasher hasher(*sha256_backends().begin(), options);
+      REQUIRE(hasher.available());
+      auto results = hasher.hash(paths);
+      REQUIRE(results.size() == paths.size());
+      for (std::size_t i = 0; i < expected.size(); ++i) {
+        REQUIRE(results[i].error == 0);
+        REQUIRE(results[i].digest == expected[i]);
+      }
+      REQUIRE(results[expected.size()].error == ENOENT);
+      REQUIRE(results[expected.size() + 1].error == EISDIR);
+      REQUIRE(hasher.hash_path(paths[5].c_str()).digest == expected[5]);
+    }
+  }
+
+  // Short reads are completed, not taken for the end of the file
+  for (unsigned limit : {1u, 1000u}) {
+    INFO(limit << " bytes per read");
+    uring_hash_options options;
+    options.queue_depth = 4;
+    options.buffer_size = 4096;
+    uring_file_hasher hasher(*sha256_backends().begin(), options);
+    REQUIRE(hasher.available());
+    uring_hash_test_access::set_short_read_limit(hasher, limit);
+    auto results = hasher.hash(paths);
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      REQUIRE(results[i].error == 0);
+      REQUIRE(results[i].digest == expected[i]);
+    }
+  }
+  std::filesystem::remove_all(dir);
+}
+#endif // SHA256_IO_URING
+
+TEST_CASE("Blob store", "[blob_store]") {
+  auto dir = std::filesystem::temp_directory_path() / "sha256_blob_store_test";
+  std::filesystem::remove_all(dir);
+  std::mt19937_64 gen;
+  // Batches end after 1 MiB, and the last blob is a duplicate
+  std::vector<std::vector<unsigned char>> blobs;
+  for (std::size_t size : {0, 1, 100, 4096, 1100000, 70000, 300007}) {
+    blobs.emplace_back(size);
+    for (auto &byte : blobs.back()) {
+      byte = static_cast<unsigned char>(gen());
+    }
+  }
+  blobs.push_back(blobs[5]);
+  std::vector<sha256_digest> expected;
+  for (const auto &blob : blobs) {
+    sha256_zedwood reference;
+    reference.add_bytes(blob.data(), blob.size());
+    expected.push_back(reference.digest());
+  }
+  std::vector<sha256_input> inputs(blobs.begin(), blobs.end());
+
+  for (bool overlap : {false, true}) {
+    INFO("overlap " << overlap);
+    std::filesystem::remove_all(dir);
+    blob_store_options options;
+    options.overlap = overlap;
+    blob_store store(dir.string(), *sha256_backends().begin(), options);
+    REQUIRE(store.has_many(expected) == std::vector<bool>(blobs.size(), false));
+
+    auto results = store.put_many(inputs);
+    REQUIRE(results.size() == blobs.size());
+    for (std::size_t i = 0; i < blobs.size(); ++i) {
+      REQUIRE(results[i].digest == expected[i]);
+      REQUIRE(results[i].stored == (i + 1 < blobs.size()));
+      REQUIRE(store.get(expected[i]) == blobs[i]);
+    }
+    auto hex = to_hex(expected[2]);
+    REQUIRE(store.path(expected[2]) ==
+            (dir / hex.substr(0, 2) / hex.substr(2)).string());
+    REQUIRE(store.has_many(expected) == std::vector<bool>(blobs.size(), true));
+
+    // Nothing is written again
+    for (const auto &result : store.put_many(inputs)) {
+      REQUIRE_FALSE(result.stored);
+    }
+    REQUIRE_FALSE(store.put(blobs[3]).stored);
+    auto stats = store.stats();
+    REQUIRE(stats.blobs_stored == blobs.size() - 1);
+    REQUIRE(stats.blobs_deduplicated == blobs.size() + 2);
+
+    std::vector<unsigned char> fresh(10000, 7);
+    sha256_zedwood reference;
+    reference.add_bytes(fresh.data(), fresh.size());
+    {
+      auto writer = store.writer();
+      writer.write(std::span<const unsigned char>(fresh).first(3));
+      writer.write(std::span<const unsigned char>(fresh).subspan(3));
+      auto result = writer.commit();
+      REQUIRE(result.stored);
+      REQUIRE(result.digest == reference.digest());
+      REQUIRE(store.get(result.digest) == fresh);
+      auto again = store.writer();
+      again.write(fresh);
+      REQUIRE_FALSE(again.commit().stored);
+      // Discarded without a commit
+      auto dropped = store.writer();
+      dropped.write(blobs[1]);
+    }
+    sha256_digest missing = {};
+    REQUIRE_FALSE(store.has(missing));
+    REQUIRE_FALSE(store.get(missing));
+
+    std::size_t files = 0;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(dir)) {
+      files += entry.is_regular_file();
+    }
+    REQUIRE(files == blobs.size());
+  }
+  std::filesystem::remove_all(dir);
+}
+#endif
+
+#ifdef SHA256_HASH_SERVICE
+TEST_CASE("Hashing daemon", "[hash_service]") {
+  auto socket_path =
+      (std::filesystem::temp_directory_path() / "sha256_hash_service_test.sock").string();
+  auto server = std::make_unique<hash_server>(socket_path, *sha256_backends().begin(), 4);
+  std::thread serving([&server] { server->run(); });
+
+  {
+    hash_client client(socket_path, 1 << 16, 8);
+    REQUIRE(client.ring_slots() == 8);
+    auto arena = client.arena();
+    std::mt19937_64 gen;
+    for (auto &byte : arena) {
+      byte = static_cast<unsigned char>(gen());
+    }
+
+    // More requests than the daemon takes per batch, and more than the ring
+    // holds, with 64 byte messages for the multi-lane double hash
+    std::vector<hash_request> requests;
+    for (std::uint32_t i = 0; i < 20; ++i) {
+      std::uint32_t length = i % 3 == 0 ? 64 : i * 97;
+      requests.push_back({i, i * 1000u, length, i % 2 ? hash_op_sha256d : hash_op_sha256});
+    }
+    requests.push_back({100, arena.size() - 10, 11, hash_op_sha256});
+    requests.push_back({101, 0, 1, 7});
+
+    std::vector<hash_completion> received;
+    std::size_t next = 0;
+    std::vector<hash_completion> completions(8);
+    while (received.size() < requests.size()) {
+      while (next < requests.size() && client.submit(requests[next])) {
+        ++next;
+      }
+      client.flush();
+      std::size_t count = client.wait(completions, 5000);
+      REQUIRE(count > 0);
+      received.insert(received.end(), completions.begin(),
+                      completions.begin() + static_cast<std::ptrdiff_t>(count));
+    }
+
+    for (std::size_t i = 0; i < received.size(); ++i) {
+      // One client's completions arrive in submission order
+      const auto &request = requests[i];
+      REQUIRE(received[i].id == request.id);
+      if (request.id >= 100) {
+        REQUIRE(received[i].status == EINVAL);
+        continue;
+      }
+      REQUIRE(received[i].status == 0);
+      sha256_zedwood reference;
+      reference.add_bytes(arena.data() + request.offset, request.length);
+      auto expected = reference.digest();
+      if (request.op == hash_op_sha256d) {
+        reference.reset();
+        reference.add_bytes(expected.data(), expected.size());
+        expected = reference.digest();
+      }
+      REQUIRE(received[i].digest == expected);
+    }
+  }
+
+  {
+    // A plain file cannot be sealed against shrinking, so it is refused even
+    // at the size of a ring with one slot and a 4 KiB arena
+    int socket_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE(socket_fd >= 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE(::connect(socket_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file);
+    REQUIRE(::ftruncate(fileno(file), 8192) == 0);
+
+    // hello_message of hash_service.cpp
+    struct {
+      std::uint32_t magic, version, slots, reserved;
+      std::uint64_t arena_bytes;
+    } hello = {0x32353653, 1, 1, 0, 4096};
+    iovec iov = {&hello, sizeof(hello)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int fd = fileno(file);
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    REQUIRE(::sendmsg(socket_fd, &msg, MSG_NOSIGNAL) == sizeof(hello));
+    std::fclose(file);
+
+    std::int32_t welcome[2] = {};
+    REQUIRE(::recv(socket_fd, welcome, sizeof(welcome), MSG_WAITALL) == sizeof(welcome));
+    REQUIRE(welcome[0] == EINVAL);
+    char byte;
+    REQUIRE(::recv(socket_fd, &byte, 1, 0) == 0);
+    ::close(socket_fd);
+  }
+
+  server->stop();
+  serving.join();
+  REQUIRE(server->stats().requests == 22);
+  server.reset();
+  REQUIRE_THROWS_AS(hash_client(socket_path), std::system_error);
+}
+#endif // SHA256_HASH_SERVICE
+
+#ifdef SHA256_INGEST_SERVER
+TEST_CASE("Ingest server", "[ingest_server]") {
+  ingest_options options;
+  options.receive_buffer = 4096;
+  ingest_server server(options);
+  REQUIRE(server.port() != 0);
+  std::thread serving([&server] { server.run(); });
+
+  auto connect_to_server = [&server] {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    timeval timeout = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server.port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    return fd;
+  };
+  // Sends in uneven pieces so that headers and payloads get split
+  auto send_stream = [](int fd, const std::vector<unsigned char> &payload) {
+    std::vector<unsigned char> bytes(8);
+    for (std::size_t i = 0; i < 8; ++i) {
+      bytes[i] = static_cast<unsigned char>(std::uint64_t(payload.size()) >> (8 * i));
+    }
+    bytes.insert(bytes.end(), payload.begin(), payload.end());
+    std::size_t sent = 0;
+    for (std::size_t piece = 3; sent < bytes.size(); piece = piece * 7 % 5003 + 1) {
+      auto length = std::min(piece, bytes.size() - sent);
+      REQUIRE(::send(fd, bytes.data() + sent, length, MSG_NOSIGNAL) ==
+              static_cast<ssize_t>(length));
+      sent += length;
+    }
+  };
+  auto receive_digest = [](int fd) {
+    sha256_digest digest{};
+    std::size_t received = 0;
+    while (received < digest.size()) {
+      ssize_t num = ::recv(fd, digest.data() + received, digest.size() - received, 0);
+      REQUIRE(num > 0);
+      received += static_cast<std::size_t>(num);
+    }
+    return digest;
+  };
+
+  std::mt19937_64 gen;
+  const std::size_t sizes[] = {0, 1, 64, 4095, 4096, 4104, 100000};
+  std::vector<std::vector<unsigned char>> payloads;
+  for (std::size_t size : sizes) {
+    std::vector<unsigned char> payload(size);
+    for (auto &byte : payload) {
+      byte = static_cast<unsigned char>(gen());
+    }
+    payloads.push_back(std::move(payload));
+  }
+
+  // Streams back to back on one connection, interleaved with a second one
+  int first = connect_to_server();
+  int second = connect_to_server();
+  for (const auto &payload : payloads) {
+    sha256_zedwood reference;
+    reference.add_bytes(payload.data(), payload.size());
+    auto expected = reference.digest();
+    send_stream(first, payload);
+    send_stream(second, payload);
+    REQUIRE(receive_digest(second) == expected);
+    REQUIRE(receive_digest(first) == expected);
+  }
+  // A connection closed in the middle of a stream is dropped
+  ::send(second, "\x10\0\0\0\0\0\0\0abc", 11, MSG_NOSIGNAL);
+  ::close(second);
+  ::close(first);
+
+  server.stop();
+  serving.join();
+  auto stats = server.stats();
+  REQUIRE(stats.streams == 2 * payloads.size());
+  REQUIRE(stats.peak_connections == 2);
+  REQUIRE(ingest_server::connection_bytes() < 256);
+}
+#endif // SHA256_INGEST_SERVER
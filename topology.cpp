@@ -0,0 +1,84 @@
+#include "topology.h"
+
+#include <iostream>
+
+int getPhysicalCores()
+{
+  static const int num_physical_cores = []()
+  {
+    int num_physical_cores = 8;
+    int res = 0;
+    hwloc_topology_t topology;
+    if (hwloc_topology_init(&topology) != 0)
+    {
+      goto cleanup;
+    }
+    if (hwloc_topology_load(topology) != 0)
+    {
+      goto cleanup;
+    }
+    res = hwloc_get_nbobjs_by_type(topology, hwloc_obj_type_t::HWLOC_OBJ_CORE);
+    if (res > 0)
+    {
+      num_physical_cores = res;
+    }
+  cleanup:
+    hwloc_topology_destroy(topology);
+    if (res <= 0)
+    {
+      std::cerr << "Could not determine number of physical cores\n";
+    }
+    return num_physical_cores;
+  }();
+
+  return num_physical_cores;
+}
+
+hwloc_topology_t getTopology()
+{
+  static const hwloc_topology_t topology = []()
+  {
+    hwloc_topology_t topology = nullptr;
+    if (hwloc_topology_init(&topology) != 0)
+    {
+      return static_cast<hwloc_topology_t>(nullptr);
+    }
+    if (hwloc_topology_load(topology) != 0)
+    {
+      hwloc_topology_destroy(topology);
+      return static_cast<hwloc_topology_t>(nullptr);
+    }
+    return topology;
+  }();
+
+  return topology;
+}
+
+bool bindThreadToCore(int core_index)
+{
+  hwloc_topology_t topology = getTopology();
+  if (!topology)
+  {
+    return false;
+  }
+  unsigned num_cores = static_cast<unsigned>(getPhysicalCores());
+  hwloc_obj_t core = hwloc_get_obj_by_type(
+      topology, hwloc_obj_type_t::HWLOC_OBJ_CORE,
+      static_cast<unsigned>(core_index) % num_cores);
+  if (!core)
+  {
+    return false;
+  }
+  return hwloc_set_cpubind(topology, core->cpuset, HWLOC_CPUBIND_THREAD) == 0;
+}
+
+void unbindThread()
+{
+  hwloc_topology_t topology = getTopology();
+  if (!topology)
+  {
+    return;
+  }
+  hwloc_set_cpubind(topology, hwloc_topology_get_topology_cpuset(topology),
+                    HWLOC_CPUBIND_THREAD);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <hwloc.h>
+
+// Number of physical cores, 8 if it cannot be determined
+int getPhysicalCores();
+
+// Process-wide hwloc topology, loaded on first use. nullptr on failure.
+hwloc_topology_t getTopology();
+
+// Bind the calling thread to a physical core. Indices wrap around so that
+// oversubscribed configurations still run.
+bool bindThreadToCore(int core_index);
+
+// Allow the calling thread to run on all cores again
+void unbindThread();
@@ -0,0 +1,458 @@
+#include "uring_hash.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// The raw system calls are used since liburing is not a dependency of this
+// repository.
+namespace
+{
+int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+unsigned load_acquire(const unsigned *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *ptr, unsigned value)
+{
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+struct buffer_state
+{
+  std::size_t slot = 0;
+  std::uint64_t offset = 0;
+  unsigned length = 0;
+  int res = 0;
+  bool done = false;
+};
+
+// One file being read through the ring
+struct file_slot
+{
+  explicit file_slot(const sha256_backend &backend) : engine(backend.create()) {}
+
+  sha256_engine engine;
+  bool active = false;
+  std::size_t index = 0;
+  int fd = -1;
+  // Bytes to hash; lowered if the file turns out to be shorter
+  std::uint64_t end = 0;
+  std::uint64_t submitted = 0;
+  // Buffers in submission order, hashed from the front
+  std::deque<unsigned> in_flight;
+  file_hash_result result;
+};
+} // namespace
+
+struct uring_file_hasher::ring_state
+{
+  void *sq_map = MAP_FAILED;
+  std::size_t sq_map_size = 0;
+  void *cq_map = MAP_FAILED;
+  std::size_t cq_map_size = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  std::size_t sqes_size = 0;
+
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  // READ_FIXED if registering the buffers succeeded, e.g. within RLIMIT_MEMLOCK
+  bool fixed_buffers = false;
+};
+
+void uring_file_hasher::aligned_free::operator()(unsigned char *ptr) const
+{
+  std::free(ptr);
+}
+
+uring_file_hasher::uring_file_hasher(const sha256_backend &backend,
+                                     const uring_hash_options &options)
+    : backend(backend), opts(options),
+      fallback(backend, {io_strategy::read, options.buffer_size, {}}),
+      ring(std::make_unique<ring_state>())
+{
+  opts.queue_depth = std::clamp(opts.queue_depth, 1u, 4096u);
+  opts.max_open_files = (std::max)(opts.max_open_files, 1u);
+  opts.buffer_size = fallback.options().buffer_size;
+  if (!setup())
+  {
+    error = errno;
+    teardown();
+  }
+}
+
+uring_file_hasher::~uring_file_hasher()
+{
+  teardown();
+}
+
+bool uring_file_hasher::setup()
+{
+  buffers.reset(static_cast<unsigned char *>(std::aligned_alloc(
+      file_hasher::direct_alignment, opts.queue_depth * opts.buffer_size)));
+  if (!buffers)
+  {
+    errno = ENOMEM;
+    return false;
+  }
+
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  ring_fd = io_uring_setup(opts.queue_depth, &params);
+  if (ring_fd < 0)
+  {
+    return false;
+  }
+
+  auto &r = *ring;
+  r.sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  r.cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+  {
+    r.sq_map_size = r.cq_map_size = (std::max)(r.sq_map_size, r.cq_map_size);
+  }
+  r.sq_map = ::mmap(nullptr, r.sq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (r.sq_map == MAP_FAILED)
+  {
+    return false;
+  }
+  if (!single_mmap)
+  {
+    r.cq_map = ::mmap(nullptr, r.cq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (r.cq_map == MAP_FAILED)
+    {
+      return false;
+    }
+  }
+  r.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  r.sqes = static_cast<io_uring_sqe *>(::mmap(nullptr, r.sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring_fd,
+                                              IORING_OFF_SQES));
+  if (r.sqes == MAP_FAILED)
+  {
+    return false;
+  }
+
+  auto *sq = static_cast<unsigned char *>(r.sq_map);
+  auto *cq = static_cast<unsigned char *>(single_mmap ? r.sq_map : r.cq_map);
+  r.sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  r.sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  r.sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  r.cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  r.cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  r.cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  r.cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  std::vector<iovec> iovs(opts.queue_depth);
+  for (unsigned i = 0; i < opts.queue_depth; ++i)
+  {
+    iovs[i].iov_base = buffers.get() + i * opts.buffer_size;
+    iovs[i].iov_len = opts.buffer_size;
+  }
+  r.fixed_buffers =
+      io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iovs.data(), opts.queue_depth) == 0;
+  return true;
+}
+
+void uring_file_hasher::teardown()
+{
+  auto &r = *ring;
+  if (r.sqes != MAP_FAILED)
+  {
+    ::munmap(r.sqes, r.sqes_size);
+    r.sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  }
+  if (r.cq_map != MAP_FAILED)
+  {
+    ::munmap(r.cq_map, r.cq_map_size);
+    r.cq_map = MAP_FAILED;
+  }
+  if (r.sq_map != MAP_FAILED)
+  {
+    ::munmap(r.sq_map, r.sq_map_size);
+    r.sq_map = MAP_FAILED;
+  }
+  if (ring_fd >= 0)
+  {
+    // Also unregisters the buffers
+    ::close(ring_fd);
+    ring_fd = -1;
+  }
+}
+
+file_hash_result uring_file_hasher::hash_path(const char *path)
+{
+  return hash({path}).front();
+}
+
+std::vector<file_hash_result>
+uring_file_hasher::hash(const std::vector<std::string> &paths)
+{
+  std::vector<file_hash_result> results(paths.size());
+  if (!available())
+  {
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+      results[i] = fallback.hash_path(paths[i].c_str());
+    }
+    return results;
+  }
+
+  auto &r = *ring;
+  std::vector<file_slot> slots;
+  slots.reserve(opts.max_open_files);
+  for (unsigned i = 0; i < opts.max_open_files; ++i)
+  {
+    slots.emplace_back(backend);
+  }
+  std::vector<buffer_state> states(opts.queue_depth);
+  std::vector<unsigned> free_buffers;
+  for (unsigned i = opts.queue_depth; i-- > 0;)
+  {
+    free_buffers.push_back(i);
+  }
+
+  std::size_t next_path = 0;
+  unsigned in_flight = 0;
+  // Queued in the submission ring but not yet consumed by the kernel
+  unsigned unsubmitted = 0;
+
+  auto finish = [&](file_slot &slot)
+  {
+    if (slot.result.error == 0)
+    {
+      slot.result.digest = slot.engine.digest();
+    }
+    results[slot.index] = slot.result;
+    ::close(slot.fd);
+    slot.fd = -1;
+    slot.active = false;
+  };
+
+  // Opens the next files until the slot holds one with data to read
+  auto open_next = [&](file_slot &slot)
+  {
+    while (!slot.active && next_path < paths.size())
+    {
+      std::size_t index = next_path++;
+      int fd = ::open(paths[index].c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        results[index].error = errno;
+        continue;
+      }
+      struct stat st;
+      if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+      {
+        // Pipes and devices have no size to split into reads
+        results[index] = fallback.hash_fd(fd);
+        ::close(fd);
+        continue;
+      }
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      slot.active = true;
+      slot.index = index;
+      slot.fd = fd;
+      slot.end = static_cast<std::uint64_t>(st.st_size);
+      slot.submitted = 0;
+      slot.result = {};
+      slot.engine.reset();
+      if (slot.end == 0)
+      {
+        finish(slot);
+      }
+    }
+  };
+
+  for (;;)
+  {
+    for (auto &slot : slots)
+    {
+      open_next(slot);
+    }
+
+    // One read per file and pass, so all open files make progress
+    unsigned to_submit = unsubmitted;
+    for (bool progress = true; progress && !free_buffers.empty();)
+    {
+      progress = false;
+      for (std::size_t s = 0; s < slots.size() && !free_buffers.empty(); ++s)
+      {
+        auto &slot = slots[s];
+        if (!slot.active || slot.result.error != 0 || slot.submitted >= slot.end)
+        {
+          continue;
+        }
+        unsigned buffer = free_buffers.back();
+        free_buffers.pop_back();
+        auto &state = states[buffer];
+        state.slot = s;
+        state.offset = slot.submitted;
+        state.length = static_cast<unsigned>(
+            (std::min)(static_cast<std::uint64_t>(opts.buffer_size), slot.end - slot.submitted));
+        state.done = false;
+        slot.submitted += state.length;
+        slot.in_flight.push_back(buffer);
+
+        unsigned tail = *r.sq_tail;
+        unsigned index = tail & *r.sq_mask;
+        io_uring_sqe &sqe = r.sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = r.fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = slot.fd;
+        sqe.off = state.offset;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffers.get() + buffer * opts.buffer_size);
+        sqe.len = state.length;
+        sqe.buf_index = static_cast<std::uint16_t>(buffer);
+        sqe.user_data = buffer;
+        r.sq_array[index] = index;
+        store_release(r.sq_tail, tail + 1);
+        ++to_submit;
+        progress = true;
+      }
+    }
+    if (in_flight == 0 && to_submit == 0)
+    {
+      break;
+    }
+
+    for (;;)
+    {
+      int ret = io_uring_enter(ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+      if (ret >= 0)
+      {
+        // The kernel may consume fewer entries than passed, e.g. when short of
+        // memory; the rest stay queued and are passed again next time
+        in_flight += static_cast<unsigned>(ret);
+        unsubmitted = to_submit - static_cast<unsigned>(ret);
+        break;
+      }
+      if (errno != EINTR)
+      {
+        // The ring is unusable; complete the remaining files without it
+        error = errno;
+        teardown();
+        for (auto &slot : slots)
+        {
+          if (slot.active)
+          {
+            results[slot.index] = fallback.hash_path(paths[slot.index].c_str());
+            ::close(slot.fd);
+          }
+        }
+        for (; next_path < paths.size(); ++next_path)
+        {
+          results[next_path] = fallback.hash_path(paths[next_path].c_str());
+        }
+        return results;
+      }
+    }
+
+    unsigned head = *r.cq_head;
+    unsigned tail = load_acquire(r.cq_tail);
+    for (; head != tail; ++head)
+    {
+      const io_uring_cqe &cqe = r.cqes[head & *r.cq_mask];
+      auto &state = states[static_cast<unsigned>(cqe.user_data)];
+      state.res = cqe.res;
+      if (short_read_limit != 0 && state.res > static_cast<int>(short_read_limit))
+      {
+        state.res = static_cast<int>(short_read_limit);
+      }
+      state.done = true;
+      --in_flight;
+    }
+    store_release(r.cq_head, head);
+
+    // Hash the completed prefix of every file in order
+    for (auto &slot : slots)
+    {
+      while (slot.active && !slot.in_flight.empty() && states[slot.in_flight.front()].done)
+      {
+        unsigned buffer = slot.in_flight.front();
+        slot.in_flight.pop_front();
+        free_buffers.push_back(buffer);
+        const auto &state = states[buffer];
+        // Nothing to do for failed files and reads past the end of a file
+        // that shrank
+        if (slot.result.error == 0 && state.offset < slot.end && state.res < 0 &&
+            state.res != -EAGAIN && state.res != -EINTR)
+        {
+          slot.result.error = -state.res;
+        }
+        else if (slot.result.error == 0 && state.offset < slot.end)
+        {
+          // A short read does not mean the end of the file: the rest of the
+          // buffer is read with pread(), and only a read of 0 bytes ends the
+          // file early
+          unsigned char *data = buffers.get() + buffer * opts.buffer_size;
+          std::size_t length = state.res > 0 ? static_cast<std::size_t>(state.res) : 0;
+          bool eof = state.res == 0;
+          while (!eof && length < state.length)
+          {
+            ssize_t got = ::pread(slot.fd, data + length, state.length - length,
+                                  static_cast<off_t>(state.offset + length));
+            if (got < 0 && errno != EINTR)
+            {
+              slot.result.error = errno;
+              break;
+            }
+            eof = got == 0;
+            length += got > 0 ? static_cast<std::size_t>(got) : 0;
+          }
+          if (slot.result.error == 0)
+          {
+            if (length < state.length)
+            {
+              // The file shrank; hash what was there
+              slot.end = state.offset + length;
+            }
+            slot.engine.add_bytes(data, length);
+            slot.result.bytes += length;
+          }
+        }
+        if (slot.in_flight.empty() &&
+            (slot.result.error != 0 || slot.submitted >= slot.end))
+        {
+          finish(slot);
+        }
+      }
+    }
+  }
+  return results;
+}
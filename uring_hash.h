@@ -0,0 +1,65 @@
+#pragma once
+
+#include "file_hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct uring_hash_options
+{
+  // Reads in flight, across all open files
+  unsigned queue_depth = 16;
+  // Size of each registered buffer
+  std::size_t buffer_size = std::size_t(128) << 10;
+  // Files read concurrently through the ring
+  unsigned max_open_files = 8;
+};
+
+// Hashes files through an io_uring with registered (fixed) buffers, so reads
+// of the next buffers and files overlap with hashing on the calling thread.
+// Completed buffers are hashed in file order. Linux only; without io_uring
+// support (old kernel, seccomp) every file takes the plain read() path.
+class uring_file_hasher
+{
+public:
+  uring_file_hasher(const sha256_backend &backend, const uring_hash_options &options);
+  ~uring_file_hasher();
+
+  uring_file_hasher(const uring_file_hasher &) = delete;
+  uring_file_hasher &operator=(const uring_file_hasher &) = delete;
+
+  // results[i] belongs to paths[i]
+  std::vector<file_hash_result> hash(const std::vector<std::string> &paths);
+  file_hash_result hash_path(const char *path);
+
+  // false if the ring could not be set up; errno value in setup_error()
+  bool available() const { return ring_fd >= 0; }
+  int setup_error() const { return error; }
+  const uring_hash_options &options() const { return opts; }
+
+private:
+  // Defined by the tests only
+  friend struct uring_hash_test_access;
+
+  struct ring_state;
+  struct aligned_free
+  {
+    void operator()(unsigned char *ptr) const;
+  };
+
+  bool setup();
+  void teardown();
+
+  const sha256_backend &backend;
+  uring_hash_options opts;
+  file_hasher fallback;
+  std::unique_ptr<unsigned char, aligned_free> buffers;
+  std::unique_ptr<ring_state> ring;
+  int ring_fd = -1;
+  int error = 0;
+  // Completed reads are cut to at most this many bytes, as if the kernel had
+  // returned a short read; 0 keeps them whole
+  unsigned short_read_limit = 0;
+};
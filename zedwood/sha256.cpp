@@ -101,6 +101,21 @@ namespace zedwood
         m_tot_len = 0;
     }
 
+    void SHA256::get_state(uint32 h[8], unsigned char *partial, uint64 &bytes) const
+    {
+        memcpy(h, m_h, sizeof(m_h));
+        memcpy(partial, m_block, m_len);
+        bytes = uint64(m_tot_len) + m_len;
+    }
+
+    void SHA256::set_state(const uint32 h[8], const unsigned char *partial, uint64 bytes)
+    {
+        memcpy(m_h, h, sizeof(m_h));
+        m_len = static_cast<unsigned int>(bytes % SHA224_256_BLOCK_SIZE);
+        m_tot_len = static_cast<unsigned int>(bytes - m_len);
+        memcpy(m_block, partial, m_len);
+    }
+
     void SHA256::update(const unsigned char *message, unsigned int len)
     {
         unsigned int block_nb;
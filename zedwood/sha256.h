@@ -19,6 +19,10 @@ namespace zedwood
         void init();
         void update(const unsigned char *message, unsigned int len);
         void final(unsigned char *digest);
+        // Intermediate state: chaining value, the buffered bytes of the
+        // incomplete block and the number of bytes hashed, below 2^32
+        void get_state(uint32 h[8], unsigned char *partial, uint64 &bytes) const;
+        void set_state(const uint32 h[8], const unsigned char *partial, uint64 bytes);
         static const unsigned int DIGEST_SIZE = (256 / 8);
 
     protected: